@@ -0,0 +1,137 @@
+// ==========================================================================
+// Memory-mapped asset pack
+// ==========================================================================
+
+#include "assetpack.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+AssetPack::AssetPack() : data(0), size(0), entries(0), entryCount(0),
+#ifdef _WIN32
+	file(0), mapping(0)
+#else
+	file(-1)
+#endif
+{}
+
+// maps the whole file read-only; false if it cannot be opened
+static bool MapFile(AssetPack *pack, const string &path)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	pack->file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return false;
+	pack->mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (!pack->mapping) return false;
+	pack->data = (const unsigned char*)MapViewOfFile(pack->mapping, FILE_MAP_READ, 0, 0, 0);
+	pack->size = size_t(size.QuadPart);
+#else
+	pack->file = open(path.c_str(), O_RDONLY);
+	if (pack->file < 0) return false;
+
+	struct stat status;
+	if (fstat(pack->file, &status) != 0 || status.st_size == 0) return false;
+	void *mapped = mmap(0, size_t(status.st_size), PROT_READ, MAP_PRIVATE, pack->file, 0);
+	if (mapped == MAP_FAILED) return false;
+	pack->data = (const unsigned char*)mapped;
+	pack->size = size_t(status.st_size);
+
+	// every blob is read front to back exactly once, so let the kernel
+	// start fetching ahead of the first upload
+	madvise(mapped, pack->size, MADV_WILLNEED);
+#endif
+	return pack->data != 0;
+}
+
+bool OpenAssetPack(AssetPack *pack, const string &path)
+{
+	if (!MapFile(pack, path)) {
+		CloseAssetPack(pack);
+		return false;
+	}
+
+	const AssetPackHeader *header = (const AssetPackHeader*)pack->data;
+	if (pack->size < sizeof(AssetPackHeader) || memcmp(header->magic, ASSET_PACK_MAGIC, 8) != 0
+		|| header->version != ASSET_PACK_VERSION) {
+		cout << "ERROR: " << path << " is not a version " << ASSET_PACK_VERSION << " asset pack" << endl;
+		CloseAssetPack(pack);
+		return false;
+	}
+
+	// a truncated pack is rejected here, not when a blob is first touched
+	size_t indexEnd = sizeof(AssetPackHeader) + size_t(header->entryCount) * sizeof(AssetEntry);
+	bool valid = indexEnd <= pack->size;
+	const AssetEntry *entries = (const AssetEntry*)(pack->data + sizeof(AssetPackHeader));
+	for (uint32_t i = 0; valid && i < header->entryCount; i++) {
+		valid = entries[i].offset <= pack->size && entries[i].size <= pack->size - entries[i].offset
+			&& memchr(entries[i].name, 0, sizeof(entries[i].name)) != 0;
+	}
+	if (!valid) {
+		cout << "ERROR: " << path << " is truncated or corrupt" << endl;
+		CloseAssetPack(pack);
+		return false;
+	}
+
+	pack->entries = entries;
+	pack->entryCount = header->entryCount;
+	cout << "Mapped " << pack->entryCount << " assets from " << path << endl;
+	return true;
+}
+
+const AssetEntry *FindAsset(const AssetPack *pack, const string &name, uint32_t type)
+{
+	for (uint32_t i = 0; i < pack->entryCount; i++) {
+		if (pack->entries[i].type == type && name == pack->entries[i].name)
+			return &pack->entries[i];
+	}
+	return 0;
+}
+
+const unsigned char *AssetData(const AssetPack *pack, const AssetEntry *entry)
+{
+	return pack->data + entry->offset;
+}
+
+string AssetName(const string &path)
+{
+	string name = path.compare(0, 2, "./") == 0 ? path.substr(2) : path;
+	size_t dot = name.find_last_of('.');
+	size_t slash = name.find_last_of("/\\");
+	if (dot != string::npos && (slash == string::npos || dot > slash))
+		name.erase(dot);
+	return name;
+}
+
+void CloseAssetPack(AssetPack *pack)
+{
+#ifdef _WIN32
+	if (pack->data) UnmapViewOfFile(pack->data);
+	if (pack->mapping) CloseHandle(pack->mapping);
+	if (pack->file && pack->file != INVALID_HANDLE_VALUE) CloseHandle(pack->file);
+	pack->file = pack->mapping = 0;
+#else
+	if (pack->data) munmap((void*)pack->data, pack->size);
+	if (pack->file >= 0) close(pack->file);
+	pack->file = -1;
+#endif
+	pack->data = 0;
+	pack->size = 0;
+	pack->entries = 0;
+	pack->entryCount = 0;
+}
@@ -0,0 +1,110 @@
+// ==========================================================================
+// Memory-mapped asset pack
+//
+// One file holding what startup would otherwise build or decode: the sphere
+// chain's packed vertices, indices and levels, pre-compressed textures with
+// their mips, and shader sources. It is a header, an index of entries and
+// the blobs they name, each blob starting on an ASSET_PACK_ALIGNMENT
+// boundary:
+//
+//	AssetPackHeader				magic, version, entry count
+//	AssetEntry[entryCount]			name, type, format, offset, size
+//	blobs					each aligned, in index order
+//
+// Structures are stored as the packing machine lays them out in memory,
+// little-endian on everything this runs on. The pack is mapped rather than
+// read, so opening it costs nothing up front and each blob is paged in from
+// disk at the moment it is uploaded, straight from the mapping; startup is
+// then bound by I/O rather than by generating and decoding.
+// tools/packassets.cpp writes packs.
+// ==========================================================================
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define ASSET_PACK_MAGIC "A5PACK\0\0"
+#define ASSET_PACK_VERSION 1
+
+// blobs start on boundaries this far apart, enough for any vertex attribute
+// and for the driver to copy from them in whole cache lines
+#define ASSET_PACK_ALIGNMENT 64
+
+// the sphere chain's entries, as BuildSphereChain packs it
+#define ASSET_SPHERE_VERTICES "mesh/sphere/vertices"
+#define ASSET_SPHERE_INDICES "mesh/sphere/indices"
+#define ASSET_SPHERE_LODS "mesh/sphere/lods"
+
+enum AssetType
+{
+	ASSET_VERTICES = 1,		// format is the PositionFormat they are packed with
+	ASSET_INDICES,			// GLuint
+	ASSET_LODS,			// AssetLOD, coarsest first
+	ASSET_TEXTURE,			// a KTX2 container
+	ASSET_SHADER			// GLSL source text
+};
+
+struct AssetPackHeader
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t entryCount;
+};
+
+struct AssetEntry
+{
+	char     name[48];		// NUL terminated
+	uint32_t type;
+	uint32_t format;
+	uint64_t offset;		// from the start of the pack
+	uint64_t size;
+};
+
+// one level of a packed chain, as AddLOD takes it
+struct AssetLOD
+{
+	int32_t firstIndex;
+	int32_t indexCount;
+	int32_t baseVertex;
+	int32_t columns;
+	int32_t rings;
+	float   maxRadius;
+};
+
+struct AssetPack
+{
+	const unsigned char *data;
+	size_t               size;
+	const AssetEntry    *entries;
+	uint32_t             entryCount;
+
+	// the operating system's handles on the file and its mapping
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#else
+	int   file;
+#endif
+
+	AssetPack();
+};
+
+// maps the pack at path and checks its index; quietly returns false if
+// there is no such file
+bool OpenAssetPack(AssetPack *pack, const std::string &path);
+
+// the entry of the given name and type, or null if the pack has none
+const AssetEntry *FindAsset(const AssetPack *pack, const std::string &name, uint32_t type);
+
+// where an entry's blob sits in the mapping
+const unsigned char *AssetData(const AssetPack *pack, const AssetEntry *entry);
+
+// the name a file is packed under: its path without a leading "./" or its
+// extension, so textures/earth.jpg finds the packed textures/earth.ktx2
+std::string AssetName(const std::string &path);
+
+void CloseAssetPack(AssetPack *pack);
+
+#endif
@@ -0,0 +1,159 @@
+// ==========================================================================
+// Headless benchmark runs
+// ==========================================================================
+
+#include "benchmark.h"
+#include "gldebug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <string>
+
+using namespace std;
+using namespace glm;
+
+Benchmark::Benchmark() : warmupFrames(60), measuredFrames(600), asteroids(0), interval(0.f), threads(0),
+	width(0), height(0), framebuffer(0), colourBuffer(0), depthBuffer(0), frame(0),
+	instances(0), vertices(0), drawCalls(0)
+{
+	for (int i = 0; i < BENCHMARK_FRAMES_IN_FLIGHT; i++)
+		fences[i] = 0;
+}
+
+bool InitializeBenchmark(Benchmark *benchmark, int width, int height)
+{
+	benchmark->width = width;
+	benchmark->height = height;
+	benchmark->frameTimes.reserve(benchmark->measuredFrames);
+
+	glGenRenderbuffers(1, &benchmark->colourBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, benchmark->colourBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &benchmark->depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, benchmark->depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &benchmark->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, benchmark->framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, benchmark->colourBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, benchmark->depthBuffer);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	benchmark->last = chrono::steady_clock::now();
+	return complete && !CheckGLErrors();
+}
+
+vec3 BenchmarkCameraStep(int frame)
+{
+	// a full turn about every 20 seconds at 60 frames a second, a slow bob
+	// and a zoom that takes the camera into the belt and back out
+	float t = float(frame);
+	return vec3(3.f, 4.f * sinf(t * 0.01f), 1.5f * sinf(t * 0.005f));
+}
+
+double BenchmarkClock(const Benchmark *benchmark)
+{
+	return (benchmark->frame + 1) * BENCHMARK_FRAME_TIME;
+}
+
+void BindBenchmarkTarget(const Benchmark *benchmark)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, benchmark->framebuffer);
+	glViewport(0, 0, benchmark->width, benchmark->height);
+}
+
+bool EndBenchmarkFrame(Benchmark *benchmark, const ProfileCounters &counters)
+{
+	// wait for the frame BENCHMARK_FRAMES_IN_FLIGHT ago, which keeps the
+	// CPU from running arbitrarily far ahead
+	int slot = benchmark->frame % BENCHMARK_FRAMES_IN_FLIGHT;
+	if (benchmark->fences[slot]) {
+		glClientWaitSync(benchmark->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+		glDeleteSync(benchmark->fences[slot]);
+	}
+	benchmark->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	double milliseconds = chrono::duration<double, milli>(now - benchmark->last).count();
+	benchmark->last = now;
+
+	if (benchmark->frame >= benchmark->warmupFrames) {
+		benchmark->frameTimes.push_back(milliseconds);
+		benchmark->instances += counters.instances;
+		benchmark->vertices += counters.vertices;
+		benchmark->drawCalls += counters.drawCalls;
+	}
+
+	benchmark->frame++;
+	return benchmark->frame < benchmark->warmupFrames + benchmark->measuredFrames;
+}
+
+// nearest-rank percentile of sorted times
+static double Percentile(const vector<double> &sorted, double percent)
+{
+	if (sorted.empty()) return 0.0;
+	size_t rank = size_t(ceil(percent / 100.0 * sorted.size()));
+	return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// strings from the driver could hold anything
+static string JSONString(const char *text)
+{
+	string quoted = "\"";
+	for (const char *c = text ? text : ""; *c; c++) {
+		if (*c == '"' || *c == '\\') quoted += '\\';
+		if ((unsigned char)*c >= 0x20) quoted += *c;
+	}
+	return quoted + "\"";
+}
+
+void ReportBenchmark(const Benchmark *benchmark, ostream &out)
+{
+	vector<double> sorted = benchmark->frameTimes;
+	sort(sorted.begin(), sorted.end());
+
+	double total = 0.0;
+	for (size_t i = 0; i < sorted.size(); i++)
+		total += sorted[i];
+	double seconds = total / 1000.0;
+	double frames = double(sorted.size());
+
+	out << fixed << setprecision(3)
+		<< "{\n"
+		<< "  \"renderer\": " << JSONString((const char*)glGetString(GL_RENDERER)) << ",\n"
+		<< "  \"version\": " << JSONString((const char*)glGetString(GL_VERSION)) << ",\n"
+		<< "  \"width\": " << benchmark->width << ",\n"
+		<< "  \"height\": " << benchmark->height << ",\n"
+		<< "  \"asteroids\": " << benchmark->asteroids << ",\n"
+		<< "  \"interval\": " << benchmark->interval << ",\n"
+		<< "  \"threads\": " << benchmark->threads << ",\n"
+		<< "  \"warmup_frames\": " << benchmark->warmupFrames << ",\n"
+		<< "  \"frames\": " << sorted.size() << ",\n"
+		<< "  \"frame_ms\": {"
+		<< " \"mean\": " << (frames > 0 ? total / frames : 0.0)
+		<< ", \"min\": " << (sorted.empty() ? 0.0 : sorted.front())
+		<< ", \"p50\": " << Percentile(sorted, 50.0)
+		<< ", \"p95\": " << Percentile(sorted, 95.0)
+		<< ", \"p99\": " << Percentile(sorted, 99.0)
+		<< ", \"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << " },\n"
+		<< "  \"fps\": " << (seconds > 0 ? frames / seconds : 0.0) << ",\n"
+		<< "  \"draw_calls_per_frame\": " << (frames > 0 ? benchmark->drawCalls / frames : 0.0) << ",\n"
+		<< "  \"instances_per_second\": " << (seconds > 0 ? benchmark->instances / seconds : 0.0) << ",\n"
+		<< "  \"vertices_per_second\": " << (seconds > 0 ? benchmark->vertices / seconds : 0.0) << "\n"
+		<< "}" << endl;
+}
+
+void DestroyBenchmark(Benchmark *benchmark)
+{
+	for (int i = 0; i < BENCHMARK_FRAMES_IN_FLIGHT; i++) {
+		if (benchmark->fences[i]) glDeleteSync(benchmark->fences[i]);
+		benchmark->fences[i] = 0;
+	}
+	glDeleteFramebuffers(1, &benchmark->framebuffer);
+	glDeleteRenderbuffers(1, &benchmark->colourBuffer);
+	glDeleteRenderbuffers(1, &benchmark->depthBuffer);
+	benchmark->framebuffer = benchmark->colourBuffer = benchmark->depthBuffer = 0;
+}
@@ -0,0 +1,83 @@
+// ==========================================================================
+// Headless benchmark runs
+//
+// With --benchmark the application renders into an offscreen framebuffer of
+// a hidden window, without vsync, while the camera follows a fixed path and
+// the simulation clock advances BENCHMARK_FRAME_TIME per frame, however long
+// the frame took, so every run draws exactly the same frames; shaders see
+// that clock too. After a number of warm-up frames the time of every
+// measured frame is recorded, and ReportBenchmark prints percentiles and
+// throughput as one JSON object for comparing builds.
+//
+// At most BENCHMARK_FRAMES_IN_FLIGHT frames are allowed to queue up on the
+// GPU, so frame times measure what the GPU sustains and not how fast the
+// driver accepts commands.
+// ==========================================================================
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "profiler.h"
+
+#define BENCHMARK_FRAMES_IN_FLIGHT 2
+
+// simulated seconds per frame
+#define BENCHMARK_FRAME_TIME (1.0/60.0)
+
+struct Benchmark
+{
+	int warmupFrames;
+	int measuredFrames;
+
+	// what the run was configured with, echoed in the report
+	int   asteroids;
+	float interval;
+	int   threads;
+	int   width;
+	int   height;
+
+	// offscreen target
+	GLuint framebuffer;
+	GLuint colourBuffer;
+	GLuint depthBuffer;
+
+	// one fence per frame in flight
+	GLsync fences[BENCHMARK_FRAMES_IN_FLIGHT];
+
+	int frame;
+	std::chrono::steady_clock::time_point last;
+	std::vector<double> frameTimes;
+	unsigned long long instances;
+	unsigned long long vertices;
+	unsigned long long drawCalls;
+
+	Benchmark();
+};
+
+// creates the offscreen target
+bool InitializeBenchmark(Benchmark *benchmark, int width, int height);
+
+// the camera move for the given frame: an orbit around the sun that drifts
+// up and down, zooming in and out, in the units Camera::move takes
+glm::vec3 BenchmarkCameraStep(int frame);
+
+// the simulation clock, in seconds, at the end of the current frame
+double BenchmarkClock(const Benchmark *benchmark);
+
+// binds the offscreen target; call before clearing
+void BindBenchmarkTarget(const Benchmark *benchmark);
+
+// ends a frame, given what it drew; returns false once the run is over
+bool EndBenchmarkFrame(Benchmark *benchmark, const ProfileCounters &counters);
+
+// writes the results as JSON
+void ReportBenchmark(const Benchmark *benchmark, std::ostream &out);
+
+void DestroyBenchmark(Benchmark *benchmark);
+
+#endif
@@ -21,15 +21,41 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <math.h>
 #include <vector>
+#include <random>
+#include <cstdlib>
 
-#include "shapes.h"
 #include "texture.h"
 #include "Camera.h"
+#include "program.h"
+#include "renderstate.h"
+#include "gldebug.h"
+#include "framedata.h"
+#include "instances.h"
+#include "scenegraph.h"
+#include "orbits.h"
+#include "jobs.h"
+#include "textureloader.h"
+#include "texturemanager.h"
+#include "culling.h"
+#include "lod.h"
+#include "profiler.h"
+#include "benchmark.h"
+#include "capture.h"
+#include "timestep.h"
+#include "framepacing.h"
+#include "vertexformat.h"
+#include "gpuculling.h"
+#include "occlusion.h"
+#include "spheremesh.h"
+#include "assetpack.h"
+#include "virtualtexture.h"
+#include "rendertarget.h"
 
 using namespace std;
 using namespace glm;
@@ -38,39 +64,30 @@ using namespace glm;
 
 #define PI_F 3.14159265359f
 
-void QueryGLVersion();
-bool CheckGLErrors();
+string QueryGLVersion();
 
-string LoadSource(const string &filename);
-GLuint CompileShader(GLenum shaderType, const string &source);
-GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader);
+bool lbPushed = false, ANIMATE = true, PROFILE_OVERLAY = false, CAPTURE = false, RESIZED = false;
 
-bool lbPushed = false, ANIMATE = true;
+// the simulation rate the animation speeds were tuned at, in ticks a second
+#define SIM_REFERENCE_RATE 60.f
 
-// --------------------------------------------------------------------------
-// Functions to set up OpenGL shader programs for rendering
-
-// load, compile, and link shaders, returning true if successful
-GLuint InitializeShaders()
+// how far the bodies have turned, in degrees, and how many ticks the
+// asteroid belt has been advanced by
+struct Animation
 {
-	// load shader source from files
-	string vertexSource = LoadSource("shaders/vertex.glsl");
-	string fragmentSource = LoadSource("shaders/fragment.glsl");
-	if (vertexSource.empty() || fragmentSource.empty()) return false;
-
-	// compile shader source into shader objects
-	GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
-	GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
-
-	// link shader program
-	GLuint program = LinkProgram(vertex, fragment);
+	float rotateSun;
+	float orbitEarth;
+	float rotateEarth;
+	float orbitMoon;
+	float rotateMoon;
+	double belt;
+
+	Animation() : rotateSun(0), orbitEarth(0), rotateEarth(0), orbitMoon(0), rotateMoon(0), belt(0)
+	{}
+};
 
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
-
-	// check for OpenGL errors and return false if error occurred
-	return program;
-}
+// the animation a fraction t of the way from a to b
+Animation MixAnimation(const Animation &a, const Animation &b, float t);
 
 // --------------------------------------------------------------------------
 // Functions to set up OpenGL buffers for storing geometry data
@@ -79,55 +96,46 @@ struct Geometry
 {
 	// OpenGL names for array buffer objects, vertex array object
 	GLuint  vertexBuffer;
-	GLuint  textureBuffer;
-	GLuint  colourBuffer;
+	GLuint  indexBuffer;
 	GLuint  vertexArray;
 	GLsizei elementCount;
+	GLsizei indexCount;
+
+	// how the interleaved vertices in vertexBuffer are laid out
+	VertexLayout layout;
+
+	// set when the vertex shader generates the mesh and there are no
+	// vertex or index buffers at all
+	bool    procedural;
 
 	// initialize object names to zero (OpenGL reserved value)
-	Geometry() : vertexBuffer(0), colourBuffer(0), vertexArray(0), elementCount(0)
+	Geometry() : vertexBuffer(0), indexBuffer(0), vertexArray(0), elementCount(0), indexCount(0),
+		procedural(false)
 	{}
 };
 
-bool InitializeVAO(Geometry *geometry){
-
-	const GLuint VERTEX_INDEX = 0;
-	const GLuint TEXTURE_INDEX = 1;
+bool InitializeVAO(Geometry *geometry, const VertexLayout *layout){
 
+	geometry->layout = *layout;
 
 	//Generate Vertex Buffer Objects
-	// create an array buffer object for storing our vertices
+	// create an array buffer object for storing our interleaved vertices
 	glGenBuffers(1, &geometry->vertexBuffer);
 
-	// create another one for storing our colours
-	glGenBuffers(1, &geometry->textureBuffer);
+	// and one for the triangle indices of indexed meshes
+	glGenBuffers(1, &geometry->indexBuffer);
 
 	//Set up Vertex Array Object
 	// create a vertex array object encapsulating all our vertex attributes
 	glGenVertexArrays(1, &geometry->vertexArray);
 	glBindVertexArray(geometry->vertexArray);
 
-	// associate the position array with the vertex array object
+	// associate every attribute of the layout with the vertex array object
 	glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-	glVertexAttribPointer(
-		VERTEX_INDEX,		//Attribute index 
-		3, 					//# of components
-		GL_FLOAT, 			//Type of component
-		GL_FALSE, 			//Should be normalized?
-		sizeof(vec3),		//Stride - can use 0 if tightly packed
-		0);					//Offset to first element
-	glEnableVertexAttribArray(VERTEX_INDEX);
-
-	// associate the colour array with the vertex array object
-	glBindBuffer(GL_ARRAY_BUFFER, geometry->textureBuffer);
-	glVertexAttribPointer(
-		TEXTURE_INDEX,		//Attribute index 
-		2, 					//# of components
-		GL_FLOAT, 			//Type of component
-		GL_FALSE, 			//Should be normalized?
-		sizeof(vec2), 		//Stride - can use 0 if tightly packed
-		0);					//Offset to first element
-	glEnableVertexAttribArray(TEXTURE_INDEX);
+	ApplyVertexLayout(layout);
+
+	// the element array binding is recorded in the vertex array object
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->indexBuffer);
 
 	// unbind our buffers, resetting to default state
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -136,18 +144,24 @@ bool InitializeVAO(Geometry *geometry){
 	return !CheckGLErrors();
 }
 
-// create buffers and fill with geometry data, returning true if successful
-bool LoadGeometry(Geometry *geometry, vec3 *vertices, vec2 *textures, int elementCount)
+// a vertex array without any vertex attributes, for meshes the vertex
+// shader builds from gl_VertexID; core profiles still need one bound to
+// draw, and instance attributes are attached to it as usual
+bool InitializeProceduralVAO(Geometry *geometry)
+{
+	geometry->procedural = true;
+	glGenVertexArrays(1, &geometry->vertexArray);
+	return !CheckGLErrors();
+}
+
+// fill the vertex buffer with elementCount vertices already packed in the
+// geometry's layout, returning true if successful
+bool LoadGeometry(Geometry *geometry, const void *vertices, int elementCount)
 {
 	geometry->elementCount = elementCount;
 
-	// create an array buffer object for storing our vertices
 	glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vec3)*geometry->elementCount, vertices, GL_STATIC_DRAW);
-
-	// create another one for storing our colours
-	glBindBuffer(GL_ARRAY_BUFFER, geometry->textureBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vec2)*geometry->elementCount, textures, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(geometry->layout.stride)*geometry->elementCount, vertices, GL_STATIC_DRAW);
 
 	//Unbind buffer to reset to default state
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -156,6 +170,23 @@ bool LoadGeometry(Geometry *geometry, vec3 *vertices, vec2 *textures, int elemen
 	return !CheckGLErrors();
 }
 
+// fill the index buffer so the geometry is drawn with glDrawElements,
+// returning true if successful
+bool LoadIndices(Geometry *geometry, const GLuint *indices, int indexCount)
+{
+	geometry->indexCount = indexCount;
+
+	// the vertex array must be bound, otherwise we would replace its
+	// element array binding rather than fill the buffer it refers to
+	glBindVertexArray(geometry->vertexArray);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*geometry->indexCount, indices, GL_STATIC_DRAW);
+	glBindVertexArray(0);
+
+	// check for OpenGL errors and return false if error occurred
+	return !CheckGLErrors();
+}
+
 // deallocate geometry-related objects
 void DestroyGeometry(Geometry *geometry)
 {
@@ -163,122 +194,76 @@ void DestroyGeometry(Geometry *geometry)
 	glBindVertexArray(0);
 	glDeleteVertexArrays(1, &geometry->vertexArray);
 	glDeleteBuffers(1, &geometry->vertexBuffer);
-	glDeleteBuffers(1, &geometry->colourBuffer);
+	glDeleteBuffers(1, &geometry->indexBuffer);
 }
 
 // --------------------------------------------------------------------------
 // Rendering function that draws our scene to the frame buffer
 
-void RenderScene(Geometry *geometry, GLuint program, vec3 color, Camera* camera, mat4 perspectiveMatrix, mat4 translationMatrix, GLenum rendermode)
+void RenderScene(RenderState *state, Geometry *geometry, ShaderProgram *program, vec3 color, mat4 translationMatrix, GLenum rendermode)
 {
 
 	// bind our shader program and the vertex array object containing our
-	// scene geometry, then tell OpenGL to draw our geometry
-	glUseProgram(program);
-
-	int vp [4];
-	glGetIntegerv(GL_VIEWPORT, vp);
-	int width = vp[2];
-	int height = vp[3];
-
-
-	//Bind uniforms
-	GLint uniformLocation = glGetUniformLocation(program, "Colour");
-	glUniform3f(uniformLocation, color.r, color.g, color.b); 
-
-	mat4 modelViewProjection = perspectiveMatrix*camera->viewMatrix();
-	uniformLocation = glGetUniformLocation(program, "modelViewProjection");
-	glUniformMatrix4fv(uniformLocation, 1, false, glm::value_ptr(modelViewProjection));
-
-	
-	uniformLocation = glGetUniformLocation(program, "translation");
-	glUniformMatrix4fv(uniformLocation, 1, GL_FALSE, glm::value_ptr(translationMatrix));
-
-	glBindVertexArray(geometry->vertexArray);
-	glDrawArrays(rendermode, 0, geometry->elementCount);
-
-	// reset state to default (no shader or geometry bound)
-	glBindVertexArray(0);
-	glUseProgram(0);
-
-	// check for an report any OpenGL errors
-	CheckGLErrors();
+	// scene geometry, then tell OpenGL to draw our geometry; bindings are
+	// left in place for the next draw, which usually wants the same ones
+	UseProgram(state, program->id);
+
+	//Bind uniforms; the camera comes from the per-frame FrameData block
+	SetUniform(program, UNIFORM_COLOUR, color);
+	SetUniform(program, UNIFORM_TRANSLATION, translationMatrix);
+
+	BindVertexArray(state, geometry->vertexArray);
+	if (geometry->indexCount > 0)
+		glDrawElements(rendermode, geometry->indexCount, GL_UNSIGNED_INT, 0);
+	else
+		glDrawArrays(rendermode, 0, geometry->elementCount);
+
+	// check for an report any OpenGL errors, in debug builds only
+	CHECK_DRAW_ERRORS();
 }
 
+// draws count instances of the geometry, or of one level of detail packed
+// into it, starting at instance first, with a single instanced draw call
+void RenderInstances(RenderState *state, Geometry *geometry, Instances *instances, ShaderProgram *program, GLint first, GLsizei count, GLenum rendermode,
+	const MeshLOD *lod = 0)
+{
+	if (count <= 0) return;
 
-sphere generateSphere(float radius, float interval){
-
-
-   
-    sphere  sph = sphere(vec3(0,0,0), radius);
-
-	
-	//printf("Phi: %f\tsin(90-phi): %f\tr: %f\n", phi_IN, sin((PI_F/2)-phi), r);
-
-	//calculate for y coordinate
-	//float yLayer = phi/interval - (180.f / (2*interval)); 
-	
-
-
-    vec3 vert1, vert2, vert3;
-    vec2 tex1, tex2, tex3; 
-
-
-
-    for(float phi = 0.f; phi <= (180.f-interval); phi += interval ){
-		
-        float r = radius * sin(radians(phi));
-        float rDown = radius * sin(radians(phi+interval));
-
-
-        if (phi == 90.f)
-            r = radius;
-        else if (phi+interval == 90.f)
-            rDown = radius; 
-
-        float y = cos(radians(phi)) * radius;
-        float yDown = cos(radians(phi+interval)) * radius;
-		
-		for ( float theta = 0.f; theta < 360.f; theta+= interval){
-		
-        vert1 = vec3(r*sin(radians(theta)), y,r*cos(radians(theta)) ) ;
-        vert2 = vec3(r*sin(radians(theta+interval)), y,r*cos(radians(theta+interval)) ) ;
-        vert3 = vec3(rDown*sin(radians(theta+interval)), yDown ,rDown*cos(radians(theta+interval)) ) ;
-        sph.mesh.push_back(vert1);
-        sph.mesh.push_back(vert2);
-        sph.mesh.push_back(vert3);
-
-        vert2 =  vec3(rDown*sin(radians(theta)), yDown,rDown*cos(radians(theta)) );
-        sph.mesh.push_back(vert1);
-        sph.mesh.push_back(vert2);
-        sph.mesh.push_back(vert3);
-
-
-        tex1 = vec2 (radians(theta)/(2*PI_F), radians(phi)/PI_F);
-        tex2 = vec2 (radians(theta+interval)/(2*PI_F), radians(phi)/PI_F);
-        tex3 = vec2 (radians(theta+interval)/(2*PI_F), radians(phi+interval)/PI_F);
-        sph.texCoord.push_back(tex1);
-        sph.texCoord.push_back(tex2);
-        sph.texCoord.push_back(tex3);
-
-        tex2 = vec2 (radians(theta)/(2*PI_F), radians(phi+interval)/PI_F);
-        sph.texCoord.push_back(tex1);
-        sph.texCoord.push_back(tex2);
-        sph.texCoord.push_back(tex3);
+	// the instances are attached to the geometry's own vertex array
+	BindInstanceRange(state, instances, first);
+	UseProgram(state, program->id);
 
+	if (lod && geometry->procedural) {
+		SetUniform(program, UNIFORM_TESSELLATION, ivec2(lod->columns, lod->rings));
+		glDrawArraysInstanced(rendermode, 0, lod->indexCount, count);
+	}
+	else if (lod)
+		glDrawElementsInstancedBaseVertex(rendermode, lod->indexCount, GL_UNSIGNED_INT,
+			(const void*)(lod->firstIndex * sizeof(GLuint)), count, lod->baseVertex);
+	else if (geometry->indexCount > 0)
+		glDrawElementsInstanced(rendermode, geometry->indexCount, GL_UNSIGNED_INT, 0, count);
+	else
+		glDrawArraysInstanced(rendermode, 0, geometry->elementCount, count);
+
+	// check for an report any OpenGL errors, in debug builds only
+	CHECK_DRAW_ERRORS();
+}
 
+// draws count instances, starting at instance first, as ray-cast impostors:
+// one quad each, which needs no mesh at all
+void RenderImpostors(RenderState *state, Instances *instances, ShaderProgram *program, GLint first, GLsizei count)
+{
+	if (count <= 0) return;
 
-	    } 
-		
+	BindInstanceRange(state, instances, first);
+	UseProgram(state, program->id);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
 
-		
-			
+	// check for an report any OpenGL errors, in debug builds only
+	CHECK_DRAW_ERRORS();
+}
 
-	}
 
-   
-    return sph; 
-}
 
 
 
@@ -324,6 +309,17 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		glfwSetWindowShouldClose(window, GL_TRUE);
 	if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
 		ANIMATE = !ANIMATE;
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		PROFILE_OVERLAY = !PROFILE_OVERLAY;
+	if (key == GLFW_KEY_C && action == GLFW_PRESS)
+		CAPTURE = !CAPTURE;
+}
+
+// notes that the window's framebuffer changed size; the main loop resizes
+// what follows it before drawing the next frame
+void FramebufferSizeCallback(GLFWwindow* /*window*/, int /*width*/, int /*height*/)
+{
+	RESIZED = true;
 }
 
 
@@ -332,6 +328,95 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 
 int main(int argc, char *argv[])
 {
+	// debug builds always report OpenGL errors; release builds only do so
+	// through debug output, and only when asked to with --gl-debug
+#ifdef NDEBUG
+	bool debugOutput = false;
+#else
+	bool debugOutput = true;
+#endif
+	int asteroidCount = 0;
+	int threadCount = 0;
+	string profileCSV, profileTrace;
+	Benchmark benchmark;
+	bool benchmarking = false;
+	string benchmarkOutput;
+	float simRate = SIM_REFERENCE_RATE;
+	FramePacing pacing;
+	FrameCapture capture;
+	capture.path = "capture.rgba";
+	RenderTarget renderTarget;
+	PositionFormat positionFormat = POSITION_SNORM16;
+	bool proceduralSpheres = false;
+	bool gpuCulling = false;
+	bool occlusionCulling = false;
+	float impostorRadius = 8.f;
+	bool virtualTexturing = false;
+	string assetPackPath = "assets.pack";
+	bool assetPackGiven = false;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--gl-debug")
+			debugOutput = true;
+		else if (string(argv[i]) == "--asteroids" && i+1 < argc)
+			asteroidCount = std::max(0, atoi(argv[++i]));
+		else if (string(argv[i]) == "--threads" && i+1 < argc)
+			threadCount = std::max(0, atoi(argv[++i]));
+		else if (string(argv[i]) == "--profile-csv" && i+1 < argc)
+			profileCSV = argv[++i];
+		else if (string(argv[i]) == "--profile-trace" && i+1 < argc)
+			profileTrace = argv[++i];
+		else if (string(argv[i]) == "--benchmark")
+			benchmarking = true;
+		else if (string(argv[i]) == "--benchmark-output" && i+1 < argc)
+			benchmarkOutput = argv[++i];
+		else if (string(argv[i]) == "--warmup" && i+1 < argc)
+			benchmark.warmupFrames = std::max(0, atoi(argv[++i]));
+		else if (string(argv[i]) == "--frames" && i+1 < argc)
+			benchmark.measuredFrames = std::max(1, atoi(argv[++i]));
+		else if (string(argv[i]) == "--interval" && i+1 < argc)
+			benchmark.interval = std::max(0.f, float(atof(argv[++i])));
+		else if (string(argv[i]) == "--sim-rate" && i+1 < argc)
+			simRate = std::max(1.f, float(atof(argv[++i])));
+		else if (string(argv[i]) == "--swap" && i+1 < argc) {
+			if (!ParseSwapMode(argv[++i], &pacing.mode))
+				cout << "WARNING: unknown swap mode " << argv[i] << ", using vsync" << endl;
+		}
+		else if (string(argv[i]) == "--procedural-spheres")
+			proceduralSpheres = true;
+		else if (string(argv[i]) == "--gpu-culling")
+			gpuCulling = true;
+		else if (string(argv[i]) == "--occlusion-culling")
+			occlusionCulling = true;
+		else if (string(argv[i]) == "--impostor-radius" && i+1 < argc)
+			impostorRadius = std::max(0.f, float(atof(argv[++i])));
+		else if (string(argv[i]) == "--virtual-textures")
+			virtualTexturing = true;
+		else if (string(argv[i]) == "--asset-pack" && i+1 < argc) {
+			assetPackPath = argv[++i];
+			assetPackGiven = true;
+		}
+		else if (string(argv[i]) == "--vertex-format" && i+1 < argc) {
+			if (!ParsePositionFormat(argv[++i], &positionFormat))
+				cout << "WARNING: unknown vertex format " << argv[i] << ", using snorm16" << endl;
+		}
+		else if (string(argv[i]) == "--frames-in-flight" && i+1 < argc)
+			pacing.maxFramesInFlight = std::max(0, atoi(argv[++i]));
+		else if (string(argv[i]) == "--fps-cap" && i+1 < argc)
+			pacing.fpsCap = std::max(0.0, atof(argv[++i]));
+		else if (string(argv[i]) == "--dynamic-resolution" && i+1 < argc)
+			renderTarget.targetMs = std::max(0.0, atof(argv[++i]));
+		else if (string(argv[i]) == "--min-scale" && i+1 < argc)
+			renderTarget.minScale = std::min(1.f, std::max(RENDER_SCALE_STEP, float(atof(argv[++i]))));
+		else if (string(argv[i]) == "--sharpness" && i+1 < argc)
+			renderTarget.sharpness = std::min(1.f, std::max(0.f, float(atof(argv[++i]))));
+		else if (string(argv[i]) == "--capture" && i+1 < argc) {
+			capture.path = argv[++i];
+			CAPTURE = true;
+		}
+	}
+	benchmark.asteroids = asteroidCount;
+	benchmark.threads = threadCount;
+
 	// initialize the GLFW windowing system
 	if (!glfwInit()) {
 		cout << "ERROR: GLFW failed to initialize, TERMINATING" << endl;
@@ -345,6 +430,9 @@ int main(int argc, char *argv[])
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debugOutput ? GL_TRUE : GL_FALSE);
+	// benchmarks draw offscreen, so their window is never shown
+	glfwWindowHint(GLFW_VISIBLE, benchmarking ? GL_FALSE : GL_TRUE);
 	int width = 1024, height = 1024;
 	window = glfwCreateWindow(width, height, "CPSC 453 OpenGL Boilerplate", 0, 0);
 	if (!window) {
@@ -355,8 +443,16 @@ int main(int argc, char *argv[])
 
 	// set keyboard callback function and make our context current (active)
 	glfwSetKeyCallback(window, KeyCallback);
+	glfwSetFramebufferSizeCallback(window, FramebufferSizeCallback);
 	glfwMakeContextCurrent(window);
 
+	// the cursor moves in window coordinates, and everything drawn is sized
+	// in framebuffer pixels, which on high-density displays are more; a
+	// benchmark's offscreen target is exactly the size asked for
+	int windowWidth = width, windowHeight = height;
+	if (!benchmarking)
+		glfwGetFramebufferSize(window, &width, &height);
+
 	//Intialize GLAD
 	if (!gladLoadGL())
 	{
@@ -364,16 +460,86 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	// query and print out information about our OpenGL environment
-	QueryGLVersion();
+	// benchmarks run as fast as the GPU allows, and keep their own count of
+	// frames in flight
+	if (benchmarking) {
+		pacing.mode = SWAP_IMMEDIATE;
+		pacing.maxFramesInFlight = 0;
+		pacing.fpsCap = 0.0;
+	}
+	ApplySwapMode(&pacing);
+
+	// query and print out information about our OpenGL environment; a
+	// program binary is only good for the driver that produced it
+	EnableProgramCache("shadercache", QueryGLVersion());
+
+	// with a debug callback in place, errors are reported as they happen and
+	// nothing needs to poll glGetError after every draw
+	if (debugOutput && InitializeDebugOutput())
+		pollGLErrors = false;
+
+	// the asset pack, if one was built, stands in for the shader sources,
+	// the sphere chain and the compressed textures; it stays mapped until
+	// exit so everything can be uploaded straight out of it
+	AssetPack assetPack;
+	if (OpenAssetPack(&assetPack, assetPackPath))
+		UseShaderPack(&assetPack);
+	else if (assetPackGiven)
+		cout << "WARNING: could not open asset pack " << assetPackPath << ", loading assets from files" << endl;
 
 	// call function to load and compile shader programs
-	GLuint program = InitializeShaders();
-	if (program == 0) {
+	ShaderProgram program = InitializeShaders();
+	if (program.id == 0) {
 		cout << "Program could not initialize shaders, TERMINATING" << endl;
 		return -1;
 	}
 
+	// virtual textures stream the bodies' maps in tiles, if every body has
+	// a tile file (see tools/tileconvert.cpp)
+	const char *virtualPaths[3] = {
+		"./textures/earth.vtex",
+		"./textures/moon.vtex",
+		"./textures/sun.vtex"
+	};
+	for (int i = 0; virtualTexturing && i < 3; i++) {
+		if (!ifstream(virtualPaths[i])) {
+			cout << "WARNING: no tile file " << virtualPaths[i] << ", using whole textures" << endl;
+			virtualTexturing = false;
+		}
+	}
+
+	// bodies sample bindless handles where the driver can, a texture array
+	// otherwise
+	bool bindlessTextures = !virtualTexturing && BindlessTexturesSupported();
+	// and procedural spheres generate their vertices in the vertex shader
+	const char *instancedVertexFile = proceduralSpheres ? "shaders/procedural_vertex.glsl" : "shaders/instanced_vertex.glsl";
+	ShaderProgram instancedProgram = InitializeShaders(instancedVertexFile,
+		virtualTexturing ? "shaders/instanced_fragment_virtual.glsl"
+		: bindlessTextures ? "shaders/instanced_fragment_bindless.glsl" : "shaders/instanced_fragment.glsl");
+	if (instancedProgram.id == 0) {
+		cout << "Program could not initialize instanced shaders, TERMINATING" << endl;
+		return -1;
+	}
+
+	// bodies too small for a mesh are ray cast on a quad instead
+	ShaderProgram impostorProgram = InitializeShaders("shaders/impostor_vertex.glsl",
+		virtualTexturing ? "shaders/impostor_fragment_virtual.glsl"
+		: bindlessTextures ? "shaders/impostor_fragment_bindless.glsl" : "shaders/impostor_fragment.glsl");
+	if (impostorProgram.id == 0) {
+		cout << "Program could not initialize impostor shaders, TERMINATING" << endl;
+		return -1;
+	}
+
+	// the bodies' meshes again, writing the virtual texture tiles they need
+	ShaderProgram feedbackProgram;
+	if (virtualTexturing) {
+		feedbackProgram = InitializeShaders(instancedVertexFile, "shaders/virtual_feedback_fragment.glsl");
+		if (feedbackProgram.id == 0) {
+			cout << "Program could not initialize virtual texture feedback shaders, TERMINATING" << endl;
+			return -1;
+		}
+	}
+
 
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
@@ -381,10 +547,43 @@ int main(int argc, char *argv[])
 
     //---------- GEOMETRY STUFF ---------------------------------------
 
-    //generate a sphere and assign its mesh and texcoord accordingly 
-    sphere sph = generateSphere(1.f, 10.f);
-    vector<vec3> vertices = sph.mesh;
-	vector<vec2> texCoord = sph.texCoord;
+    //the chain of indexed spheres, coarsest first, in one set of buffers:
+	//mapped from the asset pack when it holds one packed as this run wants,
+	//otherwise generated now. A benchmark --interval replaces the chain
+	//with a single sphere of that interval
+	float lodIntervals[LOD_LEVELS];
+	int lodLevels = LOD_LEVELS;
+	std::copy(SPHERE_LOD_INTERVALS, SPHERE_LOD_INTERVALS + LOD_LEVELS, lodIntervals);
+	if (benchmark.interval > 0.f) {
+		lodIntervals[0] = benchmark.interval;
+		lodLevels = 1;
+	}
+
+	VertexLayout vertexLayout = MakeVertexLayout(positionFormat);
+	vector<unsigned char> vertices;
+	vector<GLuint> indices;
+	LODChain sphereLODs;
+
+	const AssetEntry *packedVertices = 0, *packedIndices = 0, *packedLODs = 0;
+	if (assetPack.data && !proceduralSpheres && lodLevels == LOD_LEVELS) {
+		packedVertices = FindAsset(&assetPack, ASSET_SPHERE_VERTICES, ASSET_VERTICES);
+		packedIndices = FindAsset(&assetPack, ASSET_SPHERE_INDICES, ASSET_INDICES);
+		packedLODs = FindAsset(&assetPack, ASSET_SPHERE_LODS, ASSET_LODS);
+		if (!packedVertices || !packedIndices || !packedLODs || packedVertices->format != uint32_t(positionFormat))
+			packedVertices = packedIndices = packedLODs = 0;
+	}
+	if (packedLODs) {
+		const AssetLOD *levels = (const AssetLOD*)AssetData(&assetPack, packedLODs);
+		size_t count = std::min(size_t(packedLODs->size / sizeof(AssetLOD)), size_t(LOD_LEVELS));
+		for (size_t i = 0; i < count; i++)
+			AddLOD(&sphereLODs, levels[i].firstIndex, levels[i].indexCount, levels[i].baseVertex,
+				levels[i].maxRadius, levels[i].columns, levels[i].rings);
+	}
+	else {
+		BuildSphereChain(lodIntervals, lodLevels, proceduralSpheres ? 0 : &vertexLayout,
+			&vertices, &indices, &sphereLODs);
+	}
+	sphereLODs.impostorRadius = impostorRadius;
 
 	vec3 frustumVertices[] = {
 		vec3(-1, -1, -1),
@@ -416,15 +615,46 @@ int main(int argc, char *argv[])
 	Geometry geometry;
 
 	// call function to create and fill buffers with geometry data
-	if (!InitializeVAO(&geometry))
-		cout << "Program failed to intialize geometry!" << endl;
+	if (proceduralSpheres) {
+		if (!InitializeProceduralVAO(&geometry))
+			cout << "Program failed to intialize geometry!" << endl;
+	}
+	else {
+		if (!InitializeVAO(&geometry, &vertexLayout))
+			cout << "Program failed to intialize geometry!" << endl;
+
+		// a packed mesh goes to the GL straight from the mapping
+		const void *vertexData = packedVertices ? (const void*)AssetData(&assetPack, packedVertices) : (const void*)&vertices[0];
+		size_t vertexBytes = packedVertices ? size_t(packedVertices->size) : vertices.size();
+		if(!LoadGeometry(&geometry, vertexData, int(vertexBytes / vertexLayout.stride)))
+			cout << "Failed to load geometry" << endl;
+
+		const GLuint *indexData = packedIndices ? (const GLuint*)AssetData(&assetPack, packedIndices) : &indices[0];
+		size_t indexCount = packedIndices ? size_t(packedIndices->size / sizeof(GLuint)) : indices.size();
+		if(!LoadIndices(&geometry, indexData, int(indexCount)))
+			cout << "Failed to load geometry indices" << endl;
+	}
+
+	// the GL has its own copy now
+	vector<unsigned char>().swap(vertices);
+	vector<GLuint>().swap(indices);
 
-	if(!LoadGeometry(&geometry, &vertices[0], &texCoord[0], vertices.size()))
-		cout << "Failed to load geometry" << endl;
+	// every body is an instance of the one sphere
+	Instances instances;
+	if (!InitializeInstances(&instances, geometry.vertexArray, 64))
+		cout << "Program failed to intialize instances!" << endl;
 
 
 	//-----------------TEXTURE STUFF------------------------
-		
+
+		// worker threads for decoding textures now and animating later
+		JobSystem jobs;
+		InitializeJobSystem(&jobs, threadCount);
+
+		// textures decode in the background, drawing grey until they arrive
+		TextureLoader textureLoader;
+		if (!InitializeTextureLoader(&textureLoader, &jobs))
+			cout << "Program failed to intialize texture loader!" << endl;
 
 		char filePaths[3][50] ={
 			"./textures/2k_earth_daymap.jpg",
@@ -433,13 +663,54 @@ int main(int argc, char *argv[])
 		} ;
 
         MyTexture earthTex;
-		InitializeTexture(&earthTex, filePaths[0], GL_TEXTURE_2D);
-
         MyTexture moonTex;
-		InitializeTexture(&moonTex, filePaths[1], GL_TEXTURE_2D);
-
         MyTexture sunTex;
-		InitializeTexture(&sunTex, filePaths[2], GL_TEXTURE_2D);
+
+		// every body samples one shared binding; an instance only names its
+		// texture's layer. Layers match the 2k maps, 2048x1024. Virtual
+		// textures keep only the tiles in view, in memory of a fixed size
+		// whatever the maps' resolution, and are layered in virtualPaths order
+		TextureManager textureManager;
+		VirtualTextures virtualTextures;
+
+		// a texture the asset pack holds is already compressed, so it is
+		// uploaded right away from the mapping; the rest decode as before.
+		// Either way the manager is handed the blocks, for a compressed array
+		auto loadTexture = [&](MyTexture *texture, const char *path) {
+			const AssetEntry *entry = assetPack.data ? FindAsset(&assetPack, AssetName(path), ASSET_TEXTURE) : 0;
+			CompressedImage image;
+			if (entry && ParseKTX2(AssetData(&assetPack, entry), size_t(entry->size), &image, true)
+				&& InitializeCompressedTexture(texture, AssetData(&assetPack, entry), size_t(entry->size), entry->name))
+				SetTextureLayerImage(&textureManager, texture, &image);
+			else
+				LoadTextureAsync(&textureLoader, texture, path);
+		};
+		textureLoader.compressedUploaded = [&](MyTexture *texture, const CompressedImage *image) {
+			SetTextureLayerImage(&textureManager, texture, image);
+		};
+
+		GLint EARTH_LAYER = 0, MOON_LAYER = 1, SUN_LAYER = 2;
+		if (virtualTexturing) {
+			if (!InitializeVirtualTextures(&virtualTextures, &jobs, virtualPaths, 3, width, height, SparseTexturesSupported()))
+				cout << "Program failed to intialize virtual textures!" << endl;
+		}
+		else {
+			if (!InitializeTextureManager(&textureManager, 2048, 1024, 3, bindlessTextures))
+				cout << "Program failed to intialize texture manager!" << endl;
+			textureManager.placeholder = textureLoader.placeholder;
+			EARTH_LAYER = AddTextureLayer(&textureManager, &earthTex);
+			MOON_LAYER = AddTextureLayer(&textureManager, &moonTex);
+			SUN_LAYER = AddTextureLayer(&textureManager, &sunTex);
+
+			loadTexture(&earthTex, filePaths[0]);
+			loadTexture(&moonTex, filePaths[1]);
+			loadTexture(&sunTex, filePaths[2]);
+		}
+
+		SetUniform(&instancedProgram, UNIFORM_SAMPLER, 0);
+		SetUniform(&impostorProgram, UNIFORM_SAMPLER, 0);
+		SetUniform(&instancedProgram, UNIFORM_INDIRECTION, VIRTUAL_INDIRECTION_UNIT);
+		SetUniform(&impostorProgram, UNIFORM_INDIRECTION, VIRTUAL_INDIRECTION_UNIT);
 
 		
 
@@ -460,7 +731,7 @@ int main(int argc, char *argv[])
 	
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
 
-	glfwSetCursorPos(window, width/2, height/2);
+	glfwSetCursorPos(window, windowWidth/2, windowHeight/2);
 
 
 	glPointSize(5.f);
@@ -487,7 +758,6 @@ int main(int argc, char *argv[])
 	//earth data setup
 	float eDistance = intlog(logDistance, 1496000.f);  
 	float eSize = intlog(logSize, 6371.f);
-	vec3 earthInitPos = vec3 (eDistance, 0.f, 0.f);
 	vec4 axis = rotate(mat4(1.f), radians(23.4f), vec3(0.f,0.f,1.f)) * vec4 (0.f,1.f,0.f, 1.f);
 	vec3 earthAxis = vec3 (axis);
 
@@ -501,128 +771,634 @@ int main(int argc, char *argv[])
 
 	//=======================================
 
-	float rotateSun = 0, srSpeed = 1.f;
-	float orbitEarth = 0, eoSpeed = srSpeed/14.37; 
-	float rotateEarth = 0, erSpeed = srSpeed * 25.4;
-	float orbitMoon = 0, moSpeed = erSpeed/27.f;
-	float rotateMoon = 0, mrSpeed = erSpeed/27.32;
+	// speeds are in degrees per tick, so they shrink as the rate goes up
+	// and every body turns as fast at any simulation rate
+	float tickScale = SIM_REFERENCE_RATE / simRate;
+	float srSpeed = 1.f * tickScale;
+	float eoSpeed = srSpeed/14.37; 
+	float erSpeed = srSpeed * 25.4;
+	float moSpeed = erSpeed/27.f;
+	float mrSpeed = erSpeed/27.32;
+
+	// the state before and after the last tick; frames are drawn somewhere
+	// in between
+	Animation previous, current;
+	FixedTimestep timestep;
+
+	// the solar system as a transform hierarchy; the orbit nodes carry a
+	// body's position, so its children follow it without also inheriting
+	// its spin and size
+	SceneGraph scene;
+	int solarSystem = AddNode(&scene, -1);
+	int sunNode = AddNode(&scene, solarSystem, vec3(0.f), quat(), vec3(sunSize));
+	int earthOrbit = AddNode(&scene, solarSystem);
+	int earthNode = AddNode(&scene, earthOrbit, vec3(0.f), quat(), vec3(eSize));
+	int moonOrbit = AddNode(&scene, earthOrbit);
+	int moonNode = AddNode(&scene, moonOrbit, vec3(0.f), quat(), vec3(moonSize));
+	quat earthTilt = angleAxis(radians(23.4f), vec3(0.f,0.f,1.f));
+
+	// an asteroid belt beyond the earth's orbit, animated in bulk; seeded so
+	// every run gets the same belt
+	OrbitBatch asteroids;
+	mt19937 beltRandom(453);
+	uniform_real_distribution<float> beltDistance(eDistance*1.35f, eDistance*1.75f);
+	uniform_real_distribution<float> tumble(-5.f, 5.f), tilt(-60.f, 60.f);
+	uniform_real_distribution<float> asteroidSize(0.3f, 1.2f), angle(0.f, 360.f);
+	for (int i = 0; i < asteroidCount; i++) {
+		float distance = beltDistance(beltRandom);
+
+		// farther out orbits slower, after Kepler's third law
+		float orbitSpeed = eoSpeed * pow(eDistance/distance, 1.5f);
+		AddOrbit(&asteroids, distance, orbitSpeed, tumble(beltRandom)*tickScale, tilt(beltRandom),
+			asteroidSize(beltRandom), angle(beltRandom), angle(beltRandom));
+	}
+#ifndef NDEBUG
+	if (asteroidCount > 0) {
+		float error = OrbitKernelError(&asteroids);
+		cout << asteroidCount << " asteroids animated with " << OrbitKernelName()
+			<< ", largest error against glm " << error << endl;
+		if (error > ORBIT_KERNEL_TOLERANCE)
+			cout << "WARNING: orbit kernel disagrees with glm" << endl;
+	}
+#endif
+
+	// the belt is updated by the job system a frame ahead of rendering: while
+	// a frame draws the front set of transforms, the workers fill the back
+	// set for the next one, in chunks sized for every thread to get several
+	JobCounter beltJobs;
+	vector<mat4> beltTransforms[2];
+	int beltFront = 1;
+	size_t beltGrain = std::max<size_t>(1024, OrbitCount(&asteroids) / (4*JobThreadCount(&jobs)));
+	for (int i = 0; i < 2; i++)
+		beltTransforms[i].resize(OrbitCount(&asteroids));
+	// the first frame swaps this set to the front, as if a worker built it
+	if (asteroidCount > 0) {
+		asteroids.centre = vec3(scene.world[solarSystem][3]);
+		UpdateOrbits(&asteroids, 0.f, &beltTransforms[1 - beltFront][0], sizeof(mat4), 0, asteroidCount);
+	}
+
+	// the belt is culled through a hierarchy over its bounding spheres,
+	// refitted as the asteroids move and rebuilt now and then as it loosens
+	const unsigned BELT_REBUILD_FRAMES = 120;
+	vector<vec4> beltSpheres(OrbitCount(&asteroids));
+	vector<int> beltVisible;
+	BVH beltHierarchy;
+	unsigned frame = 0;
+
+	// ticks of animation in the belt set drawn last frame, and in the one
+	// being built
+	double beltDrawn = 0, beltBuilt = 0;
+
+	// the level of detail each body was last drawn at, -1 before its first
+	const int BODY_COUNT = 3;
+	int bodyLODs[BODY_COUNT] = { -1, -1, -1 };
+	vector<signed char> beltLODs(OrbitCount(&asteroids), -1);
+	float pixelsPerUnit = perspectiveMatrix[1][1] * height * 0.5f;
+
+	// with --gpu-culling every body goes to the GPU, which culls them and
+	// picks their levels itself; bodies come first, in the order the loop
+	// sets them, then the belt
+	GPUCulling culling;
+	if (gpuCulling) {
+		if (InitializeGPUCulling(&culling, &sphereLODs, BODY_COUNT + asteroidCount,
+			geometry.vertexBuffer, geometry.indexBuffer, proceduralSpheres ? 0 : &vertexLayout)) {
+			const GLint layers[BODY_COUNT] = { SUN_LAYER, EARTH_LAYER, MOON_LAYER };
+			vector<GLint> beltLayers(asteroidCount, MOON_LAYER);
+			SetCulledLayers(&culling, 0, layers, BODY_COUNT);
+			if (asteroidCount > 0)
+				SetCulledLayers(&culling, BODY_COUNT, &beltLayers[0], asteroidCount);
+
+			// the culling shaders only pick between mesh levels
+			if (sphereLODs.impostorRadius > 0.f)
+				cout << "WARNING: GPU culling draws no impostors, so --impostor-radius is ignored" << endl;
+		}
+		else {
+			cout << "WARNING: GPU culling unavailable, culling on the CPU" << endl;
+			DestroyGPUCulling(&culling);
+			gpuCulling = false;
+		}
+	}
+
+	// with --occlusion-culling, bodies hidden behind nearer ones are not
+	// drawn: the GPU tests them against last frame's depth pyramid when it
+	// culls, and otherwise the scene's bodies are drawn one at a time behind
+	// occlusion queries; the belt's asteroids are too small to be worth one
+	DepthPyramid depthPyramid;
+	OcclusionQueries occlusionQueries;
+	if (occlusionCulling) {
+		bool ready = gpuCulling ? InitializeDepthPyramid(&depthPyramid, width, height)
+			: InitializeOcclusionQueries(&occlusionQueries);
+		if (!ready) {
+			cout << "WARNING: occlusion culling unavailable, drawing hidden bodies" << endl;
+			occlusionCulling = false;
+		}
+	}
+	bool bodyQueries = occlusionCulling && !gpuCulling;
+
+	// camera and time, shared by every program through one uniform block
+	FrameData frameData;
+	if (!InitializeFrameData(&frameData))
+		cout << "Program failed to intialize frame data!" << endl;
+
+	// CPU and GPU timings of every frame, shown with P
+	Profiler profiler;
+	if (!InitializeProfiler(&profiler, profileCSV, profileTrace))
+		cout << "Program failed to intialize profiler!" << endl;
+
+	// with --dynamic-resolution the scene is drawn at whatever fraction of
+	// the window keeps the GPU within the frame time given, and stretched
+	// over the window; the overlay is still drawn at full size
+	bool dynamicResolution = renderTarget.targetMs > 0.0;
+	if (dynamicResolution && !InitializeRenderTarget(&renderTarget, width, height)) {
+		cout << "WARNING: dynamic resolution unavailable, drawing at full size" << endl;
+		DestroyRenderTarget(&renderTarget);
+		dynamicResolution = false;
+	}
+
+	// a benchmark measures frames with every texture in place from the start
+	if (benchmarking) {
+		FinishTextureLoader(&textureLoader);
+		if (!InitializeBenchmark(&benchmark, width, height)) {
+			cout << "Program could not create the benchmark target, TERMINATING" << endl;
+			return -1;
+		}
+	}
+
+	// start the simulation clock last, so loading does not count as time
+	// to catch up on
+	InitializeTimestep(&timestep, simRate, benchmarking ? 0.0 : glfwGetTime());
+
+	// setup above bound things behind the cache's back, so start it clean
+	RenderState renderState;
+	InvalidateRenderState(&renderState);
+
+	// the bodies' maps, whole or virtual
+	auto bindBodyTextures = [&]() {
+		if (virtualTexturing)
+			BindVirtualTextures(&renderState, &virtualTextures, 0);
+		else
+			BindTextureManager(&renderState, &textureManager, 0);
+	};
+
 	// run an event-triggered main loop
 	while (!glfwWindowShouldClose(window))
 	{
-		////////////////////////
-		//Camera interaction
-		////////////////////////
-		//Translation
-		vec3 movement(0.f);
-		if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-			movement.z += 1.f;
-		if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-			movement.z -= 1.f;
-			
-	
+		BeginProfileFrame(&profiler);
+		profiler.overlay = PROFILE_OVERLAY;
 
-		//Rotation
-		double xpos, ypos;
-		glfwGetCursorPos(window, &xpos, &ypos);
-		vec2 cursorPos(xpos, ypos);
-		vec2 cursorChange = cursorPos - vec2(width/2, height/2);
-	
-		cam.move(vec3(cursorChange*0.1f, movement.z*movementSpeed));
+		// keep the GPU queue short before anything is sampled, so the
+		// input this frame reads is shown as soon as possible
+		BeginProfileScope(&profiler, "pacing");
+		WaitForFrameSlot(&pacing);
+		EndProfileScope(&profiler);
+
+		BeginProfileScope(&profiler, "update");
 
-		//if(glfwGetMouseButton(window, 	GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS){
-			//cam.rotateHorizontal(-cursorChange.x*cursorSensitivity);
-			//cam.rotateVertical(-cursorChange.y*cursorSensitivity);
-			
-		//}
-	
-		glfwSetCursorPos(window, width/2, height/2);
-		//lastCursorPos = vec2(width/2, height/2);
-		
-		
 		///////////
 		//Calcualtions
 		//////////
-		mat4 translationSun = mat4(1.f);
-		mat4 rotationSun = rotate(mat4(1.0), radians(rotateSun), vec3(0.0f, 1.0f, 0.0f)); 
-		mat4 scalingSun = scale(mat4(1.0f),vec3(sunSize,sunSize, sunSize));
-		mat4 transformSun = translationSun * rotationSun * scalingSun; 
-
-		//earth transformations
-		//mat4 translationEarth = translate(mat4(1.0f), vec3(eDistance, 0.0f, 0.0f));
-		vec4 temp =  rotate(mat4(1.f), radians(orbitEarth), vec3(0.f,1.f,0.f)) * vec4( eDistance, 0.0f, 0.0f, 1.f);
-		vec3 earthlocation = vec3(temp.x, temp.y, temp.z);
-		mat4 translationEarth =  translate(mat4(1.0f), earthlocation);
-		mat4 rotationEarth = rotate(mat4(1.0), radians(rotateEarth), earthAxis); 
-		mat4 scalingEarth = scale(mat4(1.0f),vec3(eSize,eSize, eSize));
-		mat4 transformEarth = translationSun * translationEarth * rotationEarth * scalingEarth
-									 * rotate(mat4(1.f), radians(23.4f), vec3(0.f,0.f,1.f)); //the axis 
-
-		//moon tranformation
-		//mat4 translationMoon = translate(mat4(1.0f), vec3(moonDistance, 0.0f, 0.0f));
-		mat4 translationMoon = rotate(mat4(1.f), radians(orbitMoon), vec3(0.f,1.f,0.f)) * translate(mat4(1.0f), vec3(moonDistance, 0.0f, 0.0f));
-		mat4 rotationMoon = rotate(mat4(1.0), radians(rotateMoon), vec3(0.0f, -1.0f, 0.0f));
-		mat4 scalingMoon = scale(mat4(1.0f),vec3(moonSize,moonSize,moonSize));
-		mat4 transformMoon = translationSun * translationEarth * translationMoon * rotationMoon * scalingMoon; 
-
-		
+		// run as many ticks as the time since the last frame paid for, then
+		// draw the bodies between the last two; benchmarks keep their own
+		// clock so every run sees the same
+		double now = benchmarking ? BenchmarkClock(&benchmark) : glfwGetTime();
+		for (int ticks = AdvanceTimestep(&timestep, now); ticks > 0; ticks--) {
+			previous = current;
+			if (ANIMATE == true){
+				current.rotateSun += srSpeed;
+				current.orbitEarth += eoSpeed;
+				current.rotateEarth += erSpeed;
+				current.orbitMoon += moSpeed;
+				current.rotateMoon += mrSpeed;
+				current.belt += 1.0;
+			}
+		}
+		Animation animation = MixAnimation(previous, current, TimestepAlpha(&timestep));
+
+		//sun spins in place
+		SetRotation(&scene, sunNode, angleAxis(radians(animation.rotateSun), vec3(0.f,1.f,0.f)));
+
+		//earth orbits the sun, and spins about its tilted axis
+		quat earthOrbitRotation = angleAxis(radians(animation.orbitEarth), vec3(0.f,1.f,0.f));
+		SetTranslation(&scene, earthOrbit, earthOrbitRotation * vec3(eDistance, 0.f, 0.f));
+		SetRotation(&scene, earthNode, angleAxis(radians(animation.rotateEarth), earthAxis) * earthTilt);
+
+		//moon orbits the earth, turning with its orbit as well as spinning
+		quat moonOrbitRotation = angleAxis(radians(animation.orbitMoon), vec3(0.f,1.f,0.f));
+		SetTranslation(&scene, moonOrbit, moonOrbitRotation * vec3(moonDistance, 0.f, 0.f));
+		SetRotation(&scene, moonOrbit, moonOrbitRotation);
+		SetRotation(&scene, moonNode, angleAxis(radians(animation.rotateMoon), vec3(0.f,-1.f,0.f)));
+
+		// only nodes that moved, and whatever hangs off them, are recomputed
+		UpdateSceneGraph(&scene);
+
+		// collect the belt the workers built during the last frame, and set
+		// them off on the next one while this one is drawn
+		BeginProfileScope(&profiler, "belt wait");
+		WaitForJobs(&jobs, &beltJobs);
+		EndProfileScope(&profiler);
+		beltFront = 1 - beltFront;
+
+		// the asteroid mesh is a unit sphere, scaled by each one's size; the
+		// GPU bounds the belt itself when it culls
+		BeginProfileScope(&profiler, "belt bounds");
+		if (!gpuCulling && asteroidCount > 0) {
+			for (int i = 0; i < asteroidCount; i++)
+				beltSpheres[i] = vec4(vec3(beltTransforms[beltFront][i][3]), asteroids.size[i]);
+			if (frame % BELT_REBUILD_FRAMES == 0)
+				BuildBVH(&beltHierarchy, &beltSpheres[0], asteroidCount);
+			else
+				RefitBVH(&beltHierarchy, &beltSpheres[0]);
+		}
+		EndProfileScope(&profiler);
+
+		if (asteroidCount > 0) {
+			// the set built now is drawn next frame, so aim it at where the
+			// animation will be by then if that frame is as long as this one;
+			// the belt moves linearly, so advancing it by a fraction of a
+			// tick is the same as interpolating
+			mat4 *back = &beltTransforms[1 - beltFront][0];
+			double beltTarget = animation.belt + (animation.belt - beltDrawn);
+			float steps = float(beltTarget - beltBuilt);
+			beltDrawn = animation.belt;
+			beltBuilt = beltTarget;
+			asteroids.centre = vec3(scene.world[solarSystem][3]);
+			ParallelFor(&jobs, &beltJobs, 0, asteroidCount, beltGrain,
+				[&asteroids, back, steps](size_t first, size_t last) {
+					UpdateOrbits(&asteroids, steps, back + first, sizeof(mat4), first, last);
+				}, 8);
+		}
+		EndProfileScope(&profiler);
 
-		
 		///////////
 		//Drawing
 		//////////
 
 		//get texture from https://www.solarsystemscope.com/textures/
 
+		// swap in any textures that finished decoding, and copy them into
+		// their layers; both bind textures behind the render state cache,
+		// so resynchronise it
+		BeginProfileScope(&profiler, "textures", true);
+		size_t loading = textureLoader.pending.size();
+		bool uploaded = loading > 0 && UpdateTextureLoader(&textureLoader) < loading;
+		if (UpdateTextureManager(&textureManager) > 0 || uploaded)
+			InvalidateRenderState(&renderState);
+		if (virtualTexturing)
+			UpdateVirtualTextures(&virtualTextures, &renderState);
+		EndProfileScope(&profiler);
+
+		////////////////////////
+		//Camera interaction
+		////////////////////////
+		BeginProfileScope(&profiler, "input");
+		glfwPollEvents();
+		// input is latched as late as it can be, right before the view is
+		// built; benchmarks follow a fixed path instead of the mouse
+		if (benchmarking)
+			cam.move(BenchmarkCameraStep(benchmark.frame));
+		else {
+			//Translation
+			vec3 movement(0.f);
+			if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+				movement.z += 1.f;
+			if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+				movement.z -= 1.f;
+			
+	
+
+			//Rotation
+			double xpos, ypos;
+			glfwGetCursorPos(window, &xpos, &ypos);
+			vec2 cursorPos(xpos, ypos);
+			vec2 cursorChange = cursorPos - vec2(windowWidth/2, windowHeight/2);
+	
+			cam.move(vec3(cursorChange*0.1f, movement.z*movementSpeed));
+
+			//if(glfwGetMouseButton(window, 	GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS){
+				//cam.rotateHorizontal(-cursorChange.x*cursorSensitivity);
+				//cam.rotateVertical(-cursorChange.y*cursorSensitivity);
+			
+			//}
+	
+			glfwSetCursorPos(window, windowWidth/2, windowHeight/2);
+			//lastCursorPos = vec2(width/2, height/2);
+		}
+		EndProfileScope(&profiler);
+
+		// a resized window takes effect before anything is drawn; a minimized
+		// one has no size to take, and a benchmark's target never changes
+		if (RESIZED) {
+			RESIZED = false;
+			int newWidth = 0, newHeight = 0;
+			glfwGetFramebufferSize(window, &newWidth, &newHeight);
+			glfwGetWindowSize(window, &windowWidth, &windowHeight);
+			if (!benchmarking && newWidth > 0 && newHeight > 0 && (newWidth != width || newHeight != height)) {
+				width = newWidth;
+				height = newHeight;
+				glViewport(0, 0, width, height);
+				perspectiveMatrix = glm::perspective(PI_F*0.25f, float(width)/float(height), 0.1f, 500.f);
+				pixelsPerUnit = perspectiveMatrix[1][1] * height * 0.5f;
+
+				ResizeRenderTarget(&renderTarget, width, height);
+				ResizeDepthPyramid(&depthPyramid, dynamicResolution ? renderTarget.width : width,
+					dynamicResolution ? renderTarget.height : height);
+				ResizeVirtualFeedback(&virtualTextures, width, height);
+				if (capture.recording) {
+					cout << "WARNING: window resized, capture stopped" << endl;
+					StopCapture(&capture);
+					CAPTURE = false;
+				}
+				InvalidateRenderState(&renderState);
+			}
+		}
+
 		// clear screen to a dark grey colour
+		if (dynamicResolution)
+			BindRenderTarget(&renderTarget);
+		else if (benchmarking)
+			BindBenchmarkTarget(&benchmark);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// the camera only changes once per frame, so upload it once; shaders
+		// see the same clock as the simulation, a benchmark's included
+		mat4 view = cam.viewMatrix();
+		UpdateFrameData(&frameData, view, perspectiveMatrix, float(now));
+
 		//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		// call function to draw our scene
-        glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, sunTex.textureID);
-		GLint sample = glGetUniformLocation(program, "s");
-		glUseProgram(program);
-		glUniform1i(sample, 0);
-		glUseProgram(0);
-		RenderScene(&geometry, program, vec3(1, 0, 0), &cam, perspectiveMatrix, transformSun, GL_TRIANGLES);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, earthTex.textureID);
-		sample = glGetUniformLocation(program, "s");
-		glUseProgram(program);
-		glUniform1i(sample, 0);
-		glUseProgram(0);
-		RenderScene(&geometry, program, vec3(0, 0, 1), &cam, perspectiveMatrix, transformEarth, GL_TRIANGLES);
-
-     	glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, moonTex.textureID);
-		sample = glGetUniformLocation(program, "s");
-		glUseProgram(program);
-		glUniform1i(sample, 0);
-		glUseProgram(0);
-		RenderScene(&geometry, program, vec3(1, 1, 1), &cam, perspectiveMatrix, transformMoon, GL_TRIANGLES);
-		//RenderScene(&frustumGeometry, program, vec3(0, 0, 1), &cam, perspectiveMatrix, glm::mat4(1.0f), GL_LINE_STRIP);
-
-
-
-		glfwSwapBuffers(window);
+		// every body in the scene graph, and the texture it uses; the
+		// asteroids all use the moon's
+		const int bodyNodes[BODY_COUNT] = { sunNode, earthNode, moonNode };
+		const GLint bodyLayers[BODY_COUNT] = { SUN_LAYER, EARTH_LAYER, MOON_LAYER };
+		const char *bodyNames[BODY_COUNT] = { "sun", "earth", "moon" };
+		const GLint ASTEROID_LAYER = MOON_LAYER;
+		GLsizei beltCount = OrbitCount(&asteroids);
+
+		// only what the camera can see is drawn
+		Frustum frustum;
+		ExtractFrustum(&frustum, perspectiveMatrix * view);
+		if (gpuCulling) {
+			// the transforms go up as they are, and the GPU keeps what is
+			// visible and builds the draws for it
+			BeginProfileScope(&profiler, "cull", true);
+			mat4 bodyModels[BODY_COUNT];
+			for (int i = 0; i < BODY_COUNT; i++)
+				bodyModels[i] = scene.world[bodyNodes[i]];
+			SetCulledModels(&culling, 0, bodyModels, BODY_COUNT);
+			if (beltCount > 0)
+				SetCulledModels(&culling, BODY_COUNT, &beltTransforms[beltFront][0], beltCount);
+			CullBodies(&culling, &renderState, &frustum, pixelsPerUnit, occlusionCulling ? &depthPyramid : 0);
+			EndProfileScope(&profiler);
+
+			// only the GPU knows how many instances each draw has
+			BeginProfileScope(&profiler, "draw", true);
+			bindBodyTextures();
+			DrawCulledBodies(&culling, &renderState, &instancedProgram);
+			for (int i = 0; i < culling.drawCalls; i++)
+				CountDraw(&profiler, 0, 0);
+			EndProfileScope(&profiler);
+
+			// what was just drawn hides bodies next frame
+			if (occlusionCulling) {
+				BeginProfileScope(&profiler, "depth pyramid", true);
+				BuildDepthPyramid(&depthPyramid, &renderState, perspectiveMatrix * view);
+				EndProfileScope(&profiler);
+			}
+
+			// the same draws again, for the tiles they need
+			if (virtualTexturing) {
+				BeginProfileScope(&profiler, "texture feedback", true);
+				BeginVirtualFeedback(&virtualTextures);
+				DrawCulledBodies(&culling, &renderState, &feedbackProgram);
+				EndVirtualFeedback(&virtualTextures);
+				EndProfileScope(&profiler);
+			}
+		}
+		else {
+			BeginProfileScope(&profiler, "cull");
+			int visibleBodies[BODY_COUNT];
+			int visibleBodyCount = 0;
+			vec4 bodySpheres[BODY_COUNT];
+			for (int i = 0; i < BODY_COUNT; i++) {
+				bodySpheres[i] = BoundingSphere(scene.world[bodyNodes[i]]);
+				if (SphereInFrustum(&frustum, bodySpheres[i]))
+					visibleBodies[visibleBodyCount++] = i;
+			}
+
+			// bodies tested for occlusion go nearest first, so that they hide
+			// the ones behind them
+			vec3 cameraPosition = vec3(frameData.uniforms.cameraPosition);
+			if (bodyQueries) {
+				for (int i = 1; i < visibleBodyCount; i++) {
+					for (int j = i; j > 0; j--) {
+						vec4 a = bodySpheres[visibleBodies[j-1]], b = bodySpheres[visibleBodies[j]];
+						if (length(vec3(a) - cameraPosition) - a.w <= length(vec3(b) - cameraPosition) - b.w)
+							break;
+						std::swap(visibleBodies[j-1], visibleBodies[j]);
+					}
+				}
+			}
+
+			beltVisible.clear();
+			if (beltCount > 0)
+				CullBVH(&beltHierarchy, &frustum, &beltSpheres[0], &beltVisible);
+			EndProfileScope(&profiler);
+
+			// pick each visible body's level of detail from its size on screen,
+			// and count the instances of each level to find where their runs
+			// start, so every level is one draw; impostors are a run of their
+			// own after every mesh level, and bodies drawn one at a time go
+			// after the runs
+			BeginProfileScope(&profiler, "instances");
+			const int LOD_RUNS = LOD_IMPOSTOR + 1;
+			auto lodVertices = [&sphereLODs](int lod) {
+				return lod == LOD_IMPOSTOR ? 4 : sphereLODs.levels[lod].indexCount;
+			};
+			GLint lodFirst[LOD_RUNS+1] = { 0 };
+			GLsizei beltLODCounts[LOD_RUNS] = { 0 };
+			for (int i = 0; i < visibleBodyCount; i++) {
+				int body = visibleBodies[i];
+				bodyLODs[body] = SelectLOD(&sphereLODs, ScreenRadius(bodySpheres[body], cameraPosition, pixelsPerUnit), bodyLODs[body]);
+				if (!bodyQueries)
+					lodFirst[bodyLODs[body]+1]++;
+			}
+			for (size_t i = 0; i < beltVisible.size(); i++) {
+				int asteroid = beltVisible[i];
+				beltLODs[asteroid] = SelectLOD(&sphereLODs, ScreenRadius(beltSpheres[asteroid], cameraPosition, pixelsPerUnit), beltLODs[asteroid]);
+				lodFirst[beltLODs[asteroid]+1]++;
+				beltLODCounts[beltLODs[asteroid]]++;
+			}
+			for (int lod = 0; lod < LOD_RUNS; lod++)
+				lodFirst[lod+1] += lodFirst[lod];
+
+			// then write the instances straight into this frame's buffer memory
+			GLsizei instanceCount = lodFirst[LOD_RUNS] + (bodyQueries ? visibleBodyCount : 0);
+			GLint lodNext[LOD_RUNS];
+			copy(lodFirst, lodFirst + LOD_RUNS, lodNext);
+			InstanceData *instanceData = BeginInstances(&instances, instanceCount);
+			if (instanceData) {
+				for (int i = 0; i < visibleBodyCount; i++) {
+					int body = visibleBodies[i];
+					InstanceData &instance = instanceData[bodyQueries ? lodFirst[LOD_RUNS] + i : lodNext[bodyLODs[body]]++];
+					instance.model = scene.world[bodyNodes[body]];
+					instance.layer = bodyLayers[body];
+				}
+
+				// the belt transforms finished during the last frame
+				const mat4 *beltModels = beltCount > 0 ? &beltTransforms[beltFront][0] : 0;
+				for (size_t i = 0; i < beltVisible.size(); i++) {
+					int asteroid = beltVisible[i];
+					InstanceData &instance = instanceData[lodNext[beltLODs[asteroid]]++];
+					instance.model = beltModels[asteroid];
+					instance.layer = ASTEROID_LAYER;
+				}
+			}
+			EndInstances(&instances);
+
+			EndProfileScope(&profiler);
+
+			// call function to draw our scene: one instanced draw per level of
+			// detail, all sharing one texture binding
+			BeginProfileScope(&profiler, "draw", true);
+			if (instanceData && instanceCount > 0)
+				bindBodyTextures();
+			for (int lod = 0; instanceData && lod < LOD_RUNS; lod++) {
+				GLsizei count = lodFirst[lod+1] - lodFirst[lod];
+				if (count == 0) continue;
+
+				if (lod == LOD_IMPOSTOR)
+					RenderImpostors(&renderState, &instances, &impostorProgram, lodFirst[lod], count);
+				else
+					RenderInstances(&renderState, &geometry, &instances, &instancedProgram, lodFirst[lod], count, GL_TRIANGLES,
+						&sphereLODs.levels[lod]);
+				CountDraw(&profiler, lodVertices(lod), count);
+				if (beltLODCounts[lod] > 0)
+					CountBody(&profiler, "asteroids", lod, beltLODCounts[lod], lodVertices(lod));
+			}
+			// the GPU skips any of these whose proxy box is entirely hidden
+			for (int i = 0; instanceData && bodyQueries && i < visibleBodyCount; i++) {
+				int body = visibleBodies[i];
+				int lod = bodyLODs[body];
+				bool tested = BeginOcclusionTest(&occlusionQueries, &renderState, i, bodySpheres[body], cameraPosition);
+				if (lod == LOD_IMPOSTOR)
+					RenderImpostors(&renderState, &instances, &impostorProgram, lodFirst[LOD_RUNS] + i, 1);
+				else
+					RenderInstances(&renderState, &geometry, &instances, &instancedProgram, lodFirst[LOD_RUNS] + i, 1, GL_TRIANGLES,
+						&sphereLODs.levels[lod]);
+				if (tested)
+					EndOcclusionTest();
+				CountDraw(&profiler, lodVertices(lod), 1);
+			}
+			for (int i = 0; i < visibleBodyCount; i++) {
+				int body = visibleBodies[i];
+				CountBody(&profiler, bodyNames[body], bodyLODs[body], 1, lodVertices(bodyLODs[body]));
+			}
+			EndProfileScope(&profiler);
+
+			// the meshes again, for the tiles they need; impostors are too
+			// small to need more than the coarsest levels, always resident
+			if (virtualTexturing && instanceData) {
+				BeginProfileScope(&profiler, "texture feedback", true);
+				BeginVirtualFeedback(&virtualTextures);
+				for (int lod = 0; lod < LOD_IMPOSTOR; lod++) {
+					GLsizei count = lodFirst[lod+1] - lodFirst[lod];
+					if (count > 0)
+						RenderInstances(&renderState, &geometry, &instances, &feedbackProgram, lodFirst[lod], count, GL_TRIANGLES,
+							&sphereLODs.levels[lod]);
+				}
+				for (int i = 0; bodyQueries && i < visibleBodyCount; i++) {
+					int lod = bodyLODs[visibleBodies[i]];
+					if (lod != LOD_IMPOSTOR)
+						RenderInstances(&renderState, &geometry, &instances, &feedbackProgram, lodFirst[LOD_RUNS] + i, 1, GL_TRIANGLES,
+							&sphereLODs.levels[lod]);
+				}
+				EndVirtualFeedback(&virtualTextures);
+				EndProfileScope(&profiler);
+			}
+			FenceInstances(&instances);
+		}
 
-		glfwPollEvents();
+		// the scene, stretched over the window or the benchmark's target
+		if (dynamicResolution) {
+			BeginProfileScope(&profiler, "upscale", true);
+			PresentRenderTarget(&renderTarget, &renderState, benchmarking ? benchmark.framebuffer : 0);
+			EndProfileScope(&profiler);
+		}
+
+		BeginProfileScope(&profiler, "overlay", true);
+		DrawProfilerOverlay(&profiler, &renderState, width, height);
+		EndProfileScope(&profiler);
+		//RenderScene(&renderState, &frustumGeometry, &program, vec3(0, 0, 1), glm::mat4(1.0f), GL_LINE_STRIP);
 
-		if (ANIMATE == true){
-			rotateSun += srSpeed;
-			orbitEarth += eoSpeed;
-			rotateEarth += erSpeed;
-			orbitMoon += moSpeed;
-			rotateMoon += mrSpeed;
+
+
+		// C starts and stops recording; a capture that could not start is
+		// not retried every frame
+		if (CAPTURE != capture.recording) {
+			int captureWidth = width, captureHeight = height;
+			if (!benchmarking)
+				glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+			if (!CAPTURE)
+				StopCapture(&capture);
+			else if (!StartCapture(&capture, captureWidth, captureHeight))
+				CAPTURE = false;
 		}
-	
+		BeginProfileScope(&profiler, "capture", true);
+		CaptureFrame(&capture);
+		EndProfileScope(&profiler);
+
+		BeginProfileScope(&profiler, "swap");
+		if (!benchmarking)
+			glfwSwapBuffers(window);
+		EndPacedFrame(&pacing);
+		EndProfileScope(&profiler);
+
+		if (benchmarking && !EndBenchmarkFrame(&benchmark, profiler.frames[profiler.current].counters))
+			glfwSetWindowShouldClose(window, GL_TRUE);
+		EndProfileFrame(&profiler, renderState.changes);
+
+		// the next frame is drawn at the scale this one's scene pass calls
+		// for, and culled against a pyramid of that size
+		if (dynamicResolution && AdaptRenderScale(&renderTarget, ProfileScopeGpuMs(&profiler, "draw"))) {
+			ResizeDepthPyramid(&depthPyramid, renderTarget.width, renderTarget.height);
+			InvalidateRenderState(&renderState);
+		}
+
+		frame++;
+	}
+
+	if (benchmarking) {
+		if (benchmarkOutput.empty())
+			ReportBenchmark(&benchmark, cout);
+		else {
+			ofstream output(benchmarkOutput.c_str());
+			ReportBenchmark(&benchmark, output);
+		}
+		DestroyBenchmark(&benchmark);
 	}
 
 	// clean up allocated resources before exit
+	WaitForJobs(&jobs, &beltJobs);
+	DestroyFrameCapture(&capture);
+	DestroyRenderTarget(&renderTarget);
+	DestroyFramePacing(&pacing);
+	DestroyProfiler(&profiler);
+	DestroyTextureManager(&textureManager);
+	DestroyTextureLoader(&textureLoader);
+	DestroyVirtualTextures(&virtualTextures);
+	DestroyJobSystem(&jobs);
+	DestroyFrameData(&frameData);
+	DestroyOcclusionQueries(&occlusionQueries);
+	DestroyDepthPyramid(&depthPyramid);
+	DestroyGPUCulling(&culling);
+	DestroyInstances(&instances);
 	DestroyGeometry(&geometry);
 	glUseProgram(0);
-	glDeleteProgram(program);
+	DestroyProgram(&feedbackProgram);
+	DestroyProgram(&impostorProgram);
+	DestroyProgram(&instancedProgram);
+	DestroyProgram(&program);
+	UseShaderPack(0);
+	CloseAssetPack(&assetPack);
 	glfwDestroyWindow(window);
 	glfwTerminate();
 
@@ -636,119 +1412,33 @@ int main(int argc, char *argv[])
 // --------------------------------------------------------------------------
 // OpenGL utility functions
 
-void QueryGLVersion()
+string QueryGLVersion()
 {
 	// query opengl version and renderer information
 	string version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
 	string glslver = reinterpret_cast<const char *>(glGetString(GL_SHADING_LANGUAGE_VERSION));
 	string renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+	string vendor = reinterpret_cast<const char *>(glGetString(GL_VENDOR));
 
 	cout << "OpenGL [ " << version << " ] "
 		<< "with GLSL [ " << glslver << " ] "
 		<< "on renderer [ " << renderer << " ]" << endl;
-}
 
-bool CheckGLErrors()
-{
-	bool error = false;
-	for (GLenum flag = glGetError(); flag != GL_NO_ERROR; flag = glGetError())
-	{
-		cout << "OpenGL ERROR:  ";
-		switch (flag) {
-		case GL_INVALID_ENUM:
-			cout << "GL_INVALID_ENUM" << endl; break;
-		case GL_INVALID_VALUE:
-			cout << "GL_INVALID_VALUE" << endl; break;
-		case GL_INVALID_OPERATION:
-			cout << "GL_INVALID_OPERATION" << endl; break;
-		case GL_INVALID_FRAMEBUFFER_OPERATION:
-			cout << "GL_INVALID_FRAMEBUFFER_OPERATION" << endl; break;
-		case GL_OUT_OF_MEMORY:
-			cout << "GL_OUT_OF_MEMORY" << endl; break;
-		default:
-			cout << "[unknown error code]" << endl;
-		}
-		error = true;
-	}
-	return error;
+	// identifies the driver, for anything cached across runs
+	return vendor + "\n" + renderer + "\n" + version + "\n" + glslver;
 }
 
 // --------------------------------------------------------------------------
-// OpenGL shader support functions
+// Animation support
 
-// reads a text file with the given name into a string
-string LoadSource(const string &filename)
+Animation MixAnimation(const Animation &a, const Animation &b, float t)
 {
-	string source;
-
-	ifstream input(filename.c_str());
-	if (input) {
-		copy(istreambuf_iterator<char>(input),
-			istreambuf_iterator<char>(),
-			back_inserter(source));
-		input.close();
-	}
-	else {
-		cout << "ERROR: Could not load shader source from file "
-			<< filename << endl;
-	}
-
-	return source;
+	Animation mixed;
+	mixed.rotateSun = mix(a.rotateSun, b.rotateSun, t);
+	mixed.orbitEarth = mix(a.orbitEarth, b.orbitEarth, t);
+	mixed.rotateEarth = mix(a.rotateEarth, b.rotateEarth, t);
+	mixed.orbitMoon = mix(a.orbitMoon, b.orbitMoon, t);
+	mixed.rotateMoon = mix(a.rotateMoon, b.rotateMoon, t);
+	mixed.belt = a.belt + (b.belt - a.belt) * t;
+	return mixed;
 }
-
-// creates and returns a shader object compiled from the given source
-GLuint CompileShader(GLenum shaderType, const string &source)
-{
-	// allocate shader object name
-	GLuint shaderObject = glCreateShader(shaderType);
-
-	// try compiling the source as a shader of the given type
-	const GLchar *source_ptr = source.c_str();
-	glShaderSource(shaderObject, 1, &source_ptr, 0);
-	glCompileShader(shaderObject);
-
-	// retrieve compile status
-	GLint status;
-	glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &status);
-	if (status == GL_FALSE)
-	{
-		GLint length;
-		glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &length);
-		string info(length, ' ');
-		glGetShaderInfoLog(shaderObject, info.length(), &length, &info[0]);
-		cout << "ERROR compiling shader:" << endl << endl;
-		cout << source << endl;
-		cout << info << endl;
-	}
-
-	return shaderObject;
-}
-
-// creates and returns a program object linked from vertex and fragment shaders
-GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader)
-{
-	// allocate program object name
-	GLuint programObject = glCreateProgram();
-
-	// attach provided shader objects to this program
-	if (vertexShader)   glAttachShader(programObject, vertexShader);
-	if (fragmentShader) glAttachShader(programObject, fragmentShader);
-
-	// try linking the program with given attachments
-	glLinkProgram(programObject);
-
-	// retrieve link status
-	GLint status;
-	glGetProgramiv(programObject, GL_LINK_STATUS, &status);
-	if (status == GL_FALSE)
-	{
-		GLint length;
-		glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &length);
-		string info(length, ' ');
-		glGetProgramInfoLog(programObject, info.length(), &length, &info[0]);
-		cout << "ERROR linking shader program:" << endl;
-		cout << info << endl;
-	}
-
-	return programObject;
-}
\ No newline at end of file
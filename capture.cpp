@@ -0,0 +1,233 @@
+// ==========================================================================
+// Asynchronous frame capture
+// ==========================================================================
+
+#include "capture.h"
+#include "gldebug.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+FrameCapture::FrameCapture() : png(false), width(0), height(0), recording(false), next(0), frames(0), dropped(0),
+	quit(false), failed(false)
+{
+	for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+		buffers[i] = 0;
+		fences[i] = 0;
+		numbers[i] = 0;
+	}
+}
+
+static bool EndsWith(const string &text, const string &suffix)
+{
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// frame.png becomes frame_000042.png
+static string SequenceName(const string &path, unsigned number)
+{
+	char digits[16];
+	snprintf(digits, sizeof(digits), "_%06u", number);
+	return path.substr(0, path.size() - 4) + digits + ".png";
+}
+
+static bool WriteFrame(FrameCapture *capture, CapturedFrame *frame)
+{
+	// the default framebuffer's alpha is whatever blending left there
+	size_t size = frame->pixels.size();
+	for (size_t i = 3; i < size; i += 4)
+		frame->pixels[i] = 255;
+
+	GLsizei stride = capture->width * 4;
+	if (capture->png) {
+		return stbi_write_png(SequenceName(capture->path, frame->number).c_str(), capture->width, capture->height, 4,
+			&frame->pixels[0], stride) != 0;
+	}
+
+	for (GLsizei y = capture->height - 1; y >= 0; y--)
+		capture->raw.write((const char*)&frame->pixels[size_t(y) * stride], stride);
+	return bool(capture->raw);
+}
+
+static void EncoderLoop(FrameCapture *capture)
+{
+	unique_lock<mutex> lock(capture->mutex);
+	for (;;) {
+		capture->wake.wait(lock, [capture]() { return capture->quit || !capture->queue.empty(); });
+		if (capture->queue.empty()) return;
+
+		CapturedFrame *frame = capture->queue.front();
+		capture->queue.pop_front();
+		lock.unlock();
+		bool written = capture->failed || WriteFrame(capture, frame);
+		lock.lock();
+
+		if (!written && !capture->failed) {
+			cout << "WARNING: could not write captured frame " << frame->number << " to " << capture->path
+				<< ", capture stopped writing" << endl;
+			capture->failed = true;
+		}
+		capture->spare.push_back(frame);
+		capture->wake.notify_all();
+	}
+}
+
+// copies the frame read into slot out of its buffer and queues it; unless
+// block is set, the frame is dropped if the encoder is too far behind
+static void DeliverFrame(FrameCapture *capture, int slot, bool block)
+{
+	glDeleteSync(capture->fences[slot]);
+	capture->fences[slot] = 0;
+
+	CapturedFrame *frame = 0;
+	{
+		unique_lock<mutex> lock(capture->mutex);
+		if (block)
+			capture->wake.wait(lock, [capture]() { return capture->queue.size() < CAPTURE_MAX_QUEUED; });
+		if (capture->queue.size() >= CAPTURE_MAX_QUEUED) {
+			capture->dropped++;
+			return;
+		}
+		if (!capture->spare.empty()) {
+			frame = capture->spare.back();
+			capture->spare.pop_back();
+		}
+	}
+	if (!frame) frame = new CapturedFrame;
+
+	size_t size = size_t(capture->width) * capture->height * 4;
+	frame->pixels.resize(size);
+	frame->number = capture->numbers[slot];
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->buffers[slot]);
+	const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	bool mapped = pixels != 0;
+	if (mapped) {
+		memcpy(&frame->pixels[0], pixels, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	lock_guard<mutex> lock(capture->mutex);
+	if (mapped)
+		capture->queue.push_back(frame);
+	else {
+		capture->spare.push_back(frame);
+		capture->dropped++;
+	}
+	capture->wake.notify_all();
+}
+
+// delivers readbacks oldest first, as long as they have finished; with wait
+// set, waits for every one of them instead
+static void CollectFrames(FrameCapture *capture, bool wait)
+{
+	for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+		int slot = (capture->next + i) % CAPTURE_BUFFERS;
+		if (!capture->fences[slot]) continue;
+
+		GLenum status = wait ? glClientWaitSync(capture->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000))
+			: glClientWaitSync(capture->fences[slot], 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED && !wait) return;
+		DeliverFrame(capture, slot, wait);
+	}
+}
+
+bool StartCapture(FrameCapture *capture, GLsizei width, GLsizei height)
+{
+	if (capture->buffers[0] == 0) {
+		capture->png = EndsWith(capture->path, ".png");
+		if (!capture->png) {
+			capture->raw.open(capture->path.c_str(), ios::binary | ios::trunc);
+			if (!capture->raw) {
+				cout << "WARNING: could not open " << capture->path << " for capture" << endl;
+				return false;
+			}
+		}
+		capture->width = width;
+		capture->height = height;
+
+		glGenBuffers(CAPTURE_BUFFERS, capture->buffers);
+		for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->buffers[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(width) * height * 4, 0, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		// OpenGL reads bottom up; PNG files are written top down, and fast
+		// compression keeps the encoder up with the frame rate
+		stbi_flip_vertically_on_write(1);
+		stbi_write_png_compression_level = 1;
+		capture->encoder = thread(EncoderLoop, capture);
+		cout << "Capturing " << width << "x" << height << " frames to " << capture->path << endl;
+	}
+	else if (width != capture->width || height != capture->height) {
+		// a raw stream cannot change size part way through
+		cout << "WARNING: cannot resume a " << capture->width << "x" << capture->height << " capture at "
+			<< width << "x" << height << endl;
+		return false;
+	}
+
+	capture->recording = true;
+	return !CheckGLErrors();
+}
+
+void StopCapture(FrameCapture *capture)
+{
+	capture->recording = false;
+}
+
+void CaptureFrame(FrameCapture *capture)
+{
+	if (capture->buffers[0] == 0) return;
+	CollectFrames(capture, false);
+	if (!capture->recording) return;
+
+	// the ring has come round to a readback that has not finished; that
+	// frame is CAPTURE_BUFFERS old, so this is rarely a wait at all
+	int slot = capture->next;
+	if (capture->fences[slot]) {
+		glClientWaitSync(capture->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+		DeliverFrame(capture, slot, false);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->buffers[slot]);
+	glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	capture->numbers[slot] = capture->frames++;
+	capture->next = (slot + 1) % CAPTURE_BUFFERS;
+}
+
+void DestroyFrameCapture(FrameCapture *capture)
+{
+	if (capture->buffers[0] == 0) return;
+
+	StopCapture(capture);
+	CollectFrames(capture, true);
+	{
+		lock_guard<mutex> lock(capture->mutex);
+		capture->quit = true;
+		capture->wake.notify_all();
+	}
+	capture->encoder.join();
+
+	cout << "Captured " << (capture->frames - capture->dropped) << " frames to " << capture->path << endl;
+	if (capture->dropped > 0)
+		cout << "WARNING: " << capture->dropped << " frames were dropped while the encoder caught up" << endl;
+
+	for (size_t i = 0; i < capture->spare.size(); i++)
+		delete capture->spare[i];
+	capture->spare.clear();
+	capture->raw.close();
+
+	glDeleteBuffers(CAPTURE_BUFFERS, capture->buffers);
+	for (int i = 0; i < CAPTURE_BUFFERS; i++)
+		capture->buffers[i] = 0;
+}
@@ -0,0 +1,104 @@
+// ==========================================================================
+// Asynchronous frame capture
+//
+// Records what is drawn without the frame waiting for the GPU. CaptureFrame
+// issues a glReadPixels of the frame into a pixel buffer object, which
+// returns at once, and fences it; the buffer is only mapped once its fence
+// has signalled, a few frames later, and the frame is handed to an encoder
+// thread that writes it out while rendering carries on. A frame looks like
+//
+//	... draw ...
+//	CaptureFrame(&capture);		// before swapping buffers
+//	glfwSwapBuffers(window);
+//
+// A path ending in .png writes a numbered PNG sequence, frame.png becoming
+// frame_000000.png, frame_000001.png and so on. Anything else is one raw
+// stream of top-down RGBA frames, which ffmpeg reads with
+//
+//	ffmpeg -f rawvideo -pix_fmt rgba -s 1024x1024 -r 60 -i capture.rgba out.mp4
+//
+// If the encoder falls CAPTURE_MAX_QUEUED frames behind, which a PNG
+// sequence can at high frame rates, frames are dropped rather than let the
+// queue stall rendering or grow without bound. PNG sequences keep the
+// dropped frames' numbers, so the gaps show.
+// ==========================================================================
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glad/glad.h>
+
+// pixel buffers frames are read into; a frame is mapped when the ring comes
+// back round to it, if not before
+#define CAPTURE_BUFFERS 4
+
+// frames read back but not yet written before new ones are dropped
+#define CAPTURE_MAX_QUEUED 32
+
+// a frame on its way to the encoder, bottom row first as OpenGL reads it
+struct CapturedFrame
+{
+	std::vector<unsigned char> pixels;
+	unsigned number;
+};
+
+struct FrameCapture
+{
+	std::string path;
+	bool        png;
+
+	GLsizei width;
+	GLsizei height;
+
+	// frames are being read back
+	bool recording;
+
+	// pixel buffers, each with the fence and number of the frame read into
+	// it, or a null fence when it is free
+	GLuint   buffers[CAPTURE_BUFFERS];
+	GLsync   fences[CAPTURE_BUFFERS];
+	unsigned numbers[CAPTURE_BUFFERS];
+	int      next;
+
+	// frames captured, including dropped ones, and dropped ones
+	unsigned frames;
+	unsigned dropped;
+
+	// the encoder thread, what it has still to write, and frames it has
+	// written, kept for reuse
+	std::thread encoder;
+	std::mutex  mutex;
+	std::condition_variable wake;
+	std::deque<CapturedFrame*> queue;
+	std::vector<CapturedFrame*> spare;
+	bool quit;
+	bool failed;
+
+	std::ofstream raw;
+
+	// initialize object names to zero (OpenGL reserved value)
+	FrameCapture();
+};
+
+// starts, or after StopCapture resumes, reading back frames of width x
+// height; the output is opened, and the buffers and encoder set up, the
+// first time; returns false if the output cannot be written
+bool StartCapture(FrameCapture *capture, GLsizei width, GLsizei height);
+
+// stops reading back new frames; those already read are still written
+void StopCapture(FrameCapture *capture);
+
+// hands finished readbacks to the encoder and, while recording, reads back
+// the framebuffer bound for reading; call after drawing, before swapping
+void CaptureFrame(FrameCapture *capture);
+
+// waits for every frame read back to be written, then frees everything
+void DestroyFrameCapture(FrameCapture *capture);
+
+#endif
@@ -0,0 +1,349 @@
+// ==========================================================================
+// Pre-compressed textures in DDS and KTX2 containers
+// ==========================================================================
+
+#include "compressedtexture.h"
+#include "gldebug.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+// not every loader defines the extension enums
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+#ifndef GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+#define GL_COMPRESSED_RGBA_ASTC_4x4_KHR 0x93B0
+#define GL_COMPRESSED_RGBA_ASTC_6x6_KHR 0x93B4
+#define GL_COMPRESSED_RGBA_ASTC_8x8_KHR 0x93B7
+#define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR 0x93D0
+#define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_6x6_KHR 0x93D4
+#define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_8x8_KHR 0x93D7
+#endif
+
+// how a compressed format packs texels: block footprint and size in bytes
+struct BlockFormat
+{
+	GLenum   format;
+	unsigned vkFormat;		//0 if KTX2 has no equivalent we accept
+	unsigned dxgiFormat;	//0 if DDS has no equivalent we accept
+	int      blockWidth, blockHeight, blockBytes;
+};
+
+static const BlockFormat blockFormats[] = {
+	{ GL_COMPRESSED_RGB_S3TC_DXT1_EXT,          131, 0,  4, 4, 8 },
+	{ GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,         132, 0,  4, 4, 8 },
+	{ GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,         133, 71, 4, 4, 8 },
+	{ GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT,   134, 72, 4, 4, 8 },
+	{ GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,         137, 77, 4, 4, 16 },
+	{ GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,   138, 78, 4, 4, 16 },
+	{ GL_COMPRESSED_RGBA_BPTC_UNORM,            145, 98, 4, 4, 16 },
+	{ GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,      146, 99, 4, 4, 16 },
+	{ GL_COMPRESSED_RGBA_ASTC_4x4_KHR,          157, 0,  4, 4, 16 },
+	{ GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR,  158, 0,  4, 4, 16 },
+	{ GL_COMPRESSED_RGBA_ASTC_6x6_KHR,          165, 0,  6, 6, 16 },
+	{ GL_COMPRESSED_SRGB8_ALPHA8_ASTC_6x6_KHR,  166, 0,  6, 6, 16 },
+	{ GL_COMPRESSED_RGBA_ASTC_8x8_KHR,          171, 0,  8, 8, 16 },
+	{ GL_COMPRESSED_SRGB8_ALPHA8_ASTC_8x8_KHR,  172, 0,  8, 8, 16 },
+};
+static const size_t blockFormatCount = sizeof(blockFormats) / sizeof(blockFormats[0]);
+
+static const BlockFormat *FindBlockFormat(GLenum format)
+{
+	for (size_t i = 0; i < blockFormatCount; i++)
+		if (blockFormats[i].format == format) return &blockFormats[i];
+	return 0;
+}
+
+// bytes taken by one level of the given size
+static size_t LevelSize(const BlockFormat *block, int width, int height)
+{
+	size_t across = (width + block->blockWidth - 1) / block->blockWidth;
+	size_t down = (height + block->blockHeight - 1) / block->blockHeight;
+	return across * down * block->blockBytes;
+}
+
+// containers are little-endian; so is everything we run on, but read them
+// byte by byte anyway so alignment never matters
+static unsigned ReadU32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (unsigned(p[3]) << 24);
+}
+
+static unsigned long long ReadU64(const unsigned char *p)
+{
+	return ReadU32(p) | (unsigned long long)(ReadU32(p + 4)) << 32;
+}
+
+static bool EndsWith(const string &text, const string &suffix)
+{
+	if (text.size() < suffix.size()) return false;
+	for (size_t i = 0; i < suffix.size(); i++)
+		if (tolower(text[text.size() - suffix.size() + i]) != suffix[i]) return false;
+	return true;
+}
+
+bool IsCompressedTextureFile(const string &filename)
+{
+	return EndsWith(filename, ".dds") || EndsWith(filename, ".ktx2");
+}
+
+string FindCompressedVersion(const string &filename)
+{
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of("/\\");
+	string base = (dot == string::npos || (slash != string::npos && dot < slash)) ? filename : filename.substr(0, dot);
+
+	const char *extensions[] = { ".ktx2", ".dds" };
+	for (int i = 0; i < 2; i++) {
+		ifstream probe((base + extensions[i]).c_str(), ios::binary);
+		if (probe) return base + extensions[i];
+	}
+	return string();
+}
+
+// --------------------------------------------------------------------------
+// Container parsing
+
+bool ParseDDS(const unsigned char *bytes, size_t size, CompressedImage *image)
+{
+	// "DDS " followed by a 124 byte header
+	if (size < 128 || memcmp(bytes, "DDS ", 4) != 0 || ReadU32(bytes + 4) != 124) {
+		cout << "ERROR: not a DDS file" << endl;
+		return false;
+	}
+
+	image->height = ReadU32(bytes + 12);
+	image->width = ReadU32(bytes + 16);
+	unsigned levels = ReadU32(bytes + 28);
+	if (levels == 0) levels = 1;
+
+	// the pixel format block starts at 76; its four character code at 84
+	const unsigned char *fourCC = bytes + 84;
+	size_t offset = 128;
+	GLenum format = GL_NONE;
+	if (memcmp(fourCC, "DXT1", 4) == 0)
+		format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	else if (memcmp(fourCC, "DXT5", 4) == 0)
+		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	else if (memcmp(fourCC, "DX10", 4) == 0 && size >= 148) {
+		// an extended header follows, naming the DXGI format
+		unsigned dxgiFormat = ReadU32(bytes + 128);
+		for (size_t i = 0; i < blockFormatCount; i++)
+			if (blockFormats[i].dxgiFormat == dxgiFormat) format = blockFormats[i].format;
+		offset = 148;
+	}
+
+	const BlockFormat *block = FindBlockFormat(format);
+	if (!block) {
+		cout << "ERROR: unsupported DDS pixel format" << endl;
+		return false;
+	}
+
+	// levels are stored largest first, one after the other
+	image->format = format;
+	image->levelOffsets.clear();
+	image->levelSizes.clear();
+	size_t end = offset;
+	for (unsigned level = 0; level < levels; level++) {
+		int width = std::max(1, image->width >> level);
+		int height = std::max(1, image->height >> level);
+		size_t levelSize = LevelSize(block, width, height);
+		if (end + levelSize > size) break;
+
+		image->levelOffsets.push_back(end - offset);
+		image->levelSizes.push_back(levelSize);
+		end += levelSize;
+	}
+	if (image->levelSizes.empty()) {
+		cout << "ERROR: truncated DDS file" << endl;
+		return false;
+	}
+
+	image->data.assign(bytes + offset, bytes + end);
+	image->external = 0;
+	return true;
+}
+
+bool ParseKTX2(const unsigned char *bytes, size_t size, CompressedImage *image, bool inPlace)
+{
+	static const unsigned char identifier[12] = {
+		0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+	};
+	if (size < 80 || memcmp(bytes, identifier, 12) != 0) {
+		cout << "ERROR: not a KTX2 file" << endl;
+		return false;
+	}
+
+	unsigned vkFormat = ReadU32(bytes + 12);
+	image->width = ReadU32(bytes + 20);
+	image->height = ReadU32(bytes + 24);
+	unsigned layers = ReadU32(bytes + 32);
+	unsigned faces = ReadU32(bytes + 36);
+	unsigned levels = ReadU32(bytes + 40);
+	unsigned supercompression = ReadU32(bytes + 44);
+	if (levels == 0) levels = 1;
+
+	if (supercompression != 0 || layers > 1 || faces != 1 || ReadU32(bytes + 28) > 1) {
+		cout << "ERROR: only plain, uncompressed-container 2D KTX2 files are supported" << endl;
+		return false;
+	}
+
+	GLenum format = GL_NONE;
+	for (size_t i = 0; i < blockFormatCount; i++)
+		if (blockFormats[i].vkFormat == vkFormat) format = blockFormats[i].format;
+	const BlockFormat *block = FindBlockFormat(format);
+	if (!block) {
+		cout << "ERROR: unsupported KTX2 format " << vkFormat << endl;
+		return false;
+	}
+
+	// the level index follows the header, level 0 (the largest) first,
+	// though the data itself is usually stored smallest first
+	if (80 + 24*size_t(levels) > size) {
+		cout << "ERROR: truncated KTX2 file" << endl;
+		return false;
+	}
+	size_t first = size, last = 0;
+	for (unsigned level = 0; level < levels; level++) {
+		const unsigned char *entry = bytes + 80 + 24*level;
+		size_t offset = size_t(ReadU64(entry));
+		size_t length = size_t(ReadU64(entry + 8));
+		if (offset + length > size) {
+			cout << "ERROR: truncated KTX2 file" << endl;
+			return false;
+		}
+		first = std::min(first, offset);
+		last = std::max(last, offset + length);
+	}
+
+	image->format = format;
+	image->levelOffsets.clear();
+	image->levelSizes.clear();
+	for (unsigned level = 0; level < levels; level++) {
+		const unsigned char *entry = bytes + 80 + 24*level;
+		image->levelOffsets.push_back(size_t(ReadU64(entry)) - first);
+		image->levelSizes.push_back(size_t(ReadU64(entry + 8)));
+	}
+	if (inPlace) {
+		image->data.clear();
+		image->external = bytes + first;
+	}
+	else {
+		image->data.assign(bytes + first, bytes + last);
+		image->external = 0;
+	}
+	return true;
+}
+
+bool ReadCompressedImage(const string &filename, CompressedImage *image)
+{
+	ifstream input(filename.c_str(), ios::binary);
+	if (!input) {
+		cout << "ERROR: Could not open texture " << filename << endl;
+		return false;
+	}
+	input.seekg(0, ios::end);
+	size_t size = size_t(input.tellg());
+	input.seekg(0, ios::beg);
+
+	vector<unsigned char> bytes(size);
+	if (size == 0 || !input.read((char*)&bytes[0], size)) {
+		cout << "ERROR: Could not read texture " << filename << endl;
+		return false;
+	}
+
+	return EndsWith(filename, ".dds") ? ParseDDS(&bytes[0], size, image) : ParseKTX2(&bytes[0], size, image);
+}
+
+// --------------------------------------------------------------------------
+// Uploading
+
+bool CompressedFormatSupported(GLenum format)
+{
+	const BlockFormat *block = FindBlockFormat(format);
+	if (!block) return false;
+
+	if (block->blockBytes == 8 || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT)
+		return GLAD_GL_EXT_texture_compression_s3tc != 0;
+	if (format == GL_COMPRESSED_RGBA_BPTC_UNORM || format == GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM)
+		return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_compression_bptc;
+	return GLAD_GL_KHR_texture_compression_astc_ldr != 0;
+}
+
+size_t CompressedLevelSize(GLenum format, int width, int height)
+{
+	const BlockFormat *block = FindBlockFormat(format);
+	return block ? LevelSize(block, width, height) : 0;
+}
+
+void UploadCompressedImage(const CompressedImage *image, bool fromUnpackBuffer)
+{
+	GLsizei levels = GLsizei(image->levelSizes.size());
+	size_t base = fromUnpackBuffer ? 0 : size_t(image->external ? image->external : &image->data[0]);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	for (GLsizei level = 0; level < levels; level++) {
+		GLsizei width = std::max(1, image->width >> level);
+		GLsizei height = std::max(1, image->height >> level);
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, image->format, width, height, 0,
+			GLsizei(image->levelSizes[level]), (const void*)(base + image->levelOffsets[level]));
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+static bool CreateCompressedTexture(MyTexture *texture, const CompressedImage *image, const char *name)
+{
+	if (!CompressedFormatSupported(image->format)) {
+		cout << "ERROR: " << name << " uses a compressed format this context cannot sample" << endl;
+		return false;
+	}
+
+	texture->target = GL_TEXTURE_2D;
+	texture->width = image->width;
+	texture->height = image->height;
+
+	glGenTextures(1, &texture->textureID);
+	glBindTexture(GL_TEXTURE_2D, texture->textureID);
+	UploadCompressedImage(image, false);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return !CheckGLErrors();
+}
+
+bool InitializeCompressedTexture(MyTexture *texture, const char *filename)
+{
+	CompressedImage image;
+	if (!ReadCompressedImage(filename, &image))
+		return false;
+	return CreateCompressedTexture(texture, &image, filename);
+}
+
+bool InitializeCompressedTexture(MyTexture *texture, const unsigned char *bytes, size_t size, const char *name)
+{
+	CompressedImage image;
+	if (!ParseKTX2(bytes, size, &image, true))
+		return false;
+	return CreateCompressedTexture(texture, &image, name);
+}
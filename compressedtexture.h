@@ -0,0 +1,74 @@
+// ==========================================================================
+// Pre-compressed textures in DDS and KTX2 containers
+//
+// Block-compressed images are uploaded as they are stored, mip chain and
+// all, with glCompressedTexImage2D: nothing is decoded on the CPU and the
+// texture takes a quarter (BC1) to an eighth of the memory and bandwidth of
+// RGBA8. Supported are BC1, BC3 and BC7 (from DDS, including the DX10
+// header, or KTX2) and ASTC 4x4, 6x6 and 8x8 (from KTX2). KTX2 files must
+// not be supercompressed.
+//
+// tools/texconvert.cpp turns the JPEG maps into such files.
+// ==========================================================================
+#ifndef COMPRESSEDTEXTURE_H
+#define COMPRESSEDTEXTURE_H
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+#include "texture.h"
+
+// a parsed container; levels point into data, largest level first, or into
+// external when the image was parsed in place
+struct CompressedImage
+{
+	GLenum format;
+	int    width;
+	int    height;
+
+	std::vector<unsigned char> data;
+	const unsigned char *external;
+	std::vector<size_t> levelOffsets;
+	std::vector<size_t> levelSizes;
+
+	CompressedImage() : format(GL_NONE), width(0), height(0), external(0)
+	{}
+};
+
+// true for file names ending in .dds or .ktx2
+bool IsCompressedTextureFile(const std::string &filename);
+
+// the .ktx2 or .dds file next to filename with the same base name, if there
+// is one, or an empty string otherwise
+std::string FindCompressedVersion(const std::string &filename);
+
+// parse a container already in memory; these do not touch OpenGL, so they
+// are safe to call from worker threads; ParseKTX2 with inPlace leaves the
+// levels where they are in bytes, which must then outlive the upload
+bool ParseDDS(const unsigned char *bytes, size_t size, CompressedImage *image);
+bool ParseKTX2(const unsigned char *bytes, size_t size, CompressedImage *image, bool inPlace = false);
+
+// reads and parses a .dds or .ktx2 file
+bool ReadCompressedImage(const std::string &filename, CompressedImage *image);
+
+// whether the context can sample the given compressed internal format
+bool CompressedFormatSupported(GLenum format);
+
+// bytes one width x height level takes in the given compressed internal
+// format, or 0 for a format these containers do not hold
+size_t CompressedLevelSize(GLenum format, int width, int height);
+
+// uploads every level into the bound GL_TEXTURE_2D, either from the image's
+// own data or, with fromUnpackBuffer, from a bound pixel unpack buffer the
+// data has been copied to the start of
+void UploadCompressedImage(const CompressedImage *image, bool fromUnpackBuffer);
+
+// synchronous counterpart of InitializeTexture for compressed files
+bool InitializeCompressedTexture(MyTexture *texture, const char *filename);
+
+// the same for a KTX2 file already in memory, such as an asset pack's
+// mapping, uploaded straight from there; name is only for messages
+bool InitializeCompressedTexture(MyTexture *texture, const unsigned char *bytes, size_t size, const char *name);
+
+#endif
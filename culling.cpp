@@ -0,0 +1,192 @@
+// ==========================================================================
+// View frustum culling
+// ==========================================================================
+
+#include "culling.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+// planes still to be tested, one bit each; a node wholly inside a plane
+// clears its bit for everything below it
+#define ALL_PLANES 0x3F
+
+void ExtractFrustum(Frustum *frustum, const mat4 &viewProjection)
+{
+	// rows of the matrix; glm stores it by columns
+	vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+	// a clip-space point is inside when -w <= x, y, z <= w
+	frustum->planes[0] = rows[3] + rows[0];
+	frustum->planes[1] = rows[3] - rows[0];
+	frustum->planes[2] = rows[3] + rows[1];
+	frustum->planes[3] = rows[3] - rows[1];
+	frustum->planes[4] = rows[3] + rows[2];
+	frustum->planes[5] = rows[3] - rows[2];
+
+	// unit normals make the plane distance a true distance, comparable
+	// with a radius
+	for (int i = 0; i < 6; i++)
+		frustum->planes[i] /= length(vec3(frustum->planes[i]));
+}
+
+vec4 BoundingSphere(const mat4 &model, float meshRadius)
+{
+	// the longest axis bounds any rotation and non-uniform scale
+	float scale = std::max(std::max(length(vec3(model[0])), length(vec3(model[1]))), length(vec3(model[2])));
+	return vec4(vec3(model[3]), meshRadius * scale);
+}
+
+static bool SphereInPlanes(const Frustum *frustum, const vec4 &sphere, int mask)
+{
+	for (int i = 0; i < 6; i++) {
+		if (!(mask & (1 << i))) continue;
+		const vec4 &plane = frustum->planes[i];
+		if (dot(vec3(plane), vec3(sphere)) + plane.w < -sphere.w) return false;
+	}
+	return true;
+}
+
+bool SphereInFrustum(const Frustum *frustum, const vec4 &sphere)
+{
+	return SphereInPlanes(frustum, sphere, ALL_PLANES);
+}
+
+// --------------------------------------------------------------------------
+// Hierarchy construction
+
+static void SphereBounds(const vec4 &sphere, vec3 *lower, vec3 *upper)
+{
+	*lower = vec3(sphere) - vec3(sphere.w);
+	*upper = vec3(sphere) + vec3(sphere.w);
+}
+
+// the node's bounds from its leaf spheres or its children
+static void FitNode(BVH *bvh, size_t index, const vec4 *spheres)
+{
+	BVHNode &node = bvh->nodes[index];
+	if (node.count == 0) {
+		const BVHNode &left = bvh->nodes[node.first], &right = bvh->nodes[node.first + 1];
+		node.lower = min(left.lower, right.lower);
+		node.upper = max(left.upper, right.upper);
+		return;
+	}
+
+	SphereBounds(spheres[bvh->order[node.first]], &node.lower, &node.upper);
+	for (int i = 1; i < node.count; i++) {
+		vec3 lower, upper;
+		SphereBounds(spheres[bvh->order[node.first + i]], &lower, &upper);
+		node.lower = min(node.lower, lower);
+		node.upper = max(node.upper, upper);
+	}
+}
+
+// splits order[first, first+count) under node index, recursively
+static void BuildNode(BVH *bvh, size_t index, int first, int count, const vec4 *spheres)
+{
+	if (count <= BVH_LEAF_SIZE) {
+		bvh->nodes[index].first = first;
+		bvh->nodes[index].count = count;
+		FitNode(bvh, index, spheres);
+		return;
+	}
+
+	// split along the longest axis of the centres, half each side
+	vec3 lower(spheres[bvh->order[first]]), upper = lower;
+	for (int i = 1; i < count; i++) {
+		lower = min(lower, vec3(spheres[bvh->order[first + i]]));
+		upper = max(upper, vec3(spheres[bvh->order[first + i]]));
+	}
+	vec3 extent = upper - lower;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+	int half = count / 2;
+	int *begin = &bvh->order[first];
+	nth_element(begin, begin + half, begin + count, [spheres, axis](int a, int b) {
+		return spheres[a][axis] < spheres[b][axis];
+	});
+
+	// children sit side by side, after their parent
+	int children = int(bvh->nodes.size());
+	bvh->nodes.resize(children + 2);
+	bvh->nodes[index].first = children;
+	bvh->nodes[index].count = 0;
+
+	BuildNode(bvh, children, first, half, spheres);
+	BuildNode(bvh, children + 1, first + half, count - half, spheres);
+	FitNode(bvh, index, spheres);
+}
+
+void BuildBVH(BVH *bvh, const vec4 *spheres, size_t count)
+{
+	bvh->order.resize(count);
+	for (size_t i = 0; i < count; i++)
+		bvh->order[i] = int(i);
+
+	// a binary tree with leaves of about BVH_LEAF_SIZE / 2 and up
+	bvh->nodes.clear();
+	bvh->nodes.reserve(4 * count / BVH_LEAF_SIZE + 1);
+	if (count == 0) return;
+
+	bvh->nodes.resize(1);
+	BuildNode(bvh, 0, 0, int(count), spheres);
+}
+
+void RefitBVH(BVH *bvh, const vec4 *spheres)
+{
+	// children come after their parents, so walking backwards refits every
+	// child before the node that contains it
+	for (size_t i = bvh->nodes.size(); i-- > 0; )
+		FitNode(bvh, i, spheres);
+}
+
+// --------------------------------------------------------------------------
+// Traversal
+
+static void CullNode(BVH *bvh, size_t index, int mask, const Frustum *frustum, const vec4 *spheres, vector<int> *visible)
+{
+	const BVHNode &node = bvh->nodes[index];
+	bvh->visited++;
+
+	for (int i = 0; i < 6; i++) {
+		if (!(mask & (1 << i))) continue;
+		const vec4 &plane = frustum->planes[i];
+		vec3 normal(plane);
+
+		// the box corner farthest along the normal decides whether any of
+		// it is inside, the nearest whether all of it is
+		vec3 farthest(normal.x >= 0 ? node.upper.x : node.lower.x,
+			normal.y >= 0 ? node.upper.y : node.lower.y,
+			normal.z >= 0 ? node.upper.z : node.lower.z);
+		vec3 nearest(normal.x >= 0 ? node.lower.x : node.upper.x,
+			normal.y >= 0 ? node.lower.y : node.upper.y,
+			normal.z >= 0 ? node.lower.z : node.upper.z);
+
+		if (dot(normal, farthest) + plane.w < 0) return;
+		if (dot(normal, nearest) + plane.w >= 0) mask &= ~(1 << i);
+	}
+
+	if (node.count > 0) {
+		for (int i = 0; i < node.count; i++) {
+			int sphere = bvh->order[node.first + i];
+			if (mask == 0 || SphereInPlanes(frustum, spheres[sphere], mask))
+				visible->push_back(sphere);
+		}
+		bvh->visited += node.count;
+		return;
+	}
+
+	CullNode(bvh, node.first, mask, frustum, spheres, visible);
+	CullNode(bvh, node.first + 1, mask, frustum, spheres, visible);
+}
+
+void CullBVH(BVH *bvh, const Frustum *frustum, const vec4 *spheres, vector<int> *visible)
+{
+	bvh->visited = 0;
+	if (!bvh->nodes.empty())
+		CullNode(bvh, 0, ALL_PLANES, frustum, spheres, visible);
+}
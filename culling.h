@@ -0,0 +1,80 @@
+// ==========================================================================
+// View frustum culling
+//
+// Bodies are bounded by spheres, xyz the world-space centre and w the
+// radius, and kept when they touch the frustum of the frame's
+// projection * view matrix. Large sets of spheres, such as the asteroid
+// belt, go into a bounding volume hierarchy of axis-aligned boxes so that a
+// whole branch off screen, or wholly on it, is settled with one test:
+//
+//	BuildBVH(&bvh, &spheres[0], count);		// when the set changes shape
+//	RefitBVH(&bvh, &spheres[0]);			// every frame the spheres move
+//	CullBVH(&bvh, &frustum, &spheres[0], &visible);
+//
+// Refitting keeps the tree valid as spheres move but lets it loosen, so it
+// should be rebuilt every so often.
+// ==========================================================================
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// leaves hold at most this many spheres
+#define BVH_LEAF_SIZE 8
+
+// planes point inwards, normalized, in the order left, right, bottom, top,
+// near, far
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+struct BVHNode
+{
+	// bounds of everything below the node
+	glm::vec3 lower;
+	glm::vec3 upper;
+
+	// a leaf's spheres are order[first] .. order[first+count-1]; an inner
+	// node has count 0, and its children are nodes first and first+1
+	int first;
+	int count;
+};
+
+struct BVH
+{
+	// root first; children always come after their parent
+	std::vector<BVHNode> nodes;
+
+	// sphere indices, grouped by leaf
+	std::vector<int> order;
+
+	// nodes and spheres tested by the last CullBVH, for profiling
+	size_t visited;
+
+	BVH() : visited(0)
+	{}
+};
+
+// the frustum of a combined projection * view matrix
+void ExtractFrustum(Frustum *frustum, const glm::mat4 &viewProjection);
+
+// the world-space bounds of a mesh that fits in a sphere of meshRadius about
+// its origin, once transformed by model
+glm::vec4 BoundingSphere(const glm::mat4 &model, float meshRadius = 1.f);
+
+bool SphereInFrustum(const Frustum *frustum, const glm::vec4 &sphere);
+
+// builds the hierarchy from scratch, splitting at the median of each node's
+// longest axis
+void BuildBVH(BVH *bvh, const glm::vec4 *spheres, size_t count);
+
+// recomputes every node's bounds from the spheres' new positions, keeping
+// the tree's shape
+void RefitBVH(BVH *bvh, const glm::vec4 *spheres);
+
+// appends the index of every sphere that touches the frustum to visible
+void CullBVH(BVH *bvh, const Frustum *frustum, const glm::vec4 *spheres, std::vector<int> *visible);
+
+#endif
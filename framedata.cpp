@@ -0,0 +1,44 @@
+// ==========================================================================
+// Per-frame uniform buffer
+// ==========================================================================
+
+#include "framedata.h"
+#include "program.h"
+#include "gldebug.h"
+
+using namespace glm;
+
+bool InitializeFrameData(FrameData *frame)
+{
+	glGenBuffers(1, &frame->uniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frame->uniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), 0, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// the binding point is global state, so this only has to happen once
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frame->uniformBuffer);
+
+	return !CheckGLErrors();
+}
+
+void UpdateFrameData(FrameData *frame, const mat4 &view, const mat4 &projection, float time)
+{
+	FrameUniforms &uniforms = frame->uniforms;
+	uniforms.view = view;
+	uniforms.projection = projection;
+	uniforms.viewProjection = projection*view;
+
+	// the camera sits at the origin of view space
+	uniforms.cameraPosition = inverse(view)[3];
+	uniforms.time = time;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, frame->uniformBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &uniforms);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void DestroyFrameData(FrameData *frame)
+{
+	glDeleteBuffers(1, &frame->uniformBuffer);
+	frame->uniformBuffer = 0;
+}
@@ -0,0 +1,52 @@
+// ==========================================================================
+// Per-frame uniform buffer
+//
+// Camera and timing data that every program reads, uploaded once per frame
+// into a std140 uniform block bound to FRAME_BLOCK_BINDING. Shaders declare
+// it as
+//
+//	layout(std140) uniform FrameData {
+//		mat4 view;
+//		mat4 projection;
+//		mat4 viewProjection;
+//		vec4 cameraPosition;	// w is unused
+//		float time;
+//	};
+// ==========================================================================
+#ifndef FRAMEDATA_H
+#define FRAMEDATA_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// mirrors the std140 layout of the FrameData block, padded to a vec4
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	glm::vec4 cameraPosition;
+	GLfloat   time;
+	GLfloat   padding[3];
+};
+
+struct FrameData
+{
+	// OpenGL name of the uniform buffer, and what was last uploaded to it
+	GLuint        uniformBuffer;
+	FrameUniforms uniforms;
+
+	// initialize object names to zero (OpenGL reserved value)
+	FrameData() : uniformBuffer(0)
+	{}
+};
+
+// create the uniform buffer and attach it to FRAME_BLOCK_BINDING
+bool InitializeFrameData(FrameData *frame);
+
+// upload this frame's camera and time, once, before anything is drawn
+void UpdateFrameData(FrameData *frame, const glm::mat4 &view, const glm::mat4 &projection, float time);
+
+void DestroyFrameData(FrameData *frame);
+
+#endif
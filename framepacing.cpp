@@ -0,0 +1,107 @@
+// ==========================================================================
+// Frame pacing
+// ==========================================================================
+
+#include "framepacing.h"
+
+#include <iostream>
+#include <thread>
+#include <GLFW/glfw3.h>
+
+using namespace std;
+
+FramePacing::FramePacing() : mode(SWAP_VSYNC), maxFramesInFlight(2), fpsCap(0.0), frame(0)
+{
+	for (int i = 0; i < PACING_MAX_FRAMES_IN_FLIGHT; i++)
+		fences[i] = 0;
+}
+
+bool ParseSwapMode(const string &name, SwapMode *mode)
+{
+	for (int m = SWAP_IMMEDIATE; m <= SWAP_ADAPTIVE; m++) {
+		if (name == SwapModeName(SwapMode(m))) {
+			*mode = SwapMode(m);
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *SwapModeName(SwapMode mode)
+{
+	switch (mode) {
+	case SWAP_IMMEDIATE: return "immediate";
+	case SWAP_VSYNC:     return "vsync";
+	case SWAP_ADAPTIVE:  return "adaptive";
+	}
+	return "unknown";
+}
+
+SwapMode ApplySwapMode(FramePacing *pacing)
+{
+	if (pacing->mode == SWAP_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+		&& !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+		cout << "WARNING: adaptive vsync is not supported, using vsync" << endl;
+		pacing->mode = SWAP_VSYNC;
+	}
+
+	// a negative interval is how swap_control_tear asks for adaptive vsync
+	switch (pacing->mode) {
+	case SWAP_IMMEDIATE: glfwSwapInterval(0);  break;
+	case SWAP_VSYNC:     glfwSwapInterval(1);  break;
+	case SWAP_ADAPTIVE:  glfwSwapInterval(-1); break;
+	}
+
+	if (pacing->maxFramesInFlight > PACING_MAX_FRAMES_IN_FLIGHT)
+		pacing->maxFramesInFlight = PACING_MAX_FRAMES_IN_FLIGHT;
+	pacing->nextFrame = chrono::steady_clock::now();
+	return pacing->mode;
+}
+
+void WaitForFrameSlot(FramePacing *pacing)
+{
+	// sleep most of the way to the cap, then yield the rest, since sleeps
+	// tend to overshoot by about a millisecond
+	if (pacing->fpsCap > 0.0) {
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (pacing->nextFrame - now > chrono::milliseconds(2))
+			this_thread::sleep_until(pacing->nextFrame - chrono::milliseconds(1));
+		while (chrono::steady_clock::now() < pacing->nextFrame)
+			this_thread::yield();
+
+		// a frame that ran late starts the schedule again rather than
+		// letting the next few run back to back to catch up
+		chrono::steady_clock::duration period = chrono::duration_cast<chrono::steady_clock::duration>(
+			chrono::duration<double>(1.0 / pacing->fpsCap));
+		now = chrono::steady_clock::now();
+		pacing->nextFrame += period;
+		if (pacing->nextFrame < now)
+			pacing->nextFrame = now + period;
+	}
+
+	// the fence in this slot was set maxFramesInFlight frames ago
+	if (pacing->maxFramesInFlight > 0) {
+		GLsync &fence = pacing->fences[pacing->frame % pacing->maxFramesInFlight];
+		if (fence) {
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+}
+
+void EndPacedFrame(FramePacing *pacing)
+{
+	if (pacing->maxFramesInFlight > 0)
+		pacing->fences[pacing->frame % pacing->maxFramesInFlight] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pacing->frame++;
+}
+
+void DestroyFramePacing(FramePacing *pacing)
+{
+	for (int i = 0; i < PACING_MAX_FRAMES_IN_FLIGHT; i++) {
+		if (pacing->fences[i])
+			glDeleteSync(pacing->fences[i]);
+		pacing->fences[i] = 0;
+	}
+}
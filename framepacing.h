@@ -0,0 +1,75 @@
+// ==========================================================================
+// Frame pacing
+//
+// Chooses how buffer swaps wait for the display and how far the CPU may run
+// ahead of the GPU. Every queued frame adds a frame of latency between
+// reading input and showing its result, so a frame starts by waiting until
+// the GPU has finished all but maxFramesInFlight-1 of the frames before it,
+// and until the frame rate cap allows another; only then is input sampled
+// and the view built, as late as possible. A frame looks like
+//
+//	WaitForFrameSlot(&pacing);
+//	... simulate, then poll input and build the view, then draw ...
+//	glfwSwapBuffers(window);
+//	EndPacedFrame(&pacing);
+//
+// Adaptive vsync swaps on vertical blank when the frame is on time and
+// immediately, with a tear, when it is late, instead of waiting a whole
+// extra refresh. It needs the swap_control_tear extension and falls back to
+// plain vsync without it.
+// ==========================================================================
+#ifndef FRAMEPACING_H
+#define FRAMEPACING_H
+
+#include <chrono>
+#include <string>
+#include <glad/glad.h>
+
+// the most frames maxFramesInFlight can allow
+#define PACING_MAX_FRAMES_IN_FLIGHT 4
+
+enum SwapMode
+{
+	SWAP_IMMEDIATE = 0,
+	SWAP_VSYNC,
+	SWAP_ADAPTIVE
+};
+
+struct FramePacing
+{
+	SwapMode mode;
+
+	// frames the GPU may have queued, from 1 to PACING_MAX_FRAMES_IN_FLIGHT;
+	// 0 leaves it to the driver
+	int maxFramesInFlight;
+
+	// frames a second at most, or 0 for no cap
+	double fpsCap;
+
+	// one fence per frame in flight, and when the next frame may start
+	GLsync fences[PACING_MAX_FRAMES_IN_FLIGHT];
+	unsigned int frame;
+	std::chrono::steady_clock::time_point nextFrame;
+
+	FramePacing();
+};
+
+// parses "immediate", "vsync" or "adaptive"; returns false for anything else
+bool ParseSwapMode(const std::string &name, SwapMode *mode);
+
+const char *SwapModeName(SwapMode mode);
+
+// sets the swap interval of the current context for the pacing's mode,
+// falling back to vsync where adaptive is not supported; returns the mode
+// actually in use, which is also left in the pacing
+SwapMode ApplySwapMode(FramePacing *pacing);
+
+// blocks until the fps cap and the frames in flight allow another frame
+void WaitForFrameSlot(FramePacing *pacing);
+
+// fences the frame just submitted; call after swapping buffers
+void EndPacedFrame(FramePacing *pacing);
+
+void DestroyFramePacing(FramePacing *pacing);
+
+#endif
@@ -0,0 +1,84 @@
+// ==========================================================================
+// OpenGL error reporting
+// ==========================================================================
+
+#include "gldebug.h"
+
+#include <iostream>
+
+using namespace std;
+
+bool pollGLErrors = true;
+
+bool CheckGLErrors()
+{
+	bool error = false;
+	for (GLenum flag = glGetError(); flag != GL_NO_ERROR; flag = glGetError())
+	{
+		cout << "OpenGL ERROR:  ";
+		switch (flag) {
+		case GL_INVALID_ENUM:
+			cout << "GL_INVALID_ENUM" << endl; break;
+		case GL_INVALID_VALUE:
+			cout << "GL_INVALID_VALUE" << endl; break;
+		case GL_INVALID_OPERATION:
+			cout << "GL_INVALID_OPERATION" << endl; break;
+		case GL_INVALID_FRAMEBUFFER_OPERATION:
+			cout << "GL_INVALID_FRAMEBUFFER_OPERATION" << endl; break;
+		case GL_OUT_OF_MEMORY:
+			cout << "GL_OUT_OF_MEMORY" << endl; break;
+		default:
+			cout << "[unknown error code]" << endl;
+		}
+		error = true;
+	}
+	return error;
+}
+
+// reports messages from the driver as they are generated
+static void APIENTRY DebugCallback(GLenum /*source*/, GLenum type, GLuint id, GLenum severity,
+	GLsizei /*length*/, const GLchar *message, const void * /*userParam*/)
+{
+	// notifications are mostly buffer placement hints, far too chatty
+	if (severity == GL_DEBUG_SEVERITY_NOTIFICATION) return;
+
+	cout << "OpenGL ";
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR:
+		cout << "ERROR"; break;
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+		cout << "DEPRECATED"; break;
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+		cout << "UNDEFINED BEHAVIOUR"; break;
+	case GL_DEBUG_TYPE_PERFORMANCE:
+		cout << "PERFORMANCE"; break;
+	default:
+		cout << "MESSAGE"; break;
+	}
+	cout << " [" << id << "]:  " << message << endl;
+}
+
+bool InitializeDebugOutput()
+{
+	// core since 4.3, but 4.1 drivers commonly expose the extension
+	if (!GLAD_GL_KHR_debug && !GLAD_GL_VERSION_4_3)
+		return false;
+
+	// without a debug context the driver may not generate any messages
+	GLint flags = 0;
+	glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT))
+		cout << "OpenGL debug output enabled on a non-debug context" << endl;
+
+	glEnable(GL_DEBUG_OUTPUT);
+
+	// report from inside the offending call, so a breakpoint in the callback
+	// has it on the stack
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(DebugCallback, 0);
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, 0, GL_FALSE);
+
+	// anything raised before the callback was installed is still queued
+	CheckGLErrors();
+	return true;
+}
@@ -0,0 +1,32 @@
+// ==========================================================================
+// OpenGL error reporting
+//
+// glGetError makes many drivers synchronise with the GPU, which is fine
+// during setup but not once per draw. Per-draw code therefore checks through
+// CHECK_DRAW_ERRORS, which compiles away in release (NDEBUG) builds and, in
+// debug builds, only polls when no GL_KHR_debug callback is reporting errors
+// as they happen.
+// ==========================================================================
+#ifndef GLDEBUG_H
+#define GLDEBUG_H
+
+#include <glad/glad.h>
+
+// polls glGetError until the queue is empty, printing every error found;
+// returns true if there were any
+bool CheckGLErrors();
+
+// installs a glDebugMessageCallback if the context supports GL_KHR_debug,
+// returning true if errors will now be reported through it
+bool InitializeDebugOutput();
+
+// true while per-draw code should poll glGetError itself
+extern bool pollGLErrors;
+
+#ifdef NDEBUG
+#define CHECK_DRAW_ERRORS() (false)
+#else
+#define CHECK_DRAW_ERRORS() (pollGLErrors && CheckGLErrors())
+#endif
+
+#endif
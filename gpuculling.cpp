@@ -0,0 +1,386 @@
+// ==========================================================================
+// GPU-driven culling and draw submission
+// ==========================================================================
+
+#include "gpuculling.h"
+#include "gldebug.h"
+#include "instances.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+// compute and indirect draws only exist if the loader was generated with them
+#if defined(GL_VERSION_4_3)
+#define HAVE_COMPUTE_CULLING 1
+#endif
+
+GPUCulling::GPUCulling() : compute(false), procedural(false), capacity(0), count(0),
+	modelBuffer(0), layerBuffer(0), lodBuffer(0), output(0), uniformBuffer(0), commandBuffer(0),
+	sourceArray(0), drawn(-1), vertexArray(0), drawCalls(0)
+{
+	for (int i = 0; i < CULL_FEEDBACK_FRAMES; i++) {
+		outputBuffers[i] = 0;
+		for (int j = 0; j < LOD_LEVELS; j++)
+			queries[i][j] = 0;
+		queried[i] = false;
+	}
+	for (int j = 0; j < LOD_LEVELS; j++)
+		drawnCounts[j] = 0;
+}
+
+bool ComputeCullingSupported()
+{
+#ifdef HAVE_COMPUTE_CULLING
+	return GLAD_GL_VERSION_4_3 != 0;
+#else
+	return false;
+#endif
+}
+
+// words in one indirect command, which is how the compute shader steps
+// through them
+static GLint CommandStride(const GPUCulling *culling)
+{
+	if (culling->procedural)
+		return sizeof(DrawArraysIndirectCommand) / sizeof(GLuint);
+	return sizeof(DrawElementsIndirectCommand) / sizeof(GLuint);
+}
+
+// bytes in one level's run of culled instances
+static GLsizeiptr RunSize(const GPUCulling *culling)
+{
+	return sizeof(InstanceData) * culling->capacity;
+}
+
+// one empty command per level, each drawing from its own run of instances,
+// for the compute shader to count instances into
+static void ResetCommands(GPUCulling *culling)
+{
+	const LODChain &chain = culling->chain;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling->commandBuffer);
+	if (culling->procedural) {
+		DrawArraysIndirectCommand commands[LOD_LEVELS];
+		for (int i = 0; i < chain.count; i++) {
+			commands[i].count = chain.levels[i].indexCount;
+			commands[i].instanceCount = 0;
+			commands[i].first = 0;
+			commands[i].baseInstance = i * culling->capacity;
+		}
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(commands[0]) * chain.count, commands);
+	}
+	else {
+		DrawElementsIndirectCommand commands[LOD_LEVELS];
+		for (int i = 0; i < chain.count; i++) {
+			commands[i].count = chain.levels[i].indexCount;
+			commands[i].instanceCount = 0;
+			commands[i].firstIndex = chain.levels[i].firstIndex;
+			commands[i].baseVertex = chain.levels[i].baseVertex;
+			commands[i].baseInstance = i * culling->capacity;
+		}
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(commands[0]) * chain.count, commands);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+bool InitializeGPUCulling(GPUCulling *culling, const LODChain *chain, GLsizei capacity,
+	GLuint vertexBuffer, GLuint indexBuffer, const VertexLayout *layout)
+{
+	culling->compute = ComputeCullingSupported();
+	culling->procedural = (layout == 0);
+	culling->capacity = capacity;
+	culling->count = 0;
+	culling->chain = *chain;
+	culling->output = 0;
+	culling->drawn = -1;
+
+	if (chain->count <= 0) {
+		cout << "ERROR: GPU culling needs at least one level of detail" << endl;
+		return false;
+	}
+
+	culling->program = culling->compute
+		? InitializeComputeShader("shaders/cull_compute.glsl")
+		: InitializeFeedbackShaders("shaders/cull_vertex.glsl", "shaders/cull_geometry.glsl",
+			{ "instanceModel", "instanceLayer", "gl_SkipComponents3" });
+	if (!culling->program.id) {
+		cout << "ERROR: could not build the culling program" << endl;
+		return false;
+	}
+	SetUniform(&culling->program, UNIFORM_DEPTH_PYRAMID, CULL_PYRAMID_UNIT);
+
+	// what the CPU writes each frame, and the layers it writes once
+	glGenBuffers(1, &culling->modelBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, culling->modelBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(mat4) * capacity, 0, GL_STREAM_DRAW);
+	glGenBuffers(1, &culling->layerBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, culling->layerBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLint) * capacity, 0, GL_STATIC_DRAW);
+
+	// what the GPU writes, which the CPU never reads
+	int outputs = culling->compute ? 1 : CULL_FEEDBACK_FRAMES;
+	glGenBuffers(outputs, culling->outputBuffers);
+	for (int i = 0; i < outputs; i++) {
+		glBindBuffer(GL_ARRAY_BUFFER, culling->outputBuffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, RunSize(culling) * chain->count, 0, GL_DYNAMIC_COPY);
+	}
+
+	if (culling->compute) {
+		// no body has a level yet
+		vector<GLint> levels(capacity, -1);
+		glGenBuffers(1, &culling->lodBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, culling->lodBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLint) * capacity, &levels[0], GL_DYNAMIC_COPY);
+
+		glGenBuffers(1, &culling->commandBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling->commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(GLuint) * CommandStride(culling) * chain->count, 0, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else {
+		// the bodies as points, read with the instance attribute locations
+		// but advancing per vertex
+		glGenVertexArrays(1, &culling->sourceArray);
+		glBindVertexArray(culling->sourceArray);
+		glBindBuffer(GL_ARRAY_BUFFER, culling->modelBuffer);
+		for (GLuint column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(INSTANCE_MODEL_INDEX + column);
+			glVertexAttribPointer(INSTANCE_MODEL_INDEX + column, 4, GL_FLOAT, GL_FALSE,
+				sizeof(mat4), (void*)(sizeof(vec4) * column));
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, culling->layerBuffer);
+		glEnableVertexAttribArray(INSTANCE_LAYER_INDEX);
+		glVertexAttribIPointer(INSTANCE_LAYER_INDEX, 1, GL_INT, sizeof(GLint), 0);
+		glBindVertexArray(0);
+
+		glGenQueries(CULL_FEEDBACK_FRAMES * LOD_LEVELS, &culling->queries[0][0]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &culling->uniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, culling->uniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(CullUniforms), 0, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, CULL_BLOCK_BINDING, culling->uniformBuffer);
+
+	// the mesh, with the culled instances as its per-instance attributes
+	glGenVertexArrays(1, &culling->vertexArray);
+	glBindVertexArray(culling->vertexArray);
+	if (!culling->procedural) {
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		ApplyVertexLayout(layout);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	}
+	EnableInstanceAttributes();
+	PointInstanceAttributes(culling->outputBuffers[0], 0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	cout << "GPU culling with " << (culling->compute ? "compute shaders" : "transform feedback") << endl;
+	return !CheckGLErrors();
+}
+
+void SetCulledLayers(GPUCulling *culling, GLsizei first, const GLint *layers, GLsizei count)
+{
+	count = std::min(count, culling->capacity - first);
+	if (count <= 0) return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, culling->layerBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLint) * first, sizeof(GLint) * count, layers);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SetCulledModels(GPUCulling *culling, GLsizei first, const mat4 *models, GLsizei count)
+{
+	count = std::min(count, culling->capacity - first);
+	if (count <= 0) return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, culling->modelBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(mat4) * first, sizeof(mat4) * count, models);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	culling->count = std::max(culling->count, first + count);
+}
+
+// moves the fallback on to the newest capture, from newest back, whose
+// counts have all arrived; it never waits for the GPU, and keeps the one it
+// drew until something newer is ready. Returns false while there is
+// nothing to draw
+static bool CollectFeedbackCounts(GPUCulling *culling, int newest)
+{
+	const LODChain &chain = culling->chain;
+	for (int age = 0; age < CULL_FEEDBACK_FRAMES; age++) {
+		int slot = (newest + CULL_FEEDBACK_FRAMES - age) % CULL_FEEDBACK_FRAMES;
+		if (slot == culling->drawn || !culling->queried[slot]) break;
+
+		GLuint available = 1;
+		for (int level = 0; level < chain.count && available; level++)
+			glGetQueryObjectuiv(culling->queries[slot][level], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) continue;
+
+		for (int level = 0; level < chain.count; level++)
+			glGetQueryObjectuiv(culling->queries[slot][level], GL_QUERY_RESULT, &culling->drawnCounts[level]);
+		culling->drawn = slot;
+		break;
+	}
+	return culling->drawn >= 0;
+}
+
+void CullBodies(GPUCulling *culling, RenderState *state, const Frustum *frustum, float pixelsPerUnit,
+	const DepthPyramid *pyramid)
+{
+	const LODChain &chain = culling->chain;
+
+	CullUniforms uniforms;
+	for (int i = 0; i < 6; i++)
+		uniforms.planes[i] = frustum->planes[i];
+	for (int i = 0; i < LOD_LEVELS; i++)
+		uniforms.lodRadii[i] = vec4(i < chain.count ? chain.levels[i].maxRadius : 0.f, 0.f, 0.f, 0.f);
+	uniforms.pixelsPerUnit = pixelsPerUnit;
+	uniforms.hysteresis = chain.hysteresis;
+	uniforms.bodyCount = culling->count;
+	uniforms.lodCount = chain.count;
+	uniforms.capacity = culling->capacity;
+	uniforms.commandStride = CommandStride(culling);
+	uniforms.padding[0] = uniforms.padding[1] = 0;
+	uniforms.occlusionViewProjection = mat4(1.f);
+	uniforms.occlusionSize = vec4(0.f);
+	if (pyramid && pyramid->built) {
+		uniforms.occlusionViewProjection = pyramid->viewProjection;
+		uniforms.occlusionSize = vec4(pyramid->width, pyramid->height, pyramid->levels, 1.f);
+		BindTexture(state, CULL_PYRAMID_UNIT, GL_TEXTURE_2D, pyramid->texture);
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, culling->uniformBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CullUniforms), &uniforms);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	UseProgram(state, culling->program.id);
+
+	if (culling->compute) {
+#ifdef HAVE_COMPUTE_CULLING
+		ResetCommands(culling);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, culling->modelBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, culling->layerBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, culling->lodBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, culling->outputBuffers[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, culling->commandBuffer);
+
+		GLuint groups = (culling->count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+		if (groups > 0)
+			glDispatchCompute(groups, 1, 1);
+
+		// the draws read the commands and instances, and the next dispatch
+		// the levels
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+			GL_SHADER_STORAGE_BARRIER_BIT);
+#endif
+	}
+	else {
+		// captures into the next output round the ring; DrawCulledBodies
+		// draws an older one whose counts have arrived. Should that next
+		// output still be the one drawn, with nothing newer finished, the GPU
+		// is a whole ring behind, and rather than wait this frame captures
+		// nothing and the bodies keep their last transforms
+		int target = (culling->output + 1) % CULL_FEEDBACK_FRAMES;
+		if (target == culling->drawn)
+			CollectFeedbackCounts(culling, culling->output);
+		if (target == culling->drawn) {
+			culling->count = 0;
+			return;
+		}
+		culling->output = target;
+
+		BindVertexArray(state, culling->sourceArray);
+		glEnable(GL_RASTERIZER_DISCARD);
+		for (int level = 0; level < chain.count; level++) {
+			SetUniform(&culling->program, UNIFORM_LEVEL, level);
+			glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, culling->outputBuffers[target],
+				RunSize(culling) * level, RunSize(culling));
+
+			glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, culling->queries[target][level]);
+			glBeginTransformFeedback(GL_POINTS);
+			glDrawArrays(GL_POINTS, 0, culling->count);
+			glEndTransformFeedback();
+			glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+		}
+		glDisable(GL_RASTERIZER_DISCARD);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		culling->queried[target] = true;
+	}
+
+	CHECK_DRAW_ERRORS();
+
+	// the next frame sets its bodies afresh
+	culling->count = 0;
+}
+
+void DrawCulledBodies(GPUCulling *culling, RenderState *state, ShaderProgram *program, GLenum mode)
+{
+	const LODChain &chain = culling->chain;
+	culling->drawCalls = 0;
+
+	UseProgram(state, program->id);
+	BindVertexArray(state, culling->vertexArray);
+
+	if (culling->compute) {
+#ifdef HAVE_COMPUTE_CULLING
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling->commandBuffer);
+		if (culling->procedural) {
+			// each level tessellates differently, so needs a draw of its own
+			for (int level = 0; level < chain.count; level++) {
+				const MeshLOD &lod = chain.levels[level];
+				SetUniform(program, UNIFORM_TESSELLATION, ivec2(lod.columns, lod.rings));
+				glDrawArraysIndirect(mode, (const void*)(sizeof(DrawArraysIndirectCommand) * level));
+				culling->drawCalls++;
+			}
+		}
+		else {
+			glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, 0, chain.count, 0);
+			culling->drawCalls++;
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+#endif
+	}
+	else if (CollectFeedbackCounts(culling, (culling->output + CULL_FEEDBACK_FRAMES - 1) % CULL_FEEDBACK_FRAMES)) {
+		// 4.1 has no base instance, so each level moves the attribute
+		// offsets to its run, as BindInstanceRange does
+		for (int level = 0; level < chain.count; level++) {
+			GLuint count = culling->drawnCounts[level];
+			if (count == 0) continue;
+
+			const MeshLOD &lod = chain.levels[level];
+			PointInstanceAttributes(culling->outputBuffers[culling->drawn], RunSize(culling) * level);
+			if (culling->procedural) {
+				SetUniform(program, UNIFORM_TESSELLATION, ivec2(lod.columns, lod.rings));
+				glDrawArraysInstanced(mode, 0, lod.indexCount, count);
+			}
+			else
+				glDrawElementsInstancedBaseVertex(mode, lod.indexCount, GL_UNSIGNED_INT,
+					(const void*)(lod.firstIndex * sizeof(GLuint)), count, lod.baseVertex);
+			culling->drawCalls++;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	CHECK_DRAW_ERRORS();
+}
+
+void DestroyGPUCulling(GPUCulling *culling)
+{
+	DestroyProgram(&culling->program);
+	glDeleteVertexArrays(1, &culling->vertexArray);
+	glDeleteVertexArrays(1, &culling->sourceArray);
+	glDeleteQueries(CULL_FEEDBACK_FRAMES * LOD_LEVELS, &culling->queries[0][0]);
+	glDeleteBuffers(1, &culling->modelBuffer);
+	glDeleteBuffers(1, &culling->layerBuffer);
+	glDeleteBuffers(1, &culling->lodBuffer);
+	glDeleteBuffers(CULL_FEEDBACK_FRAMES, culling->outputBuffers);
+	glDeleteBuffers(1, &culling->uniformBuffer);
+	glDeleteBuffers(1, &culling->commandBuffer);
+
+	*culling = GPUCulling();
+}
@@ -0,0 +1,182 @@
+// ==========================================================================
+// GPU-driven culling and draw submission
+//
+// Every body's model matrix and texture layer go to the GPU as they are,
+// and the GPU decides what is drawn: a compute shader tests each body's
+// bounding sphere against the frustum, picks its level of detail with the
+// same hysteresis as SelectLOD, and appends it to that level's run of
+// instances, counting it into the level's indirect draw command. The
+// frame's bodies are then drawn with one glMultiDrawElementsIndirect, and
+// the CPU never looks at an individual body. A frame looks like
+//
+//	SetCulledModels(&culling, 0, &models[0], count);
+//	CullBodies(&culling, &renderState, &frustum, pixelsPerUnit, &pyramid);
+//	... bind textures ...
+//	DrawCulledBodies(&culling, &renderState, &program);
+//
+// Compute shaders, storage buffers and multi-draw indirect need 4.3, and a
+// glad loader generated with it. On plain 4.1 the bodies are instead run
+// through a vertex and geometry shader as points, once per level, and
+// transform feedback captures the visible ones of that level; 4.1 cannot
+// feed the number captured into a draw without a round trip, so the counts
+// come back through queries, which are only read once they have arrived.
+// The fallback therefore draws the previous frame's transforms, or older
+// ones while the GPU is further behind: bodies lag a frame behind the rest
+// of the scene, and it picks levels without hysteresis. Neither path
+// draws impostors; the chain's impostorRadius is ignored. Given a depth
+// pyramid (see occlusion.h), both also drop bodies hidden behind what was
+// drawn the frame before.
+//
+// Both shaders read the culling parameters from a std140 uniform block
+// bound to CULL_BLOCK_BINDING:
+//
+//	layout(std140) uniform CullData {
+//		vec4  planes[6];		// as in Frustum
+//		vec4  lodRadii[LOD_LEVELS];	// x is the level's maxRadius
+//		float pixelsPerUnit;
+//		float hysteresis;
+//		int   bodyCount;
+//		int   lodCount;
+//		int   capacity;		// instances in each level's run
+//		int   commandStride;	// words per indirect command
+//		mat4  occlusionViewProjection;	// the depth pyramid's camera
+//		vec4  occlusionSize;	// its width, height, levels, and 1 if built
+//	};
+// ==========================================================================
+#ifndef GPUCULLING_H
+#define GPUCULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "culling.h"
+#include "framepacing.h"
+#include "lod.h"
+#include "occlusion.h"
+#include "program.h"
+#include "renderstate.h"
+#include "vertexformat.h"
+
+// bodies each compute work group culls; must match cull_compute.glsl
+#define CULL_GROUP_SIZE 64
+
+// the texture unit the culling shaders read the depth pyramid from
+#define CULL_PYRAMID_UNIT 1
+
+// captures the fallback keeps; with frame pacing on, the CPU is at most
+// PACING_MAX_FRAMES_IN_FLIGHT frames ahead, so one newer than the capture
+// drawn has finished by the time the ring comes round. With queueing left
+// to the driver it may not have, and that frame captures nothing instead
+#define CULL_FEEDBACK_FRAMES (PACING_MAX_FRAMES_IN_FLIGHT + 1)
+
+// the layouts glMultiDrawElementsIndirect and glDrawArraysIndirect read
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint  baseVertex;
+	GLuint baseInstance;
+};
+
+struct DrawArraysIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint first;
+	GLuint baseInstance;
+};
+
+// mirrors the std140 layout of the CullData block
+struct CullUniforms
+{
+	glm::vec4 planes[6];
+	glm::vec4 lodRadii[LOD_LEVELS];
+	GLfloat   pixelsPerUnit;
+	GLfloat   hysteresis;
+	GLint     bodyCount;
+	GLint     lodCount;
+	GLint     capacity;
+	GLint     commandStride;
+	GLint     padding[2];
+	glm::mat4 occlusionViewProjection;
+	glm::vec4 occlusionSize;
+};
+
+struct GPUCulling
+{
+	// compute shaders, or the transform feedback fallback
+	bool compute;
+
+	// spheres the vertex shader generates, drawn as arrays, not elements
+	bool procedural;
+
+	// bodies the buffers hold, and bodies this frame
+	GLsizei capacity;
+	GLsizei count;
+
+	LODChain chain;
+
+	// what the CPU writes: a model matrix and a layer per body
+	GLuint modelBuffer;
+	GLuint layerBuffer;
+
+	// the level each body was drawn at last frame, for hysteresis
+	GLuint lodBuffer;
+
+	// culled instances in InstanceData layout, run after run by level, each
+	// run capacity long; the fallback keeps a ring, capturing into output
+	GLuint outputBuffers[CULL_FEEDBACK_FRAMES];
+	int    output;
+
+	GLuint uniformBuffer;
+	GLuint commandBuffer;
+
+	// the fallback's point source, one query per level and output, and the
+	// output drawn from, or -1, with the counts its queries returned
+	GLuint sourceArray;
+	GLuint queries[CULL_FEEDBACK_FRAMES][LOD_LEVELS];
+	bool   queried[CULL_FEEDBACK_FRAMES];
+	int    drawn;
+	GLuint drawnCounts[LOD_LEVELS];
+
+	// the mesh with the culled instances attached
+	GLuint vertexArray;
+
+	ShaderProgram program;
+
+	// draws issued by the last DrawCulledBodies
+	int drawCalls;
+
+	// initialize object names to zero (OpenGL reserved value)
+	GPUCulling();
+};
+
+// true if the context can cull with compute shaders and draw indirectly
+bool ComputeCullingSupported();
+
+// buffers for capacity bodies drawn from chain's levels of the mesh in
+// vertexBuffer and indexBuffer; with a null layout the mesh is generated
+// in the vertex shader instead, from the levels' tessellation
+bool InitializeGPUCulling(GPUCulling *culling, const LODChain *chain, GLsizei capacity,
+	GLuint vertexBuffer, GLuint indexBuffer, const VertexLayout *layout);
+
+// sets the layers of bodies [first, first+count); these rarely change
+void SetCulledLayers(GPUCulling *culling, GLsizei first, const GLint *layers, GLsizei count);
+
+// sets the model matrices of bodies [first, first+count) for this frame;
+// the frame draws bodies [0, the highest body set)
+void SetCulledModels(GPUCulling *culling, GLsizei first, const glm::mat4 *models, GLsizei count);
+
+// culls this frame's bodies and builds its draws, against last frame's depth
+// too if a pyramid is given
+void CullBodies(GPUCulling *culling, RenderState *state, const Frustum *frustum, float pixelsPerUnit,
+	const DepthPyramid *pyramid = 0);
+
+// draws what CullBodies kept with program, which must read the instance
+// attributes of instances.h; textures must already be bound
+void DrawCulledBodies(GPUCulling *culling, RenderState *state, ShaderProgram *program, GLenum mode = GL_TRIANGLES);
+
+void DestroyGPUCulling(GPUCulling *culling);
+
+#endif
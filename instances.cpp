@@ -0,0 +1,223 @@
+// ==========================================================================
+// Per-instance attribute stream for instanced drawing
+// ==========================================================================
+
+#include "instances.h"
+#include "gldebug.h"
+
+#include <cstddef>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+// immutable storage only exists if the loader was generated with it
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define HAVE_BUFFER_STORAGE 1
+#endif
+
+Instances::Instances() : instanceBuffer(0), vertexArray(0), capacity(0), count(0), first(0),
+	persistent(false), mapped(0), region(0), writing(0)
+{
+	for (int i = 0; i < INSTANCE_REGIONS; i++)
+		fences[i] = 0;
+}
+
+void PointInstanceAttributes(GLuint buffer, size_t base)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (GLuint column = 0; column < 4; column++) {
+		glVertexAttribPointer(
+			INSTANCE_MODEL_INDEX + column,
+			4,
+			GL_FLOAT,
+			GL_FALSE,
+			sizeof(InstanceData),
+			(void*)(base + offsetof(InstanceData, model) + sizeof(vec4)*column));
+	}
+	glVertexAttribIPointer(
+		INSTANCE_LAYER_INDEX,
+		1,
+		GL_INT,
+		sizeof(InstanceData),
+		(void*)(base + offsetof(InstanceData, layer)));
+}
+
+// points the per-instance attributes of the bound vertex array at the
+// instance starting at first
+static void PointInstanceAttributes(Instances *instances, GLint first)
+{
+	instances->first = first;
+	PointInstanceAttributes(instances->instanceBuffer, sizeof(InstanceData) * first);
+}
+
+void EnableInstanceAttributes()
+{
+	for (GLuint column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(INSTANCE_MODEL_INDEX + column);
+		glVertexAttribDivisor(INSTANCE_MODEL_INDEX + column, 1);
+	}
+	glEnableVertexAttribArray(INSTANCE_LAYER_INDEX);
+	glVertexAttribDivisor(INSTANCE_LAYER_INDEX, 1);
+}
+
+// waits until the GPU has finished reading the given region
+static void WaitForRegion(Instances *instances, int region)
+{
+	GLsync fence = instances->fences[region];
+	if (!fence) return;
+
+	// flush on the first wait so the fence is guaranteed to signal
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	for (;;) {
+		GLenum result = glClientWaitSync(fence, flags, 1000000);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+			break;
+		flags = 0;
+	}
+	glDeleteSync(fence);
+	instances->fences[region] = 0;
+}
+
+// (re)creates the buffer storage for capacity instances per region
+static bool AllocateInstances(Instances *instances, GLsizei capacity)
+{
+	instances->capacity = capacity;
+
+	glBindBuffer(GL_ARRAY_BUFFER, instances->instanceBuffer);
+#ifdef HAVE_BUFFER_STORAGE
+	if (instances->persistent) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GLsizeiptr size = sizeof(InstanceData) * capacity * INSTANCE_REGIONS;
+		glBufferStorage(GL_ARRAY_BUFFER, size, 0, flags);
+		instances->mapped = (InstanceData*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+		if (!instances->mapped) {
+			cout << "ERROR: could not map instance buffer persistently" << endl;
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			return false;
+		}
+	}
+	else
+#endif
+	{
+		glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * capacity, 0, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
+bool InitializeInstances(Instances *instances, GLuint vertexArray, GLsizei capacity)
+{
+	instances->vertexArray = vertexArray;
+	instances->count = 0;
+	instances->region = 0;
+
+#ifdef HAVE_BUFFER_STORAGE
+	instances->persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+#endif
+
+	glGenBuffers(1, &instances->instanceBuffer);
+	if (!AllocateInstances(instances, capacity))
+		return false;
+
+	glBindVertexArray(instances->vertexArray);
+	EnableInstanceAttributes();
+	PointInstanceAttributes(instances, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	return !CheckGLErrors();
+}
+
+InstanceData *BeginInstances(Instances *instances, GLsizei count)
+{
+	instances->count = count;
+
+	if (count > instances->capacity) {
+		// immutable storage cannot grow, so replace the buffer outright once
+		// the GPU is done with every region of it
+		GLsizei capacity = std::max(count, 2*instances->capacity);
+		if (instances->persistent) {
+			for (int i = 0; i < INSTANCE_REGIONS; i++)
+				WaitForRegion(instances, i);
+
+			glBindBuffer(GL_ARRAY_BUFFER, instances->instanceBuffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glDeleteBuffers(1, &instances->instanceBuffer);
+			glGenBuffers(1, &instances->instanceBuffer);
+			instances->mapped = 0;
+		}
+		if (!AllocateInstances(instances, capacity))
+			return 0;
+
+		// the attribute pointers still refer to the old buffer
+		instances->first = -1;
+	}
+
+	if (instances->persistent) {
+		WaitForRegion(instances, instances->region);
+		instances->writing = instances->mapped + instances->region * instances->capacity;
+		return instances->writing;
+	}
+
+	// orphan last frame's storage so we never wait on draws still reading it
+	GLsizeiptr size = sizeof(InstanceData) * instances->capacity;
+	glBindBuffer(GL_ARRAY_BUFFER, instances->instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, size, 0, GL_STREAM_DRAW);
+	instances->writing = (InstanceData*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return instances->writing;
+}
+
+void EndInstances(Instances *instances)
+{
+	// coherent mappings need nothing more, the writes are already visible
+	if (!instances->persistent && instances->writing) {
+		glBindBuffer(GL_ARRAY_BUFFER, instances->instanceBuffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	instances->writing = 0;
+}
+
+void FenceInstances(Instances *instances)
+{
+	if (!instances->persistent) return;
+
+	instances->fences[instances->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	instances->region = (instances->region + 1) % INSTANCE_REGIONS;
+}
+
+// binds the vertex array with its instances starting at first; a base
+// instance for instanced draws needs OpenGL 4.2, so on a 4.1 context we move
+// the attribute offsets instead, and only when the range actually changes
+void BindInstanceRange(RenderState *state, Instances *instances, GLint first)
+{
+	GLint absolute = first;
+	if (instances->persistent)
+		absolute += instances->region * instances->capacity;
+
+	BindVertexArray(state, instances->vertexArray);
+	if (instances->first != absolute)
+		PointInstanceAttributes(instances, absolute);
+}
+
+void DestroyInstances(Instances *instances)
+{
+	for (int i = 0; i < INSTANCE_REGIONS; i++) {
+		if (instances->fences[i]) glDeleteSync(instances->fences[i]);
+		instances->fences[i] = 0;
+	}
+	if (instances->mapped) {
+		glBindBuffer(GL_ARRAY_BUFFER, instances->instanceBuffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		instances->mapped = 0;
+	}
+	glDeleteBuffers(1, &instances->instanceBuffer);
+	instances->instanceBuffer = 0;
+	instances->capacity = instances->count = 0;
+}
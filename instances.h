@@ -0,0 +1,99 @@
+// ==========================================================================
+// Per-instance attribute stream for instanced drawing
+//
+// Every frame the application writes the instances it draws straight into
+// buffer memory returned by BeginInstances. Where the context supports
+// immutable buffer storage (4.4 or GL_ARB_buffer_storage) the buffer is
+// mapped once, persistently and coherently, and split into
+// INSTANCE_REGIONS frame-sized regions; each frame writes the next region
+// while the GPU may still be reading the previous ones, and a fence per
+// region keeps us from overwriting one it has not finished with. On plain
+// 4.1 the buffer is orphaned and mapped each frame instead, which lets the
+// driver hand out fresh storage without making us wait either.
+//
+// A frame looks like
+//
+//	InstanceData *data = BeginInstances(&instances, count);
+//	... fill data[0] .. data[count-1] ...
+//	EndInstances(&instances);
+//	... RenderInstances calls ...
+//	FenceInstances(&instances);
+// ==========================================================================
+#ifndef INSTANCES_H
+#define INSTANCES_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "renderstate.h"
+
+#define INSTANCE_REGIONS 3
+
+// attribute locations of the per-instance data; the model matrix takes four
+// consecutive slots, one per column
+#define INSTANCE_MODEL_INDEX 4
+#define INSTANCE_LAYER_INDEX 8
+
+// what every instance of a shared mesh gets on its own: its model matrix and
+// the texture it samples, padded so instances stay 16-byte aligned
+struct InstanceData
+{
+	glm::mat4 model;
+	GLint     layer;
+	GLint     padding[3];
+};
+
+struct Instances
+{
+	// OpenGL name of the instance buffer and the vertex array reading it
+	GLuint  instanceBuffer;
+	GLuint  vertexArray;
+
+	// instances per region, and instances written this frame
+	GLsizei capacity;
+	GLsizei count;
+
+	// absolute instance the attribute pointers currently start at
+	GLint   first;
+
+	// persistent mapping of all regions, and the region written this frame
+	bool          persistent;
+	InstanceData *mapped;
+	int           region;
+	GLsync        fences[INSTANCE_REGIONS];
+
+	// memory handed out by BeginInstances for the current frame
+	InstanceData *writing;
+
+	// initialize object names to zero (OpenGL reserved value)
+	Instances();
+};
+
+// create an instance buffer for up to capacity instances per frame and
+// attach it to the vertex array, advancing once per instance
+bool InitializeInstances(Instances *instances, GLuint vertexArray, GLsizei capacity);
+
+// returns memory for this frame's count instances, growing the buffer if
+// needed; fill it in order, the instance at index i is drawn as instance i
+InstanceData *BeginInstances(Instances *instances, GLsizei count);
+
+// finishes the writes started by BeginInstances, before any draw uses them
+void EndInstances(Instances *instances);
+
+// call once this frame's draws are submitted, so the region is not reused
+// until the GPU is done reading it
+void FenceInstances(Instances *instances);
+
+// binds the vertex array with its instances starting at this frame's
+// instance first
+void BindInstanceRange(RenderState *state, Instances *instances, GLint first);
+
+void DestroyInstances(Instances *instances);
+
+// for instance data written somewhere else, such as by the GPU itself:
+// enables the per-instance attributes of the bound vertex array, and points
+// them at the InstanceData records in buffer starting base bytes in
+void EnableInstanceAttributes();
+void PointInstanceAttributes(GLuint buffer, size_t base);
+
+#endif
@@ -0,0 +1,172 @@
+// ==========================================================================
+// Work-stealing job system
+// ==========================================================================
+
+#include "jobs.h"
+
+#include <algorithm>
+
+using namespace std;
+
+typedef pair<Job, JobCounter*> QueuedJob;
+
+// the owner takes from the back of its own queue, which keeps the chunks it
+// just split off warm in its cache
+static bool PopJob(JobQueue *queue, QueuedJob *job)
+{
+	lock_guard<mutex> lock(queue->mutex);
+	if (queue->jobs.empty()) return false;
+	*job = queue->jobs.back();
+	queue->jobs.pop_back();
+	return true;
+}
+
+// thieves take from the front, the work the owner is furthest from reaching
+static bool StealJob(JobQueue *queue, QueuedJob *job)
+{
+	unique_lock<mutex> lock(queue->mutex, try_to_lock);
+	if (!lock.owns_lock() || queue->jobs.empty()) return false;
+	*job = queue->jobs.front();
+	queue->jobs.pop_front();
+	return true;
+}
+
+// finds a job, starting with queue home and stealing from the rest in turn;
+// returns false if every queue is empty
+static bool FindJob(JobSystem *jobs, size_t home, QueuedJob *job)
+{
+	if (PopJob(jobs->queues[home], job)) return true;
+
+	size_t count = jobs->queues.size();
+	for (size_t i = 1; i < count; i++) {
+		if (StealJob(jobs->queues[(home + i) % count], job)) return true;
+	}
+
+	// a failed try_lock is not an empty queue, so take a last, patient look
+	for (size_t i = 1; i < count; i++) {
+		if (PopJob(jobs->queues[(home + i) % count], job)) return true;
+	}
+	return false;
+}
+
+// takes the oldest job of counter's from queue, if it holds any; someone
+// waiting on counter takes nothing else, so it never picks up a long job it
+// is not waiting for
+static bool TakeCounterJob(JobQueue *queue, JobCounter *counter, QueuedJob *job)
+{
+	lock_guard<mutex> lock(queue->mutex);
+	for (deque<QueuedJob>::iterator it = queue->jobs.begin(); it != queue->jobs.end(); ++it) {
+		if (it->second != counter) continue;
+		*job = *it;
+		queue->jobs.erase(it);
+		return true;
+	}
+	return false;
+}
+
+static void RunJob(JobSystem *jobs, QueuedJob &job)
+{
+	jobs->queued--;
+	job.first();
+	job.second->remaining--;
+}
+
+static void WorkerLoop(JobSystem *jobs, size_t home)
+{
+	for (;;) {
+		QueuedJob job;
+		if (FindJob(jobs, home, &job)) {
+			RunJob(jobs, job);
+			continue;
+		}
+
+		unique_lock<mutex> lock(jobs->sleepMutex);
+		jobs->wake.wait(lock, [jobs]() { return jobs->quit || jobs->queued > 0; });
+		if (jobs->quit && jobs->queued == 0) return;
+	}
+}
+
+void InitializeJobSystem(JobSystem *jobs, unsigned threads)
+{
+	if (threads == 0) {
+		unsigned cores = thread::hardware_concurrency();
+		threads = cores > 1 ? cores - 1 : 1;
+	}
+
+	for (unsigned i = 0; i <= threads; i++)
+		jobs->queues.push_back(new JobQueue);
+
+	// the last queue belongs to whoever submits from outside the pool
+	for (unsigned i = 0; i < threads; i++)
+		jobs->workers.push_back(thread(WorkerLoop, jobs, size_t(i)));
+}
+
+unsigned JobThreadCount(const JobSystem *jobs)
+{
+	return unsigned(jobs->workers.size()) + 1;
+}
+
+void SubmitJob(JobSystem *jobs, JobCounter *counter, const Job &job)
+{
+	counter->remaining++;
+	jobs->queued++;
+
+	// spread outside submissions across the workers' queues, so they start
+	// on their own work before they need to steal anything
+	size_t queue = jobs->nextQueue++ % jobs->queues.size();
+	{
+		lock_guard<mutex> lock(jobs->queues[queue]->mutex);
+		jobs->queues[queue]->jobs.push_back(QueuedJob(job, counter));
+	}
+
+	// taking the lock orders this against a worker deciding to go to sleep
+	{
+		lock_guard<mutex> lock(jobs->sleepMutex);
+	}
+	jobs->wake.notify_one();
+}
+
+void ParallelFor(JobSystem *jobs, JobCounter *counter, size_t begin, size_t end, size_t grain,
+	const function<void(size_t, size_t)> &body, size_t align)
+{
+	grain = std::max<size_t>(grain, 1);
+	grain = (grain + align - 1) / align * align;
+
+	for (size_t first = begin; first < end; first += grain) {
+		size_t last = std::min(end, first + grain);
+		SubmitJob(jobs, counter, [body, first, last]() { body(first, last); });
+	}
+}
+
+void WaitForJobs(JobSystem *jobs, JobCounter *counter)
+{
+	size_t count = jobs->queues.size();
+	while (counter->remaining > 0) {
+		// the outside queue first, then the workers'
+		QueuedJob job;
+		bool found = false;
+		for (size_t i = 0; i < count && !found; i++)
+			found = TakeCounterJob(jobs->queues[(count - 1 + i) % count], counter, &job);
+		if (found)
+			RunJob(jobs, job);
+		else
+			this_thread::yield();
+	}
+}
+
+void DestroyJobSystem(JobSystem *jobs)
+{
+	{
+		lock_guard<mutex> lock(jobs->sleepMutex);
+		jobs->quit = true;
+	}
+	jobs->wake.notify_all();
+
+	for (size_t i = 0; i < jobs->workers.size(); i++)
+		jobs->workers[i].join();
+	jobs->workers.clear();
+
+	for (size_t i = 0; i < jobs->queues.size(); i++)
+		delete jobs->queues[i];
+	jobs->queues.clear();
+}
@@ -0,0 +1,82 @@
+// ==========================================================================
+// Work-stealing job system
+//
+// A fixed pool of worker threads, each with its own queue of jobs. Workers
+// take their newest job first and, when they run dry, steal the oldest job
+// from someone else's queue, so a ParallelFor split into many chunks keeps
+// every core busy without a single shared queue everyone contends on.
+//
+// Jobs belong to a JobCounter; WaitForJobs blocks until every job submitted
+// against a counter has run, and the waiting thread runs that counter's
+// queued jobs itself while it waits rather than sleeping. It never runs
+// anyone else's, so the render thread waiting on its own short jobs is not
+// held up by a texture decode or a disk read sharing the pool.
+// ==========================================================================
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> Job;
+
+struct JobCounter
+{
+	std::atomic<int> remaining;
+
+	JobCounter() : remaining(0)
+	{}
+};
+
+struct JobQueue
+{
+	std::mutex mutex;
+	std::deque<std::pair<Job, JobCounter*> > jobs;
+};
+
+struct JobSystem
+{
+	std::vector<std::thread> workers;
+
+	// one queue per worker, plus one more for jobs submitted from outside
+	std::vector<JobQueue*> queues;
+
+	// workers sleep on this when there is nothing anywhere to steal
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<int> queued;
+	std::atomic<bool> quit;
+
+	// where the next job submitted from outside the pool goes
+	std::atomic<unsigned> nextQueue;
+
+	JobSystem() : queued(0), quit(false), nextQueue(0)
+	{}
+};
+
+// starts the pool; 0 threads means one per core, minus the calling thread
+void InitializeJobSystem(JobSystem *jobs, unsigned threads = 0);
+
+// number of threads that run jobs, counting the one calling WaitForJobs
+unsigned JobThreadCount(const JobSystem *jobs);
+
+void SubmitJob(JobSystem *jobs, JobCounter *counter, const Job &job);
+
+// splits [begin, end) into chunks of about grain items, rounded to a multiple
+// of align, and submits body(chunkBegin, chunkEnd) once per chunk
+void ParallelFor(JobSystem *jobs, JobCounter *counter, size_t begin, size_t end, size_t grain,
+	const std::function<void(size_t, size_t)> &body, size_t align = 1);
+
+// blocks until every job submitted against counter has finished, helping out
+// with counter's queued jobs in the meantime
+void WaitForJobs(JobSystem *jobs, JobCounter *counter);
+
+// waits for the workers to drain their queues, then stops them
+void DestroyJobSystem(JobSystem *jobs);
+
+#endif
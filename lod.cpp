@@ -0,0 +1,73 @@
+// ==========================================================================
+// Level-of-detail selection
+// ==========================================================================
+
+#include "lod.h"
+
+#include <cfloat>
+#include <cmath>
+
+using namespace glm;
+
+void AddLOD(LODChain *chain, GLsizei firstIndex, GLsizei indexCount, GLint baseVertex, float maxRadius,
+	GLint columns, GLint rings)
+{
+	if (chain->count >= LOD_LEVELS) return;
+
+	MeshLOD &level = chain->levels[chain->count++];
+	level.firstIndex = firstIndex;
+	level.indexCount = indexCount;
+	level.baseVertex = baseVertex;
+	level.maxRadius = maxRadius;
+	level.columns = columns;
+	level.rings = rings;
+}
+
+float ScreenRadius(const vec4 &sphere, const vec3 &camera, float pixelsPerUnit)
+{
+	vec3 offset = vec3(sphere) - camera;
+	float distanceSquared = dot(offset, offset);
+	float radiusSquared = sphere.w * sphere.w;
+
+	// from inside the sphere it fills the screen
+	if (distanceSquared <= radiusSquared) return FLT_MAX;
+
+	// the tangent of the angle the sphere subtends, in pixels
+	return pixelsPerUnit * sphere.w / sqrtf(distanceSquared - radiusSquared);
+}
+
+int SelectLOD(const LODChain *chain, float screenRadius, int current)
+{
+	// impostors have a limit of their own, with the same margin either way
+	float margin = chain->hysteresis;
+	if (chain->impostorRadius > 0.f) {
+		float limit = chain->impostorRadius;
+		if (current == LOD_IMPOSTOR)
+			limit *= 1.f + margin;
+		else if (current >= 0)
+			limit *= 1.f - margin;
+		if (screenRadius < limit)
+			return LOD_IMPOSTOR;
+		if (current == LOD_IMPOSTOR)
+			current = -1;
+	}
+
+	// the coarsest level that still covers the radius; the finest takes
+	// everything larger
+	int target = chain->count - 1;
+	for (int i = 0; i < chain->count - 1; i++) {
+		if (screenRadius <= chain->levels[i].maxRadius) {
+			target = i;
+			break;
+		}
+	}
+	if (current < 0 || current >= chain->count || target == current) return target;
+
+	// finer only once clearly beyond the current level's limit, coarser only
+	// once clearly within the target's
+	if (target > current && screenRadius < chain->levels[current].maxRadius * (1.f + margin))
+		return current;
+	if (target < current && screenRadius > chain->levels[target].maxRadius * (1.f - margin))
+		return current;
+	return target;
+}
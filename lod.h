@@ -0,0 +1,69 @@
+// ==========================================================================
+// Level-of-detail selection
+//
+// A LODChain describes several versions of one mesh, coarsest first, packed
+// into the same vertex and index buffers. Each body picks a level every
+// frame from how large it appears on screen, and only moves to another once
+// it is clearly past that level's limit, so bodies hovering on a boundary
+// do not flicker between two. Below the chain's impostor radius a body
+// leaves the mesh altogether for LOD_IMPOSTOR, a ray-cast quad.
+// ==========================================================================
+#ifndef LOD_H
+#define LOD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#define LOD_LEVELS 5
+
+// the level SelectLOD picks for bodies drawn as impostors, after every mesh
+#define LOD_IMPOSTOR LOD_LEVELS
+
+// one level: where its indices start in the shared index buffer, how many
+// there are, what they are relative to in the shared vertex buffer, and the
+// largest on-screen radius in pixels it is meant for. Spheres generated in
+// the vertex shader have no buffers; they draw indexCount vertices of a
+// sphere of the given columns and rings instead.
+struct MeshLOD
+{
+	GLsizei firstIndex;
+	GLsizei indexCount;
+	GLint   baseVertex;
+	float   maxRadius;
+	GLint   columns;
+	GLint   rings;
+};
+
+struct LODChain
+{
+	MeshLOD levels[LOD_LEVELS];
+	int     count;
+
+	// how far, as a fraction of the limit, a body has to be past a level's
+	// limit before it switches
+	float   hysteresis;
+
+	// the on-screen radius in pixels below which bodies are impostors, or 0
+	// to always draw a mesh
+	float   impostorRadius;
+
+	LODChain() : count(0), hysteresis(0.15f), impostorRadius(0.f)
+	{}
+};
+
+// appends a level; levels must be added coarsest first
+void AddLOD(LODChain *chain, GLsizei firstIndex, GLsizei indexCount, GLint baseVertex, float maxRadius,
+	GLint columns = 0, GLint rings = 0);
+
+// on-screen radius in pixels of a bounding sphere (xyz centre, w radius),
+// where pixelsPerUnit is projection[1][1] times half the viewport height;
+// it uses the distance rather than the depth, so turning the camera never
+// changes a body's level
+float ScreenRadius(const glm::vec4 &sphere, const glm::vec3 &camera, float pixelsPerUnit);
+
+// the level for a body of the given on-screen radius that is currently
+// drawn at level current, or -1 if it has none yet; LOD_IMPOSTOR if it is
+// small enough to be an impostor
+int SelectLOD(const LODChain *chain, float screenRadius, int current);
+
+#endif
@@ -0,0 +1,198 @@
+// ==========================================================================
+// Occlusion culling
+// ==========================================================================
+
+#include "occlusion.h"
+#include "gldebug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+DepthPyramid::DepthPyramid() : depthTexture(0), texture(0), framebuffer(0), width(0), height(0), levels(0),
+	viewProjection(1.f), built(false), vertexArray(0)
+{}
+
+OcclusionQueries::OcclusionQueries() : target(GL_ANY_SAMPLES_PASSED), vertexArray(0)
+{
+	for (int i = 0; i < OCCLUSION_QUERIES; i++)
+		queries[i] = 0;
+}
+
+// (re)allocates the depth copy and every level of the pyramid
+static void SizeDepthPyramid(DepthPyramid *pyramid, int width, int height)
+{
+	pyramid->width = width;
+	pyramid->height = height;
+	pyramid->levels = 1 + int(floor(log2(float(std::max(width, height)))));
+	pyramid->built = false;
+
+	glBindTexture(GL_TEXTURE_2D, pyramid->depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	// every level, each rendered into in turn
+	glBindTexture(GL_TEXTURE_2D, pyramid->texture);
+	for (int level = 0; level < pyramid->levels; level++) {
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(1, width >> level), std::max(1, height >> level),
+			0, GL_RED, GL_FLOAT, 0);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, pyramid->levels - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool InitializeDepthPyramid(DepthPyramid *pyramid, int width, int height)
+{
+	pyramid->built = false;
+
+	// the reduction is one full-screen rectangle per level, and takes
+	// the farthest of the texels each output covers
+	pyramid->program = InitializeShaders("shaders/overlay_vertex.glsl", "shaders/hiz_fragment.glsl");
+	if (!pyramid->program.id) {
+		cout << "ERROR: could not build the depth pyramid program" << endl;
+		return false;
+	}
+	SetUniform(&pyramid->program, UNIFORM_RECT, vec4(-1.f, -1.f, 2.f, 2.f));
+	SetUniform(&pyramid->program, UNIFORM_SAMPLER, 0);
+	glGenVertexArrays(1, &pyramid->vertexArray);
+
+	glGenTextures(1, &pyramid->depthTexture);
+	glGenTextures(1, &pyramid->texture);
+	SizeDepthPyramid(pyramid, width, height);
+
+	glGenFramebuffers(1, &pyramid->framebuffer);
+
+	return !CheckGLErrors();
+}
+
+void BuildDepthPyramid(DepthPyramid *pyramid, RenderState *state, const mat4 &viewProjection)
+{
+	GLint drawFramebuffer = 0, viewport[4];
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	// the depth buffer cannot be sampled where it is, so copy it out
+	BindTexture(state, 0, GL_TEXTURE_2D, pyramid->depthTexture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, pyramid->width, pyramid->height);
+
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	UseProgram(state, pyramid->program.id);
+	BindVertexArray(state, pyramid->vertexArray);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, pyramid->framebuffer);
+
+	// level 0 from the copy, then each level from the one below it, which
+	// is made the only level visible to sampling so that reading it while
+	// rendering the next is not a feedback loop
+	for (int level = 0; level < pyramid->levels; level++) {
+		if (level > 0) {
+			BindTexture(state, 0, GL_TEXTURE_2D, pyramid->texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+		}
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid->texture, level);
+		glViewport(0, 0, std::max(1, pyramid->width >> level), std::max(1, pyramid->height >> level));
+		SetUniform(&pyramid->program, UNIFORM_LEVEL, level);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+	BindTexture(state, 0, GL_TEXTURE_2D, pyramid->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, pyramid->levels - 1);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+
+	pyramid->viewProjection = viewProjection;
+	pyramid->built = true;
+
+	CHECK_DRAW_ERRORS();
+}
+
+void ResizeDepthPyramid(DepthPyramid *pyramid, int width, int height)
+{
+	if (!pyramid->texture || (width == pyramid->width && height == pyramid->height)) return;
+	SizeDepthPyramid(pyramid, width, height);
+	CheckGLErrors();
+}
+
+void DestroyDepthPyramid(DepthPyramid *pyramid)
+{
+	glDeleteFramebuffers(1, &pyramid->framebuffer);
+	glDeleteTextures(1, &pyramid->texture);
+	glDeleteTextures(1, &pyramid->depthTexture);
+	glDeleteVertexArrays(1, &pyramid->vertexArray);
+	DestroyProgram(&pyramid->program);
+	pyramid->framebuffer = pyramid->texture = pyramid->depthTexture = pyramid->vertexArray = 0;
+	pyramid->built = false;
+}
+
+bool InitializeOcclusionQueries(OcclusionQueries *queries)
+{
+#ifdef GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+	if (GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_ES3_compatibility)
+		queries->target = GL_ANY_SAMPLES_PASSED_CONSERVATIVE;
+#endif
+
+	// the box is drawn into the depth test only, so needs no real colour
+	queries->program = InitializeShaders("shaders/proxy_vertex.glsl", "shaders/overlay_fragment.glsl");
+	if (!queries->program.id) {
+		cout << "ERROR: could not build the occlusion proxy program" << endl;
+		return false;
+	}
+	glGenVertexArrays(1, &queries->vertexArray);
+	glGenQueries(OCCLUSION_QUERIES, queries->queries);
+
+	return !CheckGLErrors();
+}
+
+bool BeginOcclusionTest(OcclusionQueries *queries, RenderState *state, int query,
+	const vec4 &sphere, const vec3 &camera)
+{
+	// from inside the box its faces are behind the camera
+	vec3 offset = abs(camera - vec3(sphere));
+	if (query < 0 || query >= OCCLUSION_QUERIES ||
+		(offset.x <= sphere.w && offset.y <= sphere.w && offset.z <= sphere.w))
+		return false;
+
+	UseProgram(state, queries->program.id);
+	BindVertexArray(state, queries->vertexArray);
+	SetUniform(&queries->program, UNIFORM_SPHERE, sphere);
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glBeginQuery(queries->target, queries->queries[query]);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 14);
+	glEndQuery(queries->target);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	// the GPU waits for the answer; the CPU carries on
+	glBeginConditionalRender(queries->queries[query], GL_QUERY_WAIT);
+	return true;
+}
+
+void EndOcclusionTest()
+{
+	glEndConditionalRender();
+}
+
+void DestroyOcclusionQueries(OcclusionQueries *queries)
+{
+	glDeleteQueries(OCCLUSION_QUERIES, queries->queries);
+	for (int i = 0; i < OCCLUSION_QUERIES; i++)
+		queries->queries[i] = 0;
+	glDeleteVertexArrays(1, &queries->vertexArray);
+	queries->vertexArray = 0;
+	DestroyProgram(&queries->program);
+}
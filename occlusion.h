@@ -0,0 +1,105 @@
+// ==========================================================================
+// Occlusion culling
+//
+// Two ways of not drawing what is hidden behind something nearer, the sun
+// above all. The depth pyramid (Hi-Z) is built from the frame just drawn:
+// level 0 is a copy of its depth buffer, and each texel of the levels above
+// holds the farthest depth of the texels it covers below. Next frame a
+// bounding sphere projected with the same camera is hidden if its nearest
+// point is farther than the pyramid anywhere the sphere covers, which four
+// texel fetches at the right level answer. The test runs on the GPU, in the
+// culling shaders of gpuculling.h, and is only as stale as one frame of
+// motion:
+//
+//	... draw the frame ...
+//	BuildDepthPyramid(&pyramid, &renderState, viewProjection);
+//	... next frame ...
+//	CullBodies(&culling, &renderState, &frustum, pixelsPerUnit, &pyramid);
+//
+// Where bodies are culled on the CPU, occlusion queries test them instead:
+// a box about the body is drawn into a query with writes off, and the body
+// itself inside conditional rendering, so the GPU skips it if no sample of
+// the box passed the depth test and the CPU never waits on the answer.
+// Queries are conservative where GL_ANY_SAMPLES_PASSED_CONSERVATIVE exists
+// (4.3 or GL_ARB_ES3_compatibility).
+//
+//	if (BeginOcclusionTest(&queries, &renderState, i, sphere, cameraPosition)) {
+//		... draw the body ...
+//		EndOcclusionTest();
+//	}
+// ==========================================================================
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "program.h"
+#include "renderstate.h"
+
+struct DepthPyramid
+{
+	// the frame's depth buffer, copied out, and the reduced pyramid
+	GLuint depthTexture;
+	GLuint texture;
+	GLuint framebuffer;
+
+	int width;
+	int height;
+	int levels;
+
+	// the camera the depths were seen through, and whether there are any yet
+	glm::mat4 viewProjection;
+	bool      built;
+
+	// reduction, drawn with no vertex data
+	ShaderProgram program;
+	GLuint        vertexArray;
+
+	// initialize object names to zero (OpenGL reserved value)
+	DepthPyramid();
+};
+
+// a pyramid for a width by height framebuffer
+bool InitializeDepthPyramid(DepthPyramid *pyramid, int width, int height);
+
+// rebuilds the pyramid from the bound read framebuffer's depth, as seen
+// through viewProjection; the draw framebuffer and viewport are restored
+void BuildDepthPyramid(DepthPyramid *pyramid, RenderState *state, const glm::mat4 &viewProjection);
+
+// reallocates the pyramid for a framebuffer now width by height, binding
+// outside the render state cache; the next frame is culled without it, as
+// the first was
+void ResizeDepthPyramid(DepthPyramid *pyramid, int width, int height);
+
+void DestroyDepthPyramid(DepthPyramid *pyramid);
+
+// bodies that can be tested in one frame
+#define OCCLUSION_QUERIES 8
+
+struct OcclusionQueries
+{
+	// GL_ANY_SAMPLES_PASSED_CONSERVATIVE, or GL_ANY_SAMPLES_PASSED
+	GLenum target;
+	GLuint queries[OCCLUSION_QUERIES];
+
+	// the proxy box, drawn with no vertex data
+	ShaderProgram program;
+	GLuint        vertexArray;
+
+	// initialize object names to zero (OpenGL reserved value)
+	OcclusionQueries();
+};
+
+bool InitializeOcclusionQueries(OcclusionQueries *queries);
+
+// draws the box about sphere into query and starts rendering conditionally
+// on it; returns false, with nothing to end, when camera is inside the box
+// and the body has to be drawn regardless
+bool BeginOcclusionTest(OcclusionQueries *queries, RenderState *state, int query,
+	const glm::vec4 &sphere, const glm::vec3 &camera);
+void EndOcclusionTest();
+
+void DestroyOcclusionQueries(OcclusionQueries *queries);
+
+#endif
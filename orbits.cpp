@@ -0,0 +1,291 @@
+// ==========================================================================
+// Batched orbital motion for large numbers of bodies
+// ==========================================================================
+
+#include "orbits.h"
+
+#include <cmath>
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+using namespace glm;
+
+#if !defined(ORBITS_SCALAR)
+#if defined(__AVX__)
+#include <immintrin.h>
+#define ORBITS_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ORBITS_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ORBITS_NEON 1
+#endif
+#endif
+
+static const float DEGREES_TO_RADIANS = 0.017453292519943295f;
+
+size_t AddOrbit(OrbitBatch *batch, float distance, float orbitSpeed, float spinSpeed,
+	float tilt, float size, float orbitAngle, float spinAngle)
+{
+	batch->orbitAngle.push_back(orbitAngle);
+	batch->orbitSpeed.push_back(orbitSpeed);
+	batch->distance.push_back(distance);
+	batch->spinAngle.push_back(spinAngle);
+	batch->spinSpeed.push_back(spinSpeed);
+	batch->tilt.push_back(tilt);
+	batch->size.push_back(size);
+	return batch->orbitAngle.size() - 1;
+}
+
+size_t OrbitCount(const OrbitBatch *batch)
+{
+	return batch->orbitAngle.size();
+}
+
+// keeps angles in [0, 360) so they do not lose precision as they accumulate
+static inline float WrapDegrees(float angle)
+{
+	return angle - 360.f*floor(angle/360.f);
+}
+
+static inline mat4 *OutputAt(mat4 *out, size_t stride, size_t index)
+{
+	return (mat4*)((char*)out + stride*index);
+}
+
+void UpdateOrbitsScalar(OrbitBatch *batch, float steps, mat4 *out, size_t stride,
+	size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		float orbit = WrapDegrees(batch->orbitAngle[i] + batch->orbitSpeed[i]*steps);
+		float spin = WrapDegrees(batch->spinAngle[i] + batch->spinSpeed[i]*steps);
+		batch->orbitAngle[i] = orbit;
+		batch->spinAngle[i] = spin;
+
+		float co = cos(orbit*DEGREES_TO_RADIANS), so = sin(orbit*DEGREES_TO_RADIANS);
+		float cs = cos(spin*DEGREES_TO_RADIANS), ss = sin(spin*DEGREES_TO_RADIANS);
+		float ct = cos(batch->tilt[i]*DEGREES_TO_RADIANS), st = sin(batch->tilt[i]*DEGREES_TO_RADIANS);
+		float s = batch->size[i], d = batch->distance[i];
+
+		// scale * rotateZ(tilt) * rotateY(spin), written out column by column
+		mat4 &m = *OutputAt(out, stride, i - begin);
+		m[0] = vec4(s*ct*cs, s*st*cs, -s*ss, 0.f);
+		m[1] = vec4(-s*st, s*ct, 0.f, 0.f);
+		m[2] = vec4(s*ct*ss, s*st*ss, s*cs, 0.f);
+		m[3] = vec4(batch->centre + vec3(d*co, 0.f, -d*so), 1.f);
+	}
+}
+
+// --------------------------------------------------------------------------
+// Vector path; the kernel is written once against a handful of wrappers
+// around whichever instruction set is available
+
+#if defined(ORBITS_AVX) || defined(ORBITS_SSE) || defined(ORBITS_NEON)
+
+#if defined(ORBITS_AVX)
+typedef __m256 vfloat;
+#define VWIDTH 8
+static inline vfloat vset(float f) { return _mm256_set1_ps(f); }
+static inline vfloat vload(const float *p) { return _mm256_loadu_ps(p); }
+static inline void vstore(float *p, vfloat v) { _mm256_storeu_ps(p, v); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+static inline vfloat vfloor(vfloat a) { return _mm256_floor_ps(a); }
+static inline vfloat vround(vfloat a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+// picks b where a > limit, a elsewhere
+static inline vfloat vselectgt(vfloat a, vfloat limit, vfloat b) { return _mm256_blendv_ps(a, b, _mm256_cmp_ps(a, limit, _CMP_GT_OQ)); }
+static inline vfloat vselectlt(vfloat a, vfloat limit, vfloat b) { return _mm256_blendv_ps(a, b, _mm256_cmp_ps(a, limit, _CMP_LT_OQ)); }
+static const char *kernelName = "AVX";
+
+#elif defined(ORBITS_SSE)
+typedef __m128 vfloat;
+#define VWIDTH 4
+static inline vfloat vset(float f) { return _mm_set1_ps(f); }
+static inline vfloat vload(const float *p) { return _mm_loadu_ps(p); }
+static inline void vstore(float *p, vfloat v) { _mm_storeu_ps(p, v); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vfloat vround(vfloat a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+// SSE2 has no floor; round to nearest, then step down where that went up
+static inline vfloat vfloor(vfloat a)
+{
+	vfloat r = vround(a);
+	return _mm_sub_ps(r, _mm_and_ps(_mm_cmpgt_ps(r, a), _mm_set1_ps(1.f)));
+}
+static inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a)); }
+static inline vfloat vselectgt(vfloat a, vfloat limit, vfloat b) { return vselect(_mm_cmpgt_ps(a, limit), a, b); }
+static inline vfloat vselectlt(vfloat a, vfloat limit, vfloat b) { return vselect(_mm_cmplt_ps(a, limit), a, b); }
+static const char *kernelName = "SSE2";
+
+#elif defined(ORBITS_NEON)
+typedef float32x4_t vfloat;
+#define VWIDTH 4
+static inline vfloat vset(float f) { return vdupq_n_f32(f); }
+static inline vfloat vload(const float *p) { return vld1q_f32(p); }
+static inline void vstore(float *p, vfloat v) { vst1q_f32(p, v); }
+static inline vfloat vadd(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return vsubq_f32(a, b); }
+static inline vfloat vmul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+// truncate, then step down for negative non-integers
+static inline vfloat vfloor(vfloat a)
+{
+	vfloat t = vcvtq_f32_s32(vcvtq_s32_f32(a));
+	uint32x4_t above = vcgtq_f32(t, a);
+	return vsubq_f32(t, vreinterpretq_f32_u32(vandq_u32(above, vreinterpretq_u32_f32(vdupq_n_f32(1.f)))));
+}
+static inline vfloat vround(vfloat a) { return vfloor(vaddq_f32(a, vdupq_n_f32(0.5f))); }
+static inline vfloat vselectgt(vfloat a, vfloat limit, vfloat b) { return vbslq_f32(vcgtq_f32(a, limit), b, a); }
+static inline vfloat vselectlt(vfloat a, vfloat limit, vfloat b) { return vbslq_f32(vcltq_f32(a, limit), b, a); }
+static const char *kernelName = "NEON";
+#endif
+
+// sine and cosine of x radians, for any x of moderate size; both come from
+// one odd polynomial on [-pi/2, pi/2], accurate to about 1e-7
+static inline void vsincos(vfloat x, vfloat *s, vfloat *c)
+{
+	const vfloat pi = vset(3.14159265358979f);
+	const vfloat halfPi = vset(1.57079632679490f);
+	const vfloat twoPi = vset(6.28318530717959f);
+
+	// bring x into [-pi, pi]
+	x = vsub(x, vmul(twoPi, vround(vmul(x, vset(0.159154943091895f)))));
+
+	// cos(x) = sin(x + pi/2), brought back into [-pi, pi] as well
+	vfloat y = vadd(x, halfPi);
+	y = vselectgt(y, pi, vsub(y, twoPi));
+
+	// sin(pi - x) = sin(x) folds [-pi, pi] onto [-pi/2, pi/2]
+	x = vselectgt(x, halfPi, vsub(pi, x));
+	x = vselectlt(x, vset(-1.57079632679490f), vsub(vset(-3.14159265358979f), x));
+	y = vselectgt(y, halfPi, vsub(pi, y));
+	y = vselectlt(y, vset(-1.57079632679490f), vsub(vset(-3.14159265358979f), y));
+
+	vfloat *out[2] = { s, c };
+	vfloat in[2] = { x, y };
+	for (int k = 0; k < 2; k++) {
+		vfloat v = in[k], v2 = vmul(v, v);
+		vfloat p = vset(-2.5052108385e-8f);
+		p = vadd(vmul(p, v2), vset(2.7557319224e-6f));
+		p = vadd(vmul(p, v2), vset(-1.9841269841e-4f));
+		p = vadd(vmul(p, v2), vset(8.3333333333e-3f));
+		p = vadd(vmul(p, v2), vset(-1.6666666667e-1f));
+		*out[k] = vadd(v, vmul(vmul(v, v2), p));
+	}
+}
+
+static inline vfloat vwrap(vfloat degrees)
+{
+	return vsub(degrees, vmul(vset(360.f), vfloor(vmul(degrees, vset(1.f/360.f)))));
+}
+
+// advances and builds VWIDTH bodies starting at body i
+static inline void OrbitLanes(OrbitBatch *batch, vfloat steps, mat4 *out, size_t stride, size_t i, size_t index)
+{
+	const vfloat toRadians = vset(DEGREES_TO_RADIANS);
+
+	vfloat orbit = vwrap(vadd(vload(&batch->orbitAngle[i]), vmul(vload(&batch->orbitSpeed[i]), steps)));
+	vfloat spin = vwrap(vadd(vload(&batch->spinAngle[i]), vmul(vload(&batch->spinSpeed[i]), steps)));
+	vstore(&batch->orbitAngle[i], orbit);
+	vstore(&batch->spinAngle[i], spin);
+
+	vfloat so, co, ss, cs, st, ct;
+	vsincos(vmul(orbit, toRadians), &so, &co);
+	vsincos(vmul(spin, toRadians), &ss, &cs);
+	vsincos(vmul(vload(&batch->tilt[i]), toRadians), &st, &ct);
+
+	vfloat s = vload(&batch->size[i]);
+	vfloat d = vload(&batch->distance[i]);
+	vfloat sct = vmul(s, ct), sst = vmul(s, st);
+
+	// the eleven entries that are not constant of each matrix, lane by lane
+	float columns[11][VWIDTH];
+	vstore(columns[0], vmul(sct, cs));
+	vstore(columns[1], vmul(sst, cs));
+	vstore(columns[2], vsub(vset(0.f), vmul(s, ss)));
+	vstore(columns[3], vsub(vset(0.f), sst));
+	vstore(columns[4], sct);
+	vstore(columns[5], vmul(sct, ss));
+	vstore(columns[6], vmul(sst, ss));
+	vstore(columns[7], vmul(s, cs));
+	vstore(columns[8], vadd(vset(batch->centre.x), vmul(d, co)));
+	vstore(columns[9], vset(batch->centre.y));
+	vstore(columns[10], vsub(vset(batch->centre.z), vmul(d, so)));
+
+	for (int lane = 0; lane < VWIDTH; lane++) {
+		mat4 &m = *OutputAt(out, stride, index + lane);
+		m[0] = vec4(columns[0][lane], columns[1][lane], columns[2][lane], 0.f);
+		m[1] = vec4(columns[3][lane], columns[4][lane], 0.f, 0.f);
+		m[2] = vec4(columns[5][lane], columns[6][lane], columns[7][lane], 0.f);
+		m[3] = vec4(columns[8][lane], columns[9][lane], columns[10][lane], 1.f);
+	}
+}
+
+void UpdateOrbits(OrbitBatch *batch, float steps, mat4 *out, size_t stride, size_t begin, size_t end)
+{
+	vfloat vsteps = vset(steps);
+
+	size_t i = begin;
+	for (; i + VWIDTH <= end; i += VWIDTH)
+		OrbitLanes(batch, vsteps, out, stride, i, i - begin);
+
+	// whatever does not fill a whole vector
+	UpdateOrbitsScalar(batch, steps, OutputAt(out, stride, i - begin), stride, i, end);
+}
+
+const char *OrbitKernelName()
+{
+	return kernelName;
+}
+
+#else
+
+void UpdateOrbits(OrbitBatch *batch, float steps, mat4 *out, size_t stride, size_t begin, size_t end)
+{
+	UpdateOrbitsScalar(batch, steps, out, stride, begin, end);
+}
+
+const char *OrbitKernelName()
+{
+	return "scalar";
+}
+
+#endif
+
+// --------------------------------------------------------------------------
+// Accuracy check against the way the main loop composes matrices with glm
+
+float OrbitKernelError(const OrbitBatch *batch, bool scalar)
+{
+	size_t count = OrbitCount(batch);
+	if (count == 0) return 0.f;
+
+	// work on a copy, without advancing, so the batch is left as it was
+	OrbitBatch copy = *batch;
+	vector<mat4> kernel(count);
+	if (scalar)
+		UpdateOrbitsScalar(&copy, 0.f, &kernel[0], sizeof(mat4), 0, count);
+	else
+		UpdateOrbits(&copy, 0.f, &kernel[0], sizeof(mat4), 0, count);
+
+	float error = 0.f;
+	for (size_t i = 0; i < count; i++) {
+		vec4 position = rotate(mat4(1.f), radians(batch->orbitAngle[i]), vec3(0.f,1.f,0.f))
+			* vec4(batch->distance[i], 0.f, 0.f, 1.f);
+		mat4 reference = translate(mat4(1.f), batch->centre + vec3(position))
+			* scale(mat4(1.f), vec3(batch->size[i]))
+			* rotate(mat4(1.f), radians(batch->tilt[i]), vec3(0.f,0.f,1.f))
+			* rotate(mat4(1.f), radians(batch->spinAngle[i]), vec3(0.f,1.f,0.f));
+
+		// relative to the size of the entries, positions being much larger
+		for (int c = 0; c < 4; c++) {
+			float magnitude = std::max(1.f, length(reference[c]));
+			for (int r = 0; r < 4; r++)
+				error = std::max(error, std::abs(kernel[i][c][r] - reference[c][r]) / magnitude);
+		}
+	}
+	return error;
+}
@@ -0,0 +1,76 @@
+// ==========================================================================
+// Batched orbital motion for large numbers of bodies
+//
+// An OrbitBatch animates bodies that all circle the same centre, such as an
+// asteroid belt. Each body's state lives in plain float arrays, one per
+// quantity, in the same units as the main loop uses (degrees, and degrees
+// per step for speeds). UpdateOrbits advances every angle and writes every
+// model matrix in a single pass, several bodies at a time with SSE, AVX or
+// NEON where the compiler targets them; defining ORBITS_SCALAR forces the
+// plain C++ path.
+//
+// A body's model matrix is
+//
+//	translate(centre + rotateY(orbitAngle) * (distance, 0, 0))
+//		* scale(size) * rotateZ(tilt) * rotateY(spinAngle)
+//
+// which is the same as spinning about the tilted axis and then tilting the
+// body, the way the earth is animated.
+// ==========================================================================
+#ifndef ORBITS_H
+#define ORBITS_H
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+struct OrbitBatch
+{
+	// centre every body in the batch orbits
+	glm::vec3 centre;
+
+	// per-body state, all the same length
+	std::vector<float> orbitAngle;
+	std::vector<float> orbitSpeed;
+	std::vector<float> distance;
+	std::vector<float> spinAngle;
+	std::vector<float> spinSpeed;
+	std::vector<float> tilt;
+	std::vector<float> size;
+
+	OrbitBatch() : centre(0.f)
+	{}
+};
+
+// appends one body and returns its index
+size_t AddOrbit(OrbitBatch *batch, float distance, float orbitSpeed, float spinSpeed,
+	float tilt, float size, float orbitAngle = 0.f, float spinAngle = 0.f);
+
+size_t OrbitCount(const OrbitBatch *batch);
+
+// advances bodies [begin, end) by steps increments of their speeds and
+// writes their model matrices to out, which is strided by stride bytes so it
+// can point straight into interleaved instance data; body i goes to the
+// matrix at out + (i - begin) strides
+void UpdateOrbits(OrbitBatch *batch, float steps, glm::mat4 *out, size_t stride,
+	size_t begin, size_t end);
+
+// the same, one body at a time with glm; this is the reference the vector
+// path is checked against and what handles the bodies left over at the end
+void UpdateOrbitsScalar(OrbitBatch *batch, float steps, glm::mat4 *out, size_t stride,
+	size_t begin, size_t end);
+
+// the most OrbitKernelError may report before a kernel counts as wrong
+#define ORBIT_KERNEL_TOLERANCE 1e-4f
+
+// largest relative error between the matrices UpdateOrbits, or with scalar
+// set UpdateOrbitsScalar, builds and ones composed with glm's rotate, scale
+// and translate, for the batch's current state: each entry's difference is
+// divided by the length of its column, or by 1 if that is shorter, since
+// positions run to hundreds of units; does not modify the batch
+float OrbitKernelError(const OrbitBatch *batch, bool scalar = false);
+
+// name of the vector instruction set UpdateOrbits was compiled for
+const char *OrbitKernelName();
+
+#endif
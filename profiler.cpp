@@ -0,0 +1,350 @@
+// ==========================================================================
+// Frame profiler
+// ==========================================================================
+
+#include "profiler.h"
+#include "gldebug.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace glm;
+
+// weight of the newest frame in the running averages
+#define PROFILER_SMOOTHING 0.1
+
+// overlay layout, in pixels: bar thickness, gap between scopes, and how long
+// a millisecond is
+#define OVERLAY_BAR 6
+#define OVERLAY_GAP 4
+#define OVERLAY_PIXELS_PER_MS 20.0
+
+Profiler::Profiler() : overlay(false), current(0), frameNumber(0), lastStateChanges(0), gpuOpen(-1),
+	lastReport(0.0), vertexArray(0)
+{
+	for (int i = 0; i < PROFILER_FRAMES; i++)
+		frames[i].recorded = false;
+}
+
+// milliseconds since the profiler was created
+static double Now(const Profiler *profiler)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - profiler->epoch).count();
+}
+
+bool InitializeProfiler(Profiler *profiler, const string &csvPath, const string &tracePath)
+{
+	profiler->epoch = chrono::steady_clock::now();
+
+	if (!csvPath.empty()) {
+		profiler->csv.open(csvPath.c_str());
+		if (!profiler->csv)
+			cout << "ERROR: could not open profile " << csvPath << endl;
+		profiler->csv << "frame,scope,depth,begin_ms,cpu_ms,gpu_ms,draw_calls,instances,vertices,state_changes" << endl;
+	}
+	profiler->tracePath = tracePath;
+
+	// bars are drawn without any vertex data, from gl_VertexID alone, but a
+	// core context still insists on a vertex array being bound
+	profiler->program = InitializeShaders("shaders/overlay_vertex.glsl", "shaders/overlay_fragment.glsl");
+	glGenVertexArrays(1, &profiler->vertexArray);
+
+	return profiler->program.id != 0 && !CheckGLErrors();
+}
+
+void BeginProfileFrame(Profiler *profiler)
+{
+	ProfileFrame &frame = profiler->frames[profiler->current];
+	frame.number = profiler->frameNumber++;
+	frame.recorded = true;
+	frame.samples.clear();
+	frame.bodies.clear();
+	frame.counters = ProfileCounters();
+	profiler->open.clear();
+	profiler->gpuOpen = -1;
+}
+
+// the index of name's stats, added the first time it is seen; names are
+// usually the same literal, so the pointers are compared first
+static int FindScope(const Profiler *profiler, const char *name)
+{
+	for (size_t i = 0; i < profiler->stats.size(); i++) {
+		const char *known = profiler->stats[i].name;
+		if (known == name || strcmp(known, name) == 0) return int(i);
+	}
+	return -1;
+}
+
+void BeginProfileScope(Profiler *profiler, const char *name, bool gpu)
+{
+	ProfileFrame &frame = profiler->frames[profiler->current];
+
+	ProfileSample sample;
+	sample.name = name;
+	sample.scope = FindScope(profiler, name);
+	if (sample.scope < 0) {
+		sample.scope = int(profiler->stats.size());
+		profiler->stats.push_back(ProfileStats(name));
+	}
+	sample.depth = int(profiler->open.size());
+	sample.cpuBegin = Now(profiler);
+	sample.cpuEnd = sample.cpuBegin;
+	sample.query = 0;
+	sample.gpuMs = -1.0;
+
+	if (gpu && profiler->gpuOpen < 0) {
+		if (profiler->freeQueries.empty()) {
+			GLuint query;
+			glGenQueries(1, &query);
+			profiler->freeQueries.push_back(query);
+		}
+		sample.query = profiler->freeQueries.back();
+		profiler->freeQueries.pop_back();
+		glBeginQuery(GL_TIME_ELAPSED, sample.query);
+		profiler->gpuOpen = int(frame.samples.size());
+	}
+
+	profiler->open.push_back(int(frame.samples.size()));
+	frame.samples.push_back(sample);
+}
+
+void EndProfileScope(Profiler *profiler)
+{
+	if (profiler->open.empty()) return;
+
+	int index = profiler->open.back();
+	profiler->open.pop_back();
+
+	ProfileSample &sample = profiler->frames[profiler->current].samples[index];
+	sample.cpuEnd = Now(profiler);
+	if (profiler->gpuOpen == index) {
+		glEndQuery(GL_TIME_ELAPSED);
+		profiler->gpuOpen = -1;
+	}
+}
+
+void CountDraw(Profiler *profiler, GLsizei vertices, GLsizei instances)
+{
+	ProfileCounters &counters = profiler->frames[profiler->current].counters;
+	counters.drawCalls++;
+	counters.instances += instances;
+	counters.vertices += (unsigned long long)(vertices) * instances;
+}
+
+void CountBody(Profiler *profiler, const char *name, int lod, GLsizei instances, GLsizei vertices)
+{
+	ProfileBody body = { name, lod, unsigned(instances), (unsigned long long)(vertices) * instances };
+	profiler->frames[profiler->current].bodies.push_back(body);
+}
+
+// --------------------------------------------------------------------------
+// Resolving and reporting
+
+static void ExportFrame(Profiler *profiler, const ProfileFrame &frame)
+{
+	const ProfileCounters &counters = frame.counters;
+	for (size_t i = 0; profiler->csv.is_open() && i < frame.samples.size(); i++) {
+		const ProfileSample &sample = frame.samples[i];
+		profiler->csv << frame.number << "," << sample.name << "," << sample.depth << ","
+			<< sample.cpuBegin << "," << sample.cpuEnd - sample.cpuBegin << ",";
+		if (sample.gpuMs >= 0) profiler->csv << sample.gpuMs;
+		profiler->csv << "," << counters.drawCalls << "," << counters.instances << ","
+			<< counters.vertices << "," << counters.stateChanges << "\n";
+	}
+
+	// complete events, in microseconds; the CPU on one track, the GPU on
+	// another
+	for (size_t i = 0; !profiler->tracePath.empty() && i < frame.samples.size(); i++) {
+		const ProfileSample &sample = frame.samples[i];
+		ostringstream event;
+		event << fixed << setprecision(3)
+			<< "{\"name\":\"" << sample.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":"
+			<< sample.cpuBegin * 1000.0 << ",\"dur\":" << (sample.cpuEnd - sample.cpuBegin) * 1000.0
+			<< ",\"args\":{\"frame\":" << frame.number << "}}";
+		profiler->traceEvents.push_back(event.str());
+
+		if (sample.gpuMs >= 0) {
+			ostringstream gpuEvent;
+			gpuEvent << fixed << setprecision(3)
+				<< "{\"name\":\"" << sample.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":"
+				<< sample.cpuBegin * 1000.0 << ",\"dur\":" << sample.gpuMs * 1000.0
+				<< ",\"args\":{\"frame\":" << frame.number << "}}";
+			profiler->traceEvents.push_back(gpuEvent.str());
+		}
+	}
+}
+
+static void PrintReport(const Profiler *profiler)
+{
+	cout << "---- profile ------------------------------------------" << endl;
+	for (size_t i = 0; i < profiler->stats.size(); i++) {
+		const ProfileStats &stats = profiler->stats[i];
+		if (!stats.resolved) continue;
+		cout << string(2*stats.depth, ' ') << left << setw(24 - 2*stats.depth) << stats.name << right
+			<< " cpu " << fixed << setprecision(3) << setw(7) << stats.cpuMs << " ms";
+		if (stats.gpuMs >= 0) cout << "   gpu " << setw(7) << stats.gpuMs << " ms";
+		cout << endl;
+	}
+
+	const ProfileCounters &counters = profiler->lastCounters;
+	cout << counters.drawCalls << " draws, " << counters.instances << " instances, "
+		<< counters.vertices << " vertices, " << counters.stateChanges << " state changes" << endl;
+	for (size_t i = 0; i < profiler->lastBodies.size(); i++) {
+		const ProfileBody &body = profiler->lastBodies[i];
+		cout << "  " << left << setw(12) << body.name << right << " lod " << body.lod
+			<< setw(8) << body.instances << " instances" << setw(10) << body.vertices << " vertices" << endl;
+	}
+}
+
+// folds a finished frame into the averages and the exports
+static void ResolveFrame(Profiler *profiler, ProfileFrame &frame)
+{
+	for (size_t i = 0; i < profiler->stats.size(); i++)
+		profiler->stats[i].lastGpuMs = -1.0;
+	for (size_t i = 0; i < frame.samples.size(); i++) {
+		ProfileSample &sample = frame.samples[i];
+		if (sample.query) {
+			// PROFILER_FRAMES frames on, this practically never has to wait
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(sample.query, GL_QUERY_RESULT, &elapsed);
+			sample.gpuMs = elapsed / 1.0e6;
+			profiler->freeQueries.push_back(sample.query);
+			sample.query = 0;
+		}
+
+		ProfileStats &stats = profiler->stats[sample.scope];
+		if (!stats.resolved) {
+			stats.cpuMs = sample.cpuEnd - sample.cpuBegin;
+			stats.gpuMs = sample.gpuMs;
+			stats.resolved = true;
+		}
+		if (sample.gpuMs >= 0)
+			stats.lastGpuMs = std::max(stats.lastGpuMs, 0.0) + sample.gpuMs;
+		stats.depth = sample.depth;
+		stats.cpuMs += PROFILER_SMOOTHING * ((sample.cpuEnd - sample.cpuBegin) - stats.cpuMs);
+		if (sample.gpuMs >= 0)
+			stats.gpuMs = stats.gpuMs < 0 ? sample.gpuMs : stats.gpuMs + PROFILER_SMOOTHING * (sample.gpuMs - stats.gpuMs);
+	}
+
+	profiler->lastCounters = frame.counters;
+	profiler->lastBodies = frame.bodies;
+	ExportFrame(profiler, frame);
+	frame.recorded = false;
+}
+
+void EndProfileFrame(Profiler *profiler, unsigned int stateChanges)
+{
+	// close anything left open, so the GPU query is never left running
+	while (!profiler->open.empty())
+		EndProfileScope(profiler);
+
+	ProfileFrame &frame = profiler->frames[profiler->current];
+	frame.counters.stateChanges = stateChanges - profiler->lastStateChanges;
+	profiler->lastStateChanges = stateChanges;
+
+	// the next slot in the ring is the oldest frame, whose queries are the
+	// ones most certainly finished
+	profiler->current = (profiler->current + 1) % PROFILER_FRAMES;
+	ProfileFrame &oldest = profiler->frames[profiler->current];
+	if (oldest.recorded)
+		ResolveFrame(profiler, oldest);
+
+	double now = Now(profiler);
+	if (profiler->overlay && now - profiler->lastReport >= 1000.0) {
+		PrintReport(profiler);
+		profiler->lastReport = now;
+	}
+}
+
+double ProfileScopeGpuMs(const Profiler *profiler, const char *name)
+{
+	int scope = FindScope(profiler, name);
+	return scope < 0 ? -1.0 : profiler->stats[scope].lastGpuMs;
+}
+
+// --------------------------------------------------------------------------
+// Overlay
+
+// a bar in pixels from the top left corner of a width x height window
+static void DrawBar(Profiler *profiler, float x, float y, float w, float h, int width, int height, const vec3 &colour)
+{
+	vec4 rect(2.f*x/width - 1.f, 1.f - 2.f*(y + h)/height, 2.f*w/width, 2.f*h/height);
+	SetUniform(&profiler->program, UNIFORM_RECT, rect);
+	SetUniform(&profiler->program, UNIFORM_COLOUR, colour);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+void DrawProfilerOverlay(Profiler *profiler, RenderState *state, int width, int height)
+{
+	if (!profiler->overlay || profiler->program.id == 0) return;
+
+	// a distinct colour for each scope, CPU bright and GPU dim
+	static const vec3 palette[] = {
+		vec3(0.9f, 0.3f, 0.3f), vec3(0.3f, 0.8f, 0.3f), vec3(0.3f, 0.5f, 0.9f),
+		vec3(0.9f, 0.8f, 0.2f), vec3(0.8f, 0.3f, 0.9f), vec3(0.2f, 0.8f, 0.8f)
+	};
+	const int paletteSize = sizeof(palette) / sizeof(palette[0]);
+
+	glDisable(GL_DEPTH_TEST);
+	UseProgram(state, profiler->program.id);
+	BindVertexArray(state, profiler->vertexArray);
+
+	// a 60 Hz frame's worth of backdrop, then each top-level scope's bars
+	float x = 10.f, y = 10.f;
+	float budget = float(1000.0 / 60.0 * OVERLAY_PIXELS_PER_MS);
+	int rows = 0;
+	for (size_t i = 0; i < profiler->stats.size(); i++)
+		if (profiler->stats[i].resolved && profiler->stats[i].depth == 0) rows++;
+	DrawBar(profiler, x - 2.f, y - 2.f, budget + 4.f, rows * (2*OVERLAY_BAR + OVERLAY_GAP) + 4.f, width, height, vec3(0.1f));
+
+	int row = 0;
+	for (size_t i = 0; i < profiler->stats.size(); i++) {
+		const ProfileStats &stats = profiler->stats[i];
+		if (!stats.resolved || stats.depth != 0) continue;
+
+		vec3 colour = palette[row % paletteSize];
+		float top = y + row * (2*OVERLAY_BAR + OVERLAY_GAP);
+		DrawBar(profiler, x, top, float(stats.cpuMs * OVERLAY_PIXELS_PER_MS), OVERLAY_BAR, width, height, colour);
+		if (stats.gpuMs >= 0)
+			DrawBar(profiler, x, top + OVERLAY_BAR, float(stats.gpuMs * OVERLAY_PIXELS_PER_MS), OVERLAY_BAR, width, height, colour * 0.5f);
+		row++;
+	}
+
+	glEnable(GL_DEPTH_TEST);
+	CHECK_DRAW_ERRORS();
+}
+
+void DestroyProfiler(Profiler *profiler)
+{
+	// whatever is still in flight is resolved too, oldest first, waiting
+	// if it must
+	while (!profiler->open.empty())
+		EndProfileScope(profiler);
+	for (int i = 0; i < PROFILER_FRAMES; i++) {
+		ProfileFrame &frame = profiler->frames[(profiler->current + i) % PROFILER_FRAMES];
+		if (frame.recorded) ResolveFrame(profiler, frame);
+	}
+
+	if (!profiler->tracePath.empty()) {
+		ofstream trace(profiler->tracePath.c_str());
+		trace << "{\"traceEvents\":[\n";
+		for (size_t i = 0; i < profiler->traceEvents.size(); i++)
+			trace << profiler->traceEvents[i] << (i + 1 < profiler->traceEvents.size() ? ",\n" : "\n");
+		trace << "],\"displayTimeUnit\":\"ms\"}\n";
+		if (!trace)
+			cout << "ERROR: could not write trace " << profiler->tracePath << endl;
+	}
+	profiler->csv.close();
+
+	if (!profiler->freeQueries.empty())
+		glDeleteQueries(GLsizei(profiler->freeQueries.size()), &profiler->freeQueries[0]);
+	profiler->freeQueries.clear();
+
+	glDeleteVertexArrays(1, &profiler->vertexArray);
+	profiler->vertexArray = 0;
+	DestroyProgram(&profiler->program);
+}
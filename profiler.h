@@ -0,0 +1,183 @@
+// ==========================================================================
+// Frame profiler
+//
+// Scopes time a stretch of a frame on the CPU and, for passes that submit
+// GPU work, on the GPU too with GL_TIME_ELAPSED queries. Queries are read
+// back PROFILER_FRAMES frames after they were issued, when the GPU has long
+// finished with them, so profiling never makes the CPU wait. A frame looks
+// like
+//
+//	BeginProfileFrame(&profiler);
+//	{
+//		ProfileScope scope(&profiler, "draw", true);	// CPU and GPU
+//		... RenderInstances, then CountDraw ...
+//	}
+//	EndProfileFrame(&profiler, renderState.changes);
+//
+// GL_TIME_ELAPSED queries cannot nest, so a GPU scope opened inside another
+// is only timed on the CPU.
+//
+// DrawProfilerOverlay shows every top-level scope as a CPU and a GPU bar
+// against a 60 Hz frame, and the full table of scopes, draw counts and
+// bodies is printed once a second while it is visible. Every resolved frame
+// can also be written out as CSV, or as a Chrome trace (chrome://tracing or
+// ui.perfetto.dev) in which GPU scopes sit at the time they were submitted.
+// ==========================================================================
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+#include "program.h"
+#include "renderstate.h"
+
+// frames between issuing a query and reading it back
+#define PROFILER_FRAMES 4
+
+// what the renderer submitted in a frame
+struct ProfileCounters
+{
+	unsigned int drawCalls;
+	unsigned int instances;
+	unsigned long long vertices;
+	unsigned int stateChanges;
+
+	ProfileCounters() : drawCalls(0), instances(0), vertices(0), stateChanges(0)
+	{}
+};
+
+// one timed scope in one frame; times are milliseconds since the profiler
+// started, gpuMs is negative when the scope was not timed on the GPU
+struct ProfileSample
+{
+	const char *name;
+	int         scope;	// index into Profiler::stats
+	int         depth;
+	double      cpuBegin;
+	double      cpuEnd;
+	GLuint      query;
+	double      gpuMs;
+};
+
+// what one body, or one group of them, cost in a frame
+struct ProfileBody
+{
+	const char *name;
+	int         lod;
+	unsigned int instances;
+	unsigned long long vertices;
+};
+
+struct ProfileFrame
+{
+	unsigned int number;
+	bool         recorded;
+	std::vector<ProfileSample> samples;
+	std::vector<ProfileBody>   bodies;
+	ProfileCounters counters;
+};
+
+// running averages for the overlay and the printed table, and the GPU time
+// of the last resolved frame, negative if it was not timed there
+struct ProfileStats
+{
+	const char *name;
+	double cpuMs;
+	double gpuMs;
+	double lastGpuMs;
+	int    depth;
+	bool   resolved;
+
+	ProfileStats(const char *name) : name(name), cpuMs(0.0), gpuMs(-1.0), lastGpuMs(-1.0), depth(0), resolved(false)
+	{}
+};
+
+struct Profiler
+{
+	bool overlay;
+
+	// the frame being recorded is frames[current]; the others wait for
+	// their queries
+	ProfileFrame frames[PROFILER_FRAMES];
+	int          current;
+	unsigned int frameNumber;
+	unsigned int lastStateChanges;
+
+	// open scopes, as indices into the current frame's samples, and the one
+	// holding the GPU query, or -1
+	std::vector<int> open;
+	int              gpuOpen;
+	std::vector<GLuint> freeQueries;
+
+	std::chrono::steady_clock::time_point epoch;
+
+	// smoothed by scope, in the order scopes were first opened, and the
+	// last resolved frame's totals; scopes are told apart by name, which
+	// BeginProfileScope looks up so resolving a frame never has to
+	std::vector<ProfileStats> stats;
+	ProfileCounters lastCounters;
+	std::vector<ProfileBody> lastBodies;
+	double lastReport;
+
+	// overlay drawing
+	ShaderProgram program;
+	GLuint        vertexArray;
+
+	// exports, when asked for
+	std::ofstream csv;
+	std::string   tracePath;
+	std::vector<std::string> traceEvents;
+
+	Profiler();
+};
+
+// csvPath and tracePath may be empty to skip that export; the overlay
+// program is only needed to draw the overlay
+bool InitializeProfiler(Profiler *profiler, const std::string &csvPath = "", const std::string &tracePath = "");
+
+void BeginProfileFrame(Profiler *profiler);
+
+// closes the frame and resolves the oldest one in the ring; stateChanges is
+// the render state cache's running count of bindings issued
+void EndProfileFrame(Profiler *profiler, unsigned int stateChanges);
+
+// name must outlive the profiler, as a string literal does
+void BeginProfileScope(Profiler *profiler, const char *name, bool gpu = false);
+void EndProfileScope(Profiler *profiler);
+
+// the GPU time of the named scope in the last resolved frame, summed over
+// every time it was opened; negative if it was not timed there
+double ProfileScopeGpuMs(const Profiler *profiler, const char *name);
+
+// times the enclosing block
+struct ProfileScope
+{
+	Profiler *profiler;
+
+	ProfileScope(Profiler *profiler, const char *name, bool gpu = false) : profiler(profiler)
+	{
+		BeginProfileScope(profiler, name, gpu);
+	}
+	~ProfileScope()
+	{
+		EndProfileScope(profiler);
+	}
+};
+
+// records a draw of instances instances of vertices vertices each
+void CountDraw(Profiler *profiler, GLsizei vertices, GLsizei instances);
+
+// records what a body, drawn at level of detail lod, cost this frame
+void CountBody(Profiler *profiler, const char *name, int lod, GLsizei instances, GLsizei vertices);
+
+// draws the bar overlay over whatever is in the framebuffer
+void DrawProfilerOverlay(Profiler *profiler, RenderState *state, int width, int height);
+
+// finishes the exports and frees the queries
+void DestroyProfiler(Profiler *profiler);
+
+#endif
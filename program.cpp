@@ -0,0 +1,445 @@
+// ==========================================================================
+// Shader program loading and uniform introspection
+// ==========================================================================
+
+#include "program.h"
+#include "assetpack.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <vector>
+#include <glm/gtc/type_ptr.hpp>
+
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+// names of the uniforms in each UniformSlot, in enum order
+static const char *slotNames[UNIFORM_SLOT_COUNT] = {
+	"Colour",
+	"translation",
+	"s",
+	"rect",
+	"tessellation",
+	"level",
+	"sphere",
+	"depthPyramid",
+	"indirection",
+	"source",
+	"sharpness"
+};
+
+// names of the uniform blocks in each UniformBlockBinding, in enum order
+static const char *blockNames[UNIFORM_BLOCK_BINDING_COUNT] = {
+	"FrameData",
+	"TextureHandles",
+	"CullData",
+	"VirtualTextureData"
+};
+
+// where program binaries go, and the driver they are valid for; an empty
+// directory means the cache is off
+static string cacheDirectory;
+static string cacheDriver;
+
+// where LoadSource looks before the filesystem, if anywhere
+static const AssetPack *shaderPack = 0;
+
+// written at the start of every cache file, ahead of the binary itself
+struct ProgramCacheHeader
+{
+	char               magic[4];
+	GLenum             binaryFormat;
+	unsigned long long key;
+	GLint              length;
+};
+
+// --------------------------------------------------------------------------
+// Program binary cache
+
+void EnableProgramCache(const string &directory, const string &driver)
+{
+	// some drivers support the entry points but no binary formats at all
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats == 0) return;
+
+	mkdir(directory.c_str(), 0755);
+	cacheDirectory = directory;
+	cacheDriver = driver;
+}
+
+// 64-bit FNV-1a over every source, anything else that changes how they
+// link, and the driver
+static unsigned long long ProgramKey(const vector<string> &sources)
+{
+	vector<const string*> parts;
+	for (size_t i = 0; i < sources.size(); i++)
+		parts.push_back(&sources[i]);
+	parts.push_back(&cacheDriver);
+
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < parts.size(); i++) {
+		for (size_t c = 0; c < parts[i]->size(); c++) {
+			hash ^= (unsigned char)(*parts[i])[c];
+			hash *= 1099511628211ull;
+		}
+		// keep "ab" + "c" apart from "a" + "bc"
+		hash ^= 0xFF;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static string CacheFilename(unsigned long long key)
+{
+	ostringstream name;
+	name << cacheDirectory << "/" << hex << setw(16) << setfill('0') << key << ".bin";
+	return name.str();
+}
+
+// a program from the cache, or one with id 0 when there is no usable binary
+static ShaderProgram LoadCachedProgram(unsigned long long key)
+{
+	ShaderProgram program;
+	ifstream input(CacheFilename(key).c_str(), ios::binary);
+	if (!input) return program;
+
+	ProgramCacheHeader header;
+	if (!input.read((char*)&header, sizeof(header)) || memcmp(header.magic, "PGMB", 4) != 0
+		|| header.key != key || header.length <= 0)
+		return program;
+
+	vector<char> binary(header.length);
+	if (!input.read(&binary[0], header.length))
+		return program;
+
+	program.id = glCreateProgram();
+	glProgramBinary(program.id, header.binaryFormat, &binary[0], header.length);
+
+	GLint status;
+	glGetProgramiv(program.id, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE) {
+		// the driver changed underneath us; build it again from source
+		cout << "Cached shader program is stale, recompiling" << endl;
+		glDeleteProgram(program.id);
+		program.id = 0;
+		return program;
+	}
+
+	IntrospectProgram(&program);
+	return program;
+}
+
+static void SaveCachedProgram(const ShaderProgram *program, unsigned long long key)
+{
+	ProgramCacheHeader header;
+	memcpy(header.magic, "PGMB", 4);
+	header.key = key;
+	header.length = 0;
+	glGetProgramiv(program->id, GL_PROGRAM_BINARY_LENGTH, &header.length);
+	if (header.length <= 0) return;
+
+	vector<char> binary(header.length);
+	glGetProgramBinary(program->id, header.length, &header.length, &header.binaryFormat, &binary[0]);
+
+	ofstream output(CacheFilename(key).c_str(), ios::binary);
+	output.write((const char*)&header, sizeof(header));
+	output.write(&binary[0], header.length);
+	if (!output)
+		cout << "WARNING: could not write shader program cache " << CacheFilename(key) << endl;
+}
+
+// --------------------------------------------------------------------------
+// Functions to set up OpenGL shader programs for rendering
+
+// loads, compiles and links count stages, capturing varyings with
+// transform feedback if there are any; returns a program with id 0 on
+// failure
+static ShaderProgram BuildProgram(const GLenum *types, const string *files, int count,
+	const vector<string> &varyings)
+{
+	// load shader source from files
+	vector<string> sources(count);
+	for (int i = 0; i < count; i++) {
+		sources[i] = LoadSource(files[i]);
+		if (sources[i].empty()) return ShaderProgram();
+	}
+
+	// a binary from an earlier run saves compiling and linking entirely
+	unsigned long long key = 0;
+	if (!cacheDirectory.empty()) {
+		vector<string> parts = sources;
+		for (size_t i = 0; i < varyings.size(); i++)
+			parts.push_back(varyings[i]);
+		key = ProgramKey(parts);
+		ShaderProgram cached = LoadCachedProgram(key);
+		if (cached.id != 0) return cached;
+	}
+
+	// compile shader source into shader objects
+	vector<GLuint> shaders(count);
+	for (int i = 0; i < count; i++)
+		shaders[i] = CompileShader(types[i], sources[i]);
+
+	// link shader program
+	ShaderProgram program = LinkProgram(&shaders[0], count, varyings);
+
+	for (int i = 0; i < count; i++)
+		glDeleteShader(shaders[i]);
+
+	// LinkProgram hands back failed programs too, so only keep linked ones
+	if (!cacheDirectory.empty()) {
+		GLint status = GL_FALSE;
+		glGetProgramiv(program.id, GL_LINK_STATUS, &status);
+		if (status == GL_TRUE) SaveCachedProgram(&program, key);
+	}
+
+	return program;
+}
+
+ShaderProgram InitializeShaders(const string &vertexFile, const string &fragmentFile)
+{
+	GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	string files[2] = { vertexFile, fragmentFile };
+	return BuildProgram(types, files, 2, vector<string>());
+}
+
+ShaderProgram InitializeComputeShader(const string &computeFile)
+{
+	GLenum type = GL_COMPUTE_SHADER;
+	return BuildProgram(&type, &computeFile, 1, vector<string>());
+}
+
+ShaderProgram InitializeFeedbackShaders(const string &vertexFile, const string &geometryFile,
+	const vector<string> &varyings)
+{
+	GLenum types[2] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER };
+	string files[2] = { vertexFile, geometryFile };
+	return BuildProgram(types, files, 2, varyings);
+}
+
+void IntrospectProgram(ShaderProgram *program)
+{
+	program->uniforms.clear();
+	for (int i = 0; i < UNIFORM_SLOT_COUNT; i++)
+		program->slots[i] = Uniform();
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program->id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program->id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	vector<GLchar> name(std::max(maxLength, 1));
+	for (GLint i = 0; i < count; i++)
+	{
+		Uniform uniform;
+		GLsizei length = 0;
+		glGetActiveUniform(program->id, i, name.size(), &length, &uniform.size, &uniform.type, &name[0]);
+
+		// members of uniform blocks have no location of their own
+		uniform.location = glGetUniformLocation(program->id, &name[0]);
+		if (uniform.location < 0) continue;
+
+		// arrays are reported as "name[0]", but looked up as "name"
+		string key(&name[0], length);
+		if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+			key.resize(key.size() - 3);
+
+		program->uniforms[key] = uniform;
+	}
+
+	for (int i = 0; i < UNIFORM_SLOT_COUNT; i++)
+		program->slots[i] = FindUniform(program, slotNames[i]);
+
+	for (GLuint i = 0; i < UNIFORM_BLOCK_BINDING_COUNT; i++) {
+		GLuint block = glGetUniformBlockIndex(program->id, blockNames[i]);
+		if (block != GL_INVALID_INDEX)
+			glUniformBlockBinding(program->id, block, i);
+	}
+}
+
+Uniform FindUniform(const ShaderProgram *program, const string &name)
+{
+	map<string, Uniform>::const_iterator it = program->uniforms.find(name);
+	return it != program->uniforms.end() ? it->second : Uniform();
+}
+
+void DestroyProgram(ShaderProgram *program)
+{
+	glDeleteProgram(program->id);
+	program->id = 0;
+	program->uniforms.clear();
+}
+
+// --------------------------------------------------------------------------
+// Typed uniform setters
+
+void SetUniform(const ShaderProgram *program, UniformSlot slot, GLint value)
+{
+	GLint location = program->slots[slot].location;
+	if (location >= 0) glProgramUniform1i(program->id, location, value);
+}
+
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const ivec2 &value)
+{
+	GLint location = program->slots[slot].location;
+	if (location >= 0) glProgramUniform2i(program->id, location, value.x, value.y);
+}
+
+void SetUniform(const ShaderProgram *program, UniformSlot slot, GLfloat value)
+{
+	GLint location = program->slots[slot].location;
+	if (location >= 0) glProgramUniform1f(program->id, location, value);
+}
+
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const vec2 &value)
+{
+	GLint location = program->slots[slot].location;
+	if (location >= 0) glProgramUniform2fv(program->id, location, 1, value_ptr(value));
+}
+
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const vec3 &value)
+{
+	GLint location = program->slots[slot].location;
+	if (location >= 0) glProgramUniform3fv(program->id, location, 1, value_ptr(value));
+}
+
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const vec4 &value)
+{
+	GLint location = program->slots[slot].location;
+	if (location >= 0) glProgramUniform4fv(program->id, location, 1, value_ptr(value));
+}
+
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const mat4 &value)
+{
+	GLint location = program->slots[slot].location;
+	if (location >= 0) glProgramUniformMatrix4fv(program->id, location, 1, GL_FALSE, value_ptr(value));
+}
+
+// --------------------------------------------------------------------------
+// OpenGL shader support functions
+
+// sources come from pack first, if given
+void UseShaderPack(const AssetPack *pack)
+{
+	shaderPack = pack;
+}
+
+// reads a text file with the given name into a string
+string LoadSource(const string &filename)
+{
+	if (shaderPack) {
+		const AssetEntry *entry = FindAsset(shaderPack, AssetName(filename), ASSET_SHADER);
+		if (entry)
+			return string((const char*)AssetData(shaderPack, entry), size_t(entry->size));
+	}
+
+	string source;
+
+	// sized up front and read in one go rather than a character at a time
+	ifstream input(filename.c_str(), ios::binary);
+	if (input) {
+		input.seekg(0, ios::end);
+		source.resize(size_t(input.tellg()));
+		input.seekg(0, ios::beg);
+		if (!source.empty()) input.read(&source[0], source.size());
+		input.close();
+	}
+	else {
+		cout << "ERROR: Could not load shader source from file "
+			<< filename << endl;
+	}
+
+	return source;
+}
+
+// creates and returns a shader object compiled from the given source
+GLuint CompileShader(GLenum shaderType, const string &source)
+{
+	// allocate shader object name
+	GLuint shaderObject = glCreateShader(shaderType);
+
+	// try compiling the source as a shader of the given type
+	const GLchar *source_ptr = source.c_str();
+	glShaderSource(shaderObject, 1, &source_ptr, 0);
+	glCompileShader(shaderObject);
+
+	// retrieve compile status
+	GLint status;
+	glGetShaderiv(shaderObject, GL_COMPILE_STATUS, &status);
+	if (status == GL_FALSE)
+	{
+		GLint length;
+		glGetShaderiv(shaderObject, GL_INFO_LOG_LENGTH, &length);
+		string info(length, ' ');
+		glGetShaderInfoLog(shaderObject, info.length(), &length, &info[0]);
+		cout << "ERROR compiling shader:" << endl << endl;
+		cout << source << endl;
+		cout << info << endl;
+	}
+
+	return shaderObject;
+}
+
+// creates and returns a program linked from vertex and fragment shaders,
+// with its active uniforms already looked up
+ShaderProgram LinkProgram(GLuint vertexShader, GLuint fragmentShader)
+{
+	GLuint shaders[2] = { vertexShader, fragmentShader };
+	return LinkProgram(shaders, 2, vector<string>());
+}
+
+ShaderProgram LinkProgram(const GLuint *shaders, int count, const vector<string> &varyings)
+{
+	// allocate program object name
+	ShaderProgram program;
+	program.id = glCreateProgram();
+
+	// attach provided shader objects to this program
+	for (int i = 0; i < count; i++)
+		if (shaders[i]) glAttachShader(program.id, shaders[i]);
+
+	// transform feedback outputs are fixed at link time, written one after
+	// another into a single buffer
+	if (!varyings.empty()) {
+		vector<const GLchar*> names;
+		for (size_t i = 0; i < varyings.size(); i++)
+			names.push_back(varyings[i].c_str());
+		glTransformFeedbackVaryings(program.id, GLsizei(names.size()), &names[0], GL_INTERLEAVED_ATTRIBS);
+	}
+
+	// keep the binary around for the program cache
+	if (!cacheDirectory.empty())
+		glProgramParameteri(program.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+	// try linking the program with given attachments
+	glLinkProgram(program.id);
+
+	// retrieve link status
+	GLint status;
+	glGetProgramiv(program.id, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE)
+	{
+		GLint length;
+		glGetProgramiv(program.id, GL_INFO_LOG_LENGTH, &length);
+		string info(length, ' ');
+		glGetProgramInfoLog(program.id, info.length(), &length, &info[0]);
+		cout << "ERROR linking shader program:" << endl;
+		cout << info << endl;
+		return program;
+	}
+
+	IntrospectProgram(&program);
+	return program;
+}
@@ -0,0 +1,128 @@
+// ==========================================================================
+// Shader program loading and uniform introspection
+//
+// LinkProgram queries every active uniform of a program once, right after
+// linking, so nothing on the per-draw path has to look a uniform up by name.
+// The uniforms the renderer sets every frame are resolved into fixed slots
+// and written through the typed SetUniform overloads, and the uniform blocks
+// shared between programs are attached to fixed binding points.
+//
+// With the program cache enabled, InitializeShaders saves every program it
+// links with glGetProgramBinary and reloads it with glProgramBinary on the
+// next run, skipping compilation. Binaries are keyed by a hash of the
+// sources and the driver, and a binary the driver rejects anyway (after an
+// update it did not report in its version string, say) is rebuilt from
+// source.
+// ==========================================================================
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+struct AssetPack;
+
+// uniforms the renderer sets by slot rather than by name
+enum UniformSlot
+{
+	UNIFORM_COLOUR,
+	UNIFORM_TRANSLATION,
+	UNIFORM_SAMPLER,
+	UNIFORM_RECT,
+	UNIFORM_TESSELLATION,
+	UNIFORM_LEVEL,
+	UNIFORM_SPHERE,
+	UNIFORM_DEPTH_PYRAMID,
+	UNIFORM_INDIRECTION,
+	UNIFORM_SOURCE,
+	UNIFORM_SHARPNESS,
+	UNIFORM_SLOT_COUNT
+};
+
+// binding points of the uniform blocks shared by all programs; GLSL 4.10 has
+// no layout(binding = N), so these are assigned when the program is linked
+enum UniformBlockBinding
+{
+	FRAME_BLOCK_BINDING,		//"FrameData", see framedata.h
+	TEXTURE_BLOCK_BINDING,		//"TextureHandles", see texturemanager.h
+	CULL_BLOCK_BINDING,		//"CullData", see gpuculling.h
+	VIRTUAL_BLOCK_BINDING,		//"VirtualTextureData", see virtualtexture.h
+	UNIFORM_BLOCK_BINDING_COUNT
+};
+
+// an active uniform as reported by glGetActiveUniform
+struct Uniform
+{
+	GLint  location;
+	GLenum type;
+	GLint  size;
+
+	// -1 is what OpenGL reports for uniforms that are not active
+	Uniform() : location(-1), type(GL_NONE), size(0)
+	{}
+};
+
+struct ShaderProgram
+{
+	// OpenGL name of the program object
+	GLuint id;
+
+	// every active uniform, keyed by name with any "[0]" suffix removed
+	std::map<std::string, Uniform> uniforms;
+
+	// the well-known uniforms, looked up once at link time
+	Uniform slots[UNIFORM_SLOT_COUNT];
+
+	// initialize object names to zero (OpenGL reserved value)
+	ShaderProgram() : id(0)
+	{}
+};
+
+// cache program binaries in directory from now on; driver should name the
+// vendor, renderer and version, as QueryGLVersion returns them
+void EnableProgramCache(const std::string &directory, const std::string &driver);
+
+// load, compile, and link shaders, returning a program with id 0 on failure
+ShaderProgram InitializeShaders(const std::string &vertexFile = "shaders/vertex.glsl",
+	const std::string &fragmentFile = "shaders/fragment.glsl");
+
+// the same for a compute shader, which needs 4.3 or GL_ARB_compute_shader
+ShaderProgram InitializeComputeShader(const std::string &computeFile);
+
+// the same for a vertex and geometry shader pair that only writes varyings
+// out with transform feedback, interleaved in the order given
+ShaderProgram InitializeFeedbackShaders(const std::string &vertexFile, const std::string &geometryFile,
+	const std::vector<std::string> &varyings);
+
+// read shader sources from pack first, falling back to the file for any it
+// does not hold; null goes back to files only
+void UseShaderPack(const AssetPack *pack);
+
+std::string LoadSource(const std::string &filename);
+GLuint CompileShader(GLenum shaderType, const std::string &source);
+ShaderProgram LinkProgram(GLuint vertexShader, GLuint fragmentShader);
+ShaderProgram LinkProgram(const GLuint *shaders, int count, const std::vector<std::string> &varyings);
+
+// fills in the uniform table and slots of an already linked program, and
+// attaches its uniform blocks to their binding points
+void IntrospectProgram(ShaderProgram *program);
+
+// returns the named uniform, or one with location -1 if it is not active
+Uniform FindUniform(const ShaderProgram *program, const std::string &name);
+
+void DestroyProgram(ShaderProgram *program);
+
+// typed setters; these write straight to the program object, so it does not
+// need to be bound, and quietly ignore uniforms the compiler optimized away
+void SetUniform(const ShaderProgram *program, UniformSlot slot, GLint value);
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const glm::ivec2 &value);
+void SetUniform(const ShaderProgram *program, UniformSlot slot, GLfloat value);
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const glm::vec2 &value);
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const glm::vec3 &value);
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const glm::vec4 &value);
+void SetUniform(const ShaderProgram *program, UniformSlot slot, const glm::mat4 &value);
+
+#endif
@@ -0,0 +1,82 @@
+// ==========================================================================
+// Render state cache
+// ==========================================================================
+
+#include "renderstate.h"
+
+// the cache starts out matching a context nobody has touched
+RenderState::RenderState() : program(0), vertexArray(0), activeUnit(0), changes(0), skipped(0)
+{
+	for (int i = 0; i < RENDERSTATE_TEXTURE_UNITS; i++) {
+		textureTargets[i] = GL_TEXTURE_2D;
+		textures[i] = 0;
+	}
+}
+
+void UseProgram(RenderState *state, GLuint program)
+{
+	if (state->program == program) {
+		state->skipped++;
+		return;
+	}
+	glUseProgram(program);
+	state->program = program;
+	state->changes++;
+}
+
+void BindVertexArray(RenderState *state, GLuint vertexArray)
+{
+	if (state->vertexArray == vertexArray) {
+		state->skipped++;
+		return;
+	}
+	glBindVertexArray(vertexArray);
+	state->vertexArray = vertexArray;
+	state->changes++;
+}
+
+// only one binding per unit is remembered: switching a unit between targets
+// costs a rebind, which is never wrong, just not free
+void BindTexture(RenderState *state, GLuint unit, GLenum target, GLuint texture)
+{
+	if (unit >= RENDERSTATE_TEXTURE_UNITS) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		state->activeUnit = unit;
+		state->changes += 2;
+		return;
+	}
+
+	if (state->textures[unit] == texture && state->textureTargets[unit] == target) {
+		state->skipped++;
+		return;
+	}
+	if (state->activeUnit != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		state->activeUnit = unit;
+		state->changes++;
+	}
+	glBindTexture(target, texture);
+	state->textureTargets[unit] = target;
+	state->textures[unit] = texture;
+	state->changes++;
+}
+
+// resynchronises the cache by actually resetting OpenGL to the defaults
+void InvalidateRenderState(RenderState *state)
+{
+	glUseProgram(0);
+	glBindVertexArray(0);
+	for (GLuint unit = 0; unit < RENDERSTATE_TEXTURE_UNITS; unit++) {
+		if (state->textures[unit] != 0) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glBindTexture(state->textureTargets[unit], 0);
+		}
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	unsigned int changes = state->changes, skipped = state->skipped;
+	*state = RenderState();
+	state->changes = changes;
+	state->skipped = skipped;
+}
@@ -0,0 +1,40 @@
+// ==========================================================================
+// Render state cache
+//
+// Remembers which program, vertex array and textures are bound so the
+// renderer can ask for a binding every draw without paying for the ones that
+// are already in place. Everything drawn each frame binds through here;
+// code that talks to OpenGL directly (setup, uploads) must either restore
+// what it changed or call InvalidateRenderState afterwards.
+// ==========================================================================
+#ifndef RENDERSTATE_H
+#define RENDERSTATE_H
+
+#include <glad/glad.h>
+
+#define RENDERSTATE_TEXTURE_UNITS 16
+
+struct RenderState
+{
+	GLuint program;
+	GLuint vertexArray;
+	GLuint activeUnit;
+	GLenum textureTargets[RENDERSTATE_TEXTURE_UNITS];
+	GLuint textures[RENDERSTATE_TEXTURE_UNITS];
+
+	// bindings actually issued and bindings skipped as redundant
+	unsigned int changes;
+	unsigned int skipped;
+
+	// matches OpenGL's defaults for a fresh context
+	RenderState();
+};
+
+void UseProgram(RenderState *state, GLuint program);
+void BindVertexArray(RenderState *state, GLuint vertexArray);
+void BindTexture(RenderState *state, GLuint unit, GLenum target, GLuint texture);
+
+// forget everything cached, e.g. after code outside the cache changed state
+void InvalidateRenderState(RenderState *state);
+
+#endif
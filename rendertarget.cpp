@@ -0,0 +1,150 @@
+// ==========================================================================
+// Dynamic resolution
+// ==========================================================================
+
+#include "rendertarget.h"
+#include "gldebug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+RenderTarget::RenderTarget() : outputWidth(0), outputHeight(0), width(0), height(0), scale(1.f), minScale(0.5f),
+	targetMs(0.0), sharpness(0.3f), averageMs(-1.0), settle(0), framebuffer(0), colourTexture(0), depthBuffer(0),
+	vertexArray(0)
+{}
+
+// the size drawn at the current scale
+static void ScaleTarget(RenderTarget *target)
+{
+	target->width = std::max(1, GLsizei(target->outputWidth * target->scale + 0.5f));
+	target->height = std::max(1, GLsizei(target->outputHeight * target->scale + 0.5f));
+}
+
+// (re)allocates the colour and depth attachments at the output size
+static void SizeTarget(RenderTarget *target, GLsizei outputWidth, GLsizei outputHeight)
+{
+	target->outputWidth = outputWidth;
+	target->outputHeight = outputHeight;
+	ScaleTarget(target);
+
+	glBindTexture(GL_TEXTURE_2D, target->colourTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, outputWidth, outputHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, target->depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, outputWidth, outputHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+}
+
+bool InitializeRenderTarget(RenderTarget *target, GLsizei outputWidth, GLsizei outputHeight)
+{
+	target->program = InitializeShaders("shaders/overlay_vertex.glsl", "shaders/upscale_fragment.glsl");
+	if (!target->program.id) {
+		cout << "ERROR: could not build the upscale program" << endl;
+		return false;
+	}
+	SetUniform(&target->program, UNIFORM_RECT, vec4(-1.f, -1.f, 2.f, 2.f));
+	SetUniform(&target->program, UNIFORM_SAMPLER, 0);
+	glGenVertexArrays(1, &target->vertexArray);
+
+	glGenTextures(1, &target->colourTexture);
+	glGenRenderbuffers(1, &target->depthBuffer);
+	SizeTarget(target, outputWidth, outputHeight);
+
+	glGenFramebuffers(1, &target->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->colourTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target->depthBuffer);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete) {
+		cout << "ERROR: dynamic resolution framebuffer is incomplete" << endl;
+		return false;
+	}
+
+	return !CheckGLErrors();
+}
+
+void ResizeRenderTarget(RenderTarget *target, GLsizei outputWidth, GLsizei outputHeight)
+{
+	if (!target->framebuffer || (outputWidth == target->outputWidth && outputHeight == target->outputHeight)) return;
+	SizeTarget(target, outputWidth, outputHeight);
+
+	// what was measured was at the old size
+	target->averageMs = -1.0;
+	target->settle = RENDER_SCALE_SETTLE_FRAMES;
+	CheckGLErrors();
+}
+
+bool AdaptRenderScale(RenderTarget *target, double gpuMs)
+{
+	if (target->targetMs <= 0.0 || gpuMs <= 0.0) return false;
+	if (target->settle > 0) {
+		target->settle--;
+		return false;
+	}
+
+	// a few frames' worth, so one slow frame does not move the scale
+	target->averageMs = target->averageMs < 0.0 ? gpuMs : target->averageMs + 0.2 * (gpuMs - target->averageMs);
+
+	float scale = target->scale;
+	if (target->averageMs > target->targetMs)
+		scale = RENDER_SCALE_STEP * floor(scale * float(sqrt(target->targetMs / target->averageMs)) / RENDER_SCALE_STEP);
+	else if (target->averageMs < RENDER_SCALE_HEADROOM * target->targetMs)
+		scale += RENDER_SCALE_STEP;
+	scale = clamp(scale, target->minScale, 1.f);
+	if (scale == target->scale) return false;
+
+	GLsizei width = target->width, height = target->height;
+	target->scale = scale;
+	ScaleTarget(target);
+	target->averageMs = -1.0;
+	target->settle = RENDER_SCALE_SETTLE_FRAMES;
+	return width != target->width || height != target->height;
+}
+
+void BindRenderTarget(const RenderTarget *target)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+	glViewport(0, 0, target->width, target->height);
+}
+
+void PresentRenderTarget(RenderTarget *target, RenderState *state, GLuint framebuffer)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, target->outputWidth, target->outputHeight);
+
+	// sharpening fades in as the scale drops, and is off at full size
+	float sharpness = target->sharpness * std::min(1.f, 4.f * (1.f - target->scale));
+	SetUniform(&target->program, UNIFORM_SOURCE,
+		vec4(float(target->width), float(target->height), float(target->outputWidth), float(target->outputHeight)));
+	SetUniform(&target->program, UNIFORM_SHARPNESS, sharpness);
+
+	glDisable(GL_DEPTH_TEST);
+	UseProgram(state, target->program.id);
+	BindVertexArray(state, target->vertexArray);
+	BindTexture(state, 0, GL_TEXTURE_2D, target->colourTexture);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glEnable(GL_DEPTH_TEST);
+
+	CHECK_DRAW_ERRORS();
+}
+
+void DestroyRenderTarget(RenderTarget *target)
+{
+	glDeleteFramebuffers(1, &target->framebuffer);
+	glDeleteTextures(1, &target->colourTexture);
+	glDeleteRenderbuffers(1, &target->depthBuffer);
+	glDeleteVertexArrays(1, &target->vertexArray);
+	DestroyProgram(&target->program);
+	target->framebuffer = target->colourTexture = target->depthBuffer = target->vertexArray = 0;
+}
@@ -0,0 +1,97 @@
+// ==========================================================================
+// Dynamic resolution
+//
+// The scene is drawn into an offscreen target at a fraction of the window's
+// resolution, then stretched over the window with a bilinear filter and a
+// light sharpening pass. AdaptRenderScale moves the fraction so the GPU
+// time the profiler measured for the scene pass stays under a target; the
+// upscale, the overlay and the like cost the same at any scale, so they
+// are left out. Fragment work goes with the pixels drawn, the square of the
+// scale, so an overrun drops straight to the scale that should fit, while
+// headroom only climbs back a step at a time. A frame looks like
+//
+//	BindRenderTarget(&target);
+//	... clear and draw the scene ...
+//	PresentRenderTarget(&target, &renderState, 0);	// onto the window
+//	... draw the overlay at full resolution, swap ...
+//	if (AdaptRenderScale(&target, ProfileScopeGpuMs(&profiler, "draw")))
+//		... resize whatever follows the drawn size ...
+//
+// The target is allocated at the window's size and drawn into its lower
+// left corner, so changing the scale reallocates nothing. GPU times arrive
+// PROFILER_FRAMES frames late, so after a change the scale is held until
+// frames drawn at the new size have been measured.
+// ==========================================================================
+#ifndef RENDERTARGET_H
+#define RENDERTARGET_H
+
+#include <glad/glad.h>
+
+#include "program.h"
+#include "renderstate.h"
+
+// scales are multiples of this, which keeps small swings in GPU time from
+// resizing the target every time
+#define RENDER_SCALE_STEP (1.f/16.f)
+
+// the GPU time under which the scale climbs, as a fraction of the target
+#define RENDER_SCALE_HEADROOM 0.8
+
+// frames the scale is held for after it changes
+#define RENDER_SCALE_SETTLE_FRAMES 12
+
+struct RenderTarget
+{
+	// the window's framebuffer, which the target is presented to
+	GLsizei outputWidth;
+	GLsizei outputHeight;
+
+	// what is drawn this frame, scale times the output
+	GLsizei width;
+	GLsizei height;
+	float   scale;
+	float   minScale;
+
+	// GPU milliseconds a frame should take, or 0 to hold the scale
+	double targetMs;
+
+	// how strongly a scaled-down frame is sharpened, from 0 to 1
+	float sharpness;
+
+	// smoothed GPU time since the last change, negative until measured,
+	// and frames left until the scale may change again
+	double averageMs;
+	int    settle;
+
+	GLuint framebuffer;
+	GLuint colourTexture;
+	GLuint depthBuffer;
+
+	// the upscale, drawn with no vertex data
+	ShaderProgram program;
+	GLuint        vertexArray;
+
+	// initialize object names to zero (OpenGL reserved value)
+	RenderTarget();
+};
+
+// a target for a window framebuffer of outputWidth x outputHeight
+bool InitializeRenderTarget(RenderTarget *target, GLsizei outputWidth, GLsizei outputHeight);
+
+// reallocates the target for a window framebuffer now outputWidth x
+// outputHeight, binding outside the render state cache; the scale is kept
+void ResizeRenderTarget(RenderTarget *target, GLsizei outputWidth, GLsizei outputHeight);
+
+// moves the scale towards targetMs given the GPU time of a finished frame's
+// scene pass; returns true when width and height change
+bool AdaptRenderScale(RenderTarget *target, double gpuMs);
+
+// binds the target and sets the viewport to the part drawn this frame
+void BindRenderTarget(const RenderTarget *target);
+
+// stretches what was drawn over all of framebuffer, leaving it bound
+void PresentRenderTarget(RenderTarget *target, RenderState *state, GLuint framebuffer);
+
+void DestroyRenderTarget(RenderTarget *target);
+
+#endif
@@ -0,0 +1,78 @@
+// ==========================================================================
+// Transform hierarchy
+// ==========================================================================
+
+#include "scenegraph.h"
+
+#include <cassert>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+int AddNode(SceneGraph *graph, int parent, const vec3 &translation, const quat &rotation, const vec3 &scale)
+{
+	int node = int(graph->parent.size());
+	assert(parent < node);
+
+	graph->parent.push_back(parent);
+	graph->translation.push_back(translation);
+	graph->rotation.push_back(rotation);
+	graph->scale.push_back(scale);
+	graph->world.push_back(mat4(1.f));
+	graph->dirty.push_back(1);
+	return node;
+}
+
+void SetTranslation(SceneGraph *graph, int node, const vec3 &translation)
+{
+	if (graph->translation[node] == translation) return;
+	graph->translation[node] = translation;
+	graph->dirty[node] = 1;
+}
+
+void SetRotation(SceneGraph *graph, int node, const quat &rotation)
+{
+	if (graph->rotation[node] == rotation) return;
+	graph->rotation[node] = rotation;
+	graph->dirty[node] = 1;
+}
+
+void SetScale(SceneGraph *graph, int node, const vec3 &scale)
+{
+	if (graph->scale[node] == scale) return;
+	graph->scale[node] = scale;
+	graph->dirty[node] = 1;
+}
+
+// translation * rotation * scale, without multiplying out full matrices
+static mat4 LocalMatrix(const vec3 &translation, const quat &rotation, const vec3 &scale)
+{
+	mat4 local = mat4_cast(rotation);
+	local[0] *= scale.x;
+	local[1] *= scale.y;
+	local[2] *= scale.z;
+	local[3] = vec4(translation, 1.f);
+	return local;
+}
+
+void UpdateSceneGraph(SceneGraph *graph)
+{
+	size_t count = graph->parent.size();
+	graph->recomputed = 0;
+
+	// parents come first, so by the time we reach a node its parent's dirty
+	// flag says whether the parent's world matrix changed in this pass
+	for (size_t i = 0; i < count; i++) {
+		int parent = graph->parent[i];
+		if (!graph->dirty[i] && (parent < 0 || !graph->dirty[parent]))
+			continue;
+
+		mat4 local = LocalMatrix(graph->translation[i], graph->rotation[i], graph->scale[i]);
+		graph->world[i] = parent < 0 ? local : graph->world[parent] * local;
+		graph->dirty[i] = 1;
+		graph->recomputed++;
+	}
+
+	fill(graph->dirty.begin(), graph->dirty.end(), 0);
+}
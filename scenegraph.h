@@ -0,0 +1,55 @@
+// ==========================================================================
+// Transform hierarchy
+//
+// Nodes carry a local translation, rotation and scale and a cached world
+// matrix. All of it is kept structure-of-arrays, with every parent stored
+// before its children, so UpdateSceneGraph is a single forward pass that
+// only recomputes nodes whose local transform changed, or whose parent's
+// world matrix did, since the last update.
+// ==========================================================================
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct SceneGraph
+{
+	// node i's parent has a lower index, or is -1 for a root
+	std::vector<int>       parent;
+
+	// local transform, applied as translation * rotation * scale
+	std::vector<glm::vec3> translation;
+	std::vector<glm::quat> rotation;
+	std::vector<glm::vec3> scale;
+
+	// parent's world matrix times the local transform
+	std::vector<glm::mat4> world;
+
+	// set when the local transform changed since the last update
+	std::vector<unsigned char> dirty;
+
+	// how many world matrices the last update recomputed
+	size_t recomputed;
+
+	SceneGraph() : recomputed(0)
+	{}
+};
+
+// appends a node and returns its index; parent must already exist, which is
+// what keeps the arrays in parent-before-child order
+int AddNode(SceneGraph *graph, int parent,
+	const glm::vec3 &translation = glm::vec3(0.f),
+	const glm::quat &rotation = glm::quat(),
+	const glm::vec3 &scale = glm::vec3(1.f));
+
+// setters only mark the node dirty when the value actually changes
+void SetTranslation(SceneGraph *graph, int node, const glm::vec3 &translation);
+void SetRotation(SceneGraph *graph, int node, const glm::quat &rotation);
+void SetScale(SceneGraph *graph, int node, const glm::vec3 &scale);
+
+// recomputes the world matrices of dirty nodes and their descendants
+void UpdateSceneGraph(SceneGraph *graph);
+
+#endif
@@ -0,0 +1,154 @@
+// ==========================================================================
+// Compute program culling bodies and building their indirect draws
+//
+// One invocation per body: bodies outside the frustum or hidden behind last
+// frame's depth are dropped, visible ones pick a level of detail the way
+// SelectLOD does and are appended to that level's run of instances, counted
+// into its indirect draw command.
+// ==========================================================================
+#version 430
+
+layout(local_size_x = 64) in;
+
+// per-frame camera data, shared with every other program (see framedata.h)
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+};
+
+// culling parameters (see gpuculling.h)
+layout(std140) uniform CullData {
+	vec4  planes[6];
+	vec4  lodRadii[5];
+	float pixelsPerUnit;
+	float hysteresis;
+	int   bodyCount;
+	int   lodCount;
+	int   capacity;
+	int   commandStride;
+	mat4  occlusionViewProjection;
+	vec4  occlusionSize;
+};
+
+// last frame's farthest depths (see occlusion.h)
+uniform sampler2D depthPyramid;
+
+// every body, as the application wrote them
+layout(std430, binding = 0) readonly buffer Models { mat4 models[]; };
+layout(std430, binding = 1) readonly buffer Layers { int layers[]; };
+
+// the level each body was drawn at last frame, -1 before its first
+layout(std430, binding = 2) buffer Levels { int levels[]; };
+
+// the bodies to draw, in the InstanceData layout of instances.h
+struct Instance
+{
+	mat4 model;
+	int  layer;
+	int  padding[3];
+};
+layout(std430, binding = 3) writeonly buffer Instances { Instance instances[]; };
+
+// the indirect draw commands, whose second word is the instance count
+layout(std430, binding = 4) buffer Commands { uint commands[]; };
+
+// the on-screen radius in pixels of a bounding sphere, as ScreenRadius
+float ScreenRadius(vec4 sphere)
+{
+	vec3 offset = sphere.xyz - cameraPosition.xyz;
+	float distanceSquared = dot(offset, offset);
+	float radiusSquared = sphere.w * sphere.w;
+	if (distanceSquared <= radiusSquared)
+		return 3.0e38;
+	return pixelsPerUnit * sphere.w / sqrt(distanceSquared - radiusSquared);
+}
+
+// true if the sphere was hidden everywhere it covers on screen by what was
+// drawn last frame; its bounding box is projected with the camera the depth
+// pyramid was built with, and at the level where it covers at most two by
+// two texels, four fetches give the farthest depth around it
+bool Occluded(vec4 sphere)
+{
+	if (occlusionSize.w == 0.0)
+		return false;
+
+	vec2 low = vec2(1.0), high = vec2(-1.0);
+	float nearest = 1.0;
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = occlusionViewProjection * vec4(sphere.xyz + sphere.w * corner, 1.0);
+
+		// reaching behind the camera, it cannot be bounded on screen
+		if (clip.w <= 0.0)
+			return false;
+		vec3 ndc = clip.xyz / clip.w;
+		low = min(low, ndc.xy);
+		high = max(high, ndc.xy);
+		nearest = min(nearest, ndc.z);
+	}
+	low = clamp(low * 0.5 + 0.5, 0.0, 1.0);
+	high = clamp(high * 0.5 + 0.5, 0.0, 1.0);
+
+	vec2 extent = (high - low) * occlusionSize.xy;
+	int level = int(min(ceil(log2(max(max(extent.x, extent.y), 1.0))), occlusionSize.z - 1.0));
+	ivec2 size = textureSize(depthPyramid, level);
+	ivec2 first = min(ivec2(low * vec2(size)), size - 1);
+	ivec2 last = min(ivec2(high * vec2(size)), size - 1);
+
+	float farthest = max(
+		max(texelFetch(depthPyramid, first, level).r, texelFetch(depthPyramid, ivec2(last.x, first.y), level).r),
+		max(texelFetch(depthPyramid, ivec2(first.x, last.y), level).r, texelFetch(depthPyramid, last, level).r));
+	return nearest * 0.5 + 0.5 > farthest;
+}
+
+// the level for a body of the given radius drawn at current, as SelectLOD
+int SelectLOD(float radius, int current)
+{
+	int target = lodCount - 1;
+	for (int i = 0; i < lodCount - 1; i++) {
+		if (radius <= lodRadii[i].x) {
+			target = i;
+			break;
+		}
+	}
+	if (current < 0 || current >= lodCount || target == current)
+		return target;
+
+	if (target > current && radius < lodRadii[current].x * (1.0 + hysteresis))
+		return current;
+	if (target < current && radius > lodRadii[target].x * (1.0 - hysteresis))
+		return current;
+	return target;
+}
+
+void main()
+{
+	int body = int(gl_GlobalInvocationID.x);
+	if (body >= bodyCount)
+		return;
+
+	// the mesh is a unit sphere; the longest axis bounds any scale
+	mat4 model = models[body];
+	float scale = max(max(length(model[0].xyz), length(model[1].xyz)), length(model[2].xyz));
+	vec4 sphere = vec4(model[3].xyz, scale);
+
+	for (int i = 0; i < 6; i++) {
+		if (dot(planes[i].xyz, sphere.xyz) + planes[i].w < -sphere.w)
+			return;
+	}
+	if (Occluded(sphere))
+		return;
+
+	int level = SelectLOD(ScreenRadius(sphere), levels[body]);
+	levels[body] = level;
+
+	uint slot = atomicAdd(commands[level * commandStride + 1], 1u);
+	Instance instance;
+	instance.model = model;
+	instance.layer = layers[body];
+	instance.padding[0] = instance.padding[1] = instance.padding[2] = 0;
+	instances[level * capacity + int(slot)] = instance;
+}
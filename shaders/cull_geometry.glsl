@@ -0,0 +1,31 @@
+// ==========================================================================
+// Geometry program keeping the bodies of one level of detail
+//
+// Run once per level; the bodies cull_vertex.glsl put at that level are
+// passed on, and transform feedback captures them in the InstanceData
+// layout of instances.h.
+// ==========================================================================
+#version 410
+
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+in mat4 bodyModel[];
+flat in int bodyLayer[];
+flat in int bodyLevel[];
+
+// the level this pass keeps
+uniform int level;
+
+out mat4 instanceModel;
+flat out int instanceLayer;
+
+void main()
+{
+	if (bodyLevel[0] != level)
+		return;
+
+	instanceModel = bodyModel[0];
+	instanceLayer = bodyLayer[0];
+	EmitVertex();
+}
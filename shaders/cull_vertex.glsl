@@ -0,0 +1,112 @@
+// ==========================================================================
+// Vertex program culling bodies for transform feedback
+//
+// The fallback for contexts without compute shaders: bodies arrive as
+// points, and each one's visibility and level of detail are worked out
+// here, without hysteresis, for cull_geometry.glsl to keep or drop.
+// ==========================================================================
+#version 410
+
+// the body, read the way instances.h lays instance attributes out, but one
+// per point
+layout(location = 4) in mat4 BodyModel;
+layout(location = 8) in int BodyLayer;
+
+// per-frame camera data, shared with every other program (see framedata.h)
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+};
+
+// culling parameters (see gpuculling.h)
+layout(std140) uniform CullData {
+	vec4  planes[6];
+	vec4  lodRadii[5];
+	float pixelsPerUnit;
+	float hysteresis;
+	int   bodyCount;
+	int   lodCount;
+	int   capacity;
+	int   commandStride;
+	mat4  occlusionViewProjection;
+	vec4  occlusionSize;
+};
+
+// last frame's farthest depths (see occlusion.h)
+uniform sampler2D depthPyramid;
+
+out mat4 bodyModel;
+flat out int bodyLayer;
+flat out int bodyLevel;
+
+// true if the sphere was hidden everywhere it covers on screen by what was
+// drawn last frame; its bounding box is projected with the camera the depth
+// pyramid was built with, and at the level where it covers at most two by
+// two texels, four fetches give the farthest depth around it
+bool Occluded(vec4 sphere)
+{
+	if (occlusionSize.w == 0.0)
+		return false;
+
+	vec2 low = vec2(1.0), high = vec2(-1.0);
+	float nearest = 1.0;
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = occlusionViewProjection * vec4(sphere.xyz + sphere.w * corner, 1.0);
+
+		// reaching behind the camera, it cannot be bounded on screen
+		if (clip.w <= 0.0)
+			return false;
+		vec3 ndc = clip.xyz / clip.w;
+		low = min(low, ndc.xy);
+		high = max(high, ndc.xy);
+		nearest = min(nearest, ndc.z);
+	}
+	low = clamp(low * 0.5 + 0.5, 0.0, 1.0);
+	high = clamp(high * 0.5 + 0.5, 0.0, 1.0);
+
+	vec2 extent = (high - low) * occlusionSize.xy;
+	int level = int(min(ceil(log2(max(max(extent.x, extent.y), 1.0))), occlusionSize.z - 1.0));
+	ivec2 size = textureSize(depthPyramid, level);
+	ivec2 first = min(ivec2(low * vec2(size)), size - 1);
+	ivec2 last = min(ivec2(high * vec2(size)), size - 1);
+
+	float farthest = max(
+		max(texelFetch(depthPyramid, first, level).r, texelFetch(depthPyramid, ivec2(last.x, first.y), level).r),
+		max(texelFetch(depthPyramid, ivec2(first.x, last.y), level).r, texelFetch(depthPyramid, last, level).r));
+	return nearest * 0.5 + 0.5 > farthest;
+}
+
+void main()
+{
+	bodyModel = BodyModel;
+	bodyLayer = BodyLayer;
+
+	// the mesh is a unit sphere; the longest axis bounds any scale
+	float scale = max(max(length(BodyModel[0].xyz), length(BodyModel[1].xyz)), length(BodyModel[2].xyz));
+	vec4 sphere = vec4(BodyModel[3].xyz, scale);
+
+	// -1 marks a body outside the frustum, or hidden
+	bodyLevel = lodCount - 1;
+	for (int i = 0; i < 6; i++) {
+		if (dot(planes[i].xyz, sphere.xyz) + planes[i].w < -sphere.w)
+			bodyLevel = -1;
+	}
+	if (bodyLevel >= 0 && Occluded(sphere))
+		bodyLevel = -1;
+
+	// the coarsest level that still covers the body's size on screen
+	vec3 offset = sphere.xyz - cameraPosition.xyz;
+	float distanceSquared = dot(offset, offset);
+	float radiusSquared = sphere.w * sphere.w;
+	if (bodyLevel >= 0 && distanceSquared > radiusSquared) {
+		float radius = pixelsPerUnit * sphere.w / sqrt(distanceSquared - radiusSquared);
+		for (int i = lodCount - 2; i >= 0; i--) {
+			if (radius <= lodRadii[i].x)
+				bodyLevel = i;
+		}
+	}
+}
@@ -0,0 +1,19 @@
+// ==========================================================================
+// Fragment program for single objects drawn with RenderScene
+// ==========================================================================
+#version 410
+
+// interpolated texture coordinates received from the vertex stage
+in vec2 textureCoords;
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+uniform vec3 Colour;
+uniform sampler2D s;
+
+void main(void)
+{
+	// textured objects are modulated by their colour; white leaves them as is
+	FragmentColour = texture(s, textureCoords) * vec4(Colour, 1.0);
+}
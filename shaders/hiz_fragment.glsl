@@ -0,0 +1,41 @@
+// ==========================================================================
+// Fragment program reducing one level of the depth pyramid
+//
+// Each output texel is the farthest depth of the source texels it covers:
+// two by two, or three along an edge where the source size is odd. Level 0
+// copies the depth buffer one to one.
+// ==========================================================================
+#version 410
+
+// the source, with only the level below visible
+uniform sampler2D s;
+
+// the level being written
+uniform int level;
+
+// first output is mapped to the framebuffer's colour index by default
+out float FragmentDepth;
+
+void main(void)
+{
+	ivec2 target = ivec2(gl_FragCoord.xy);
+	ivec2 size = textureSize(s, 0);
+	if (level == 0) {
+		FragmentDepth = texelFetch(s, target, 0).r;
+		return;
+	}
+
+	ivec2 first = target * 2;
+	ivec2 last = first + 1;
+	ivec2 outputSize = max(size / 2, ivec2(1));
+	if ((size.x & 1) != 0 && target.x == outputSize.x - 1) last.x++;
+	if ((size.y & 1) != 0 && target.y == outputSize.y - 1) last.y++;
+	last = min(last, size - 1);
+
+	float farthest = 0.0;
+	for (int y = first.y; y <= last.y; y++) {
+		for (int x = first.x; x <= last.x; x++)
+			farthest = max(farthest, texelFetch(s, ivec2(x, y), 0).r);
+	}
+	FragmentDepth = farthest;
+}
@@ -0,0 +1,74 @@
+// ==========================================================================
+// Fragment program for instanced sphere impostors, with bindless texture
+// handles
+//
+// Intersects the ray through each fragment of the quad with the sphere,
+// discards the misses, and writes the hit's own depth and the texture
+// coordinates the sphere mesh would have there, so an impostor is
+// indistinguishable from a very finely tessellated body.
+// ==========================================================================
+#version 410
+#extension GL_ARB_bindless_texture : require
+
+// lets neighbouring fragments of different bodies use different handles
+#extension GL_NV_gpu_shader5 : enable
+
+// the hit is always nearer than the quad it was found through
+#extension GL_ARB_conservative_depth : enable
+#ifdef GL_ARB_conservative_depth
+layout(depth_less) out float gl_FragDepth;
+#endif
+
+// per-frame camera data, shared with every other program (see framedata.h)
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+};
+
+in vec3 worldPosition;
+flat in vec4 sphere;
+flat in mat3 objectFromWorld;
+flat in int layer;
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+// every body's texture handle (see texturemanager.h)
+layout(std140) uniform TextureHandles {
+	uvec2 handles[64];
+};
+
+const float PI = 3.14159265358979;
+
+void main(void)
+{
+	vec3 origin = cameraPosition.xyz;
+	vec3 direction = normalize(worldPosition - origin);
+
+	// the nearer root of |origin + t*direction - centre| = radius
+	vec3 offset = origin - sphere.xyz;
+	float b = dot(direction, offset);
+	float c = dot(offset, offset) - sphere.w * sphere.w;
+	float discriminant = b * b - c;
+	if (discriminant < 0.0)
+		discard;
+	vec3 hit = origin + direction * (-b - sqrt(discriminant));
+
+	vec4 clip = viewProjection * vec4(hit, 1.0);
+	gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;
+
+	// the mesh's mapping: v runs from the +y pole, u around from +z towards
+	// +x. u is taken from whichever of two ranges has no seam between this
+	// fragment and its neighbours, so mipmapping does not see a jump
+	vec3 normal = normalize(objectFromWorld * (hit - sphere.xyz));
+	float turn = atan(normal.x, normal.z) / (2.0 * PI);
+	float u0 = fract(turn);
+	float u1 = fract(turn + 0.5) - 0.5;
+	float u = fwidth(u0) <= fwidth(u1) + 1e-6 ? u0 : u1;
+	vec2 textureCoords = vec2(u, acos(clamp(normal.y, -1.0, 1.0)) / PI);
+
+	FragmentColour = texture(sampler2D(handles[layer]), textureCoords);
+}
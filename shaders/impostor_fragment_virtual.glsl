@@ -0,0 +1,112 @@
+// ==========================================================================
+// Fragment program for instanced sphere impostors with virtual textures
+//
+// Intersects the ray through each fragment of the quad with the sphere,
+// discards the misses, and writes the hit's own depth and the texture
+// coordinates the sphere mesh would have there, so an impostor is
+// indistinguishable from a very finely tessellated body. The map is
+// sampled as in instanced_fragment_virtual.glsl.
+// ==========================================================================
+#version 410
+
+// the hit is always nearer than the quad it was found through
+#extension GL_ARB_conservative_depth : enable
+#ifdef GL_ARB_conservative_depth
+layout(depth_less) out float gl_FragDepth;
+#endif
+
+// per-frame camera data, shared with every other program (see framedata.h)
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+};
+
+in vec3 worldPosition;
+flat in vec4 sphere;
+flat in mat3 objectFromWorld;
+flat in int layer;
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+// the layout of the maps and their tiles (see virtualtexture.h)
+layout(std140) uniform VirtualTextureData {
+	vec4 layerSizes[8];
+	vec4 page;
+	vec4 options;
+};
+
+// the tile cache or sparse array, and where each tile is resident
+uniform sampler2DArray s;
+uniform usampler2DArray indirection;
+
+// the level of detail the hardware would pick for texel coordinates
+float MipLevel(vec2 texel)
+{
+	vec2 dx = dFdx(texel), dy = dFdy(texel);
+	return 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+}
+
+// the tile under uv at a level of a map, clamped to the map
+ivec2 TileAt(vec2 uv, vec2 size, float level)
+{
+	vec2 levelSize = max(floor(size / exp2(level)), vec2(1.0));
+	return min(ivec2(uv * levelSize / page.x), ivec2(ceil(levelSize / page.x)) - 1);
+}
+
+vec4 VirtualTexture(vec2 uv, int map)
+{
+	vec3 size = layerSizes[map].xyz;
+	float lod = clamp(MipLevel(uv * size.xy), 0.0, size.z - 1.0);
+	uv = vec2(fract(uv.x), clamp(uv.y, 0.0, 1.0));
+
+	uvec4 entry = texelFetch(indirection, ivec3(TileAt(uv, size.xy, floor(lod)), map), int(lod));
+	float resident = float(entry.z);
+
+	// a sparse array is sampled in place, no finer than what is resident
+	if (options.x > 0.5)
+		return textureLod(s, vec3(uv * size.xy / options.zw, map), max(lod, resident));
+
+	// a cache page holds its tile inside a border, so bilinear filtering
+	// never reaches the neighbouring page
+	vec2 levelSize = max(floor(size.xy / exp2(resident)), vec2(1.0));
+	vec2 texel = uv * levelSize;
+	vec2 within = texel - vec2(TileAt(uv, size.xy, resident)) * page.x;
+	vec2 physical = (vec2(entry.xy) * page.z + page.y + within) / page.w;
+	return textureLod(s, vec3(physical, 0.0), 0.0);
+}
+
+const float PI = 3.14159265358979;
+
+void main(void)
+{
+	vec3 origin = cameraPosition.xyz;
+	vec3 direction = normalize(worldPosition - origin);
+
+	// the nearer root of |origin + t*direction - centre| = radius
+	vec3 offset = origin - sphere.xyz;
+	float b = dot(direction, offset);
+	float c = dot(offset, offset) - sphere.w * sphere.w;
+	float discriminant = b * b - c;
+	if (discriminant < 0.0)
+		discard;
+	vec3 hit = origin + direction * (-b - sqrt(discriminant));
+
+	vec4 clip = viewProjection * vec4(hit, 1.0);
+	gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;
+
+	// the mesh's mapping: v runs from the +y pole, u around from +z towards
+	// +x. u is taken from whichever of two ranges has no seam between this
+	// fragment and its neighbours, so mipmapping does not see a jump
+	vec3 normal = normalize(objectFromWorld * (hit - sphere.xyz));
+	float turn = atan(normal.x, normal.z) / (2.0 * PI);
+	float u0 = fract(turn);
+	float u1 = fract(turn + 0.5) - 0.5;
+	float u = fwidth(u0) <= fwidth(u1) + 1e-6 ? u0 : u1;
+	vec2 textureCoords = vec2(u, acos(clamp(normal.y, -1.0, 1.0)) / PI);
+
+	FragmentColour = VirtualTexture(textureCoords, layer);
+}
@@ -0,0 +1,57 @@
+// ==========================================================================
+// Vertex program for instanced sphere impostors
+//
+// A body too small on screen to be worth a mesh is drawn as one quad facing
+// the camera, a four vertex triangle strip with no vertex data; the
+// fragment shader ray casts the sphere inside it. The quad sits in the plane
+// through the centre and is sized to the cone of rays that touch the
+// sphere, so it covers the silhouette exactly at any distance.
+// ==========================================================================
+#version 410
+
+// the instance attributes of instances.h; the mesh attributes are unused
+layout(location = 4) in mat4 InstanceModel;
+layout(location = 8) in int InstanceLayer;
+
+// per-frame camera data, shared with every other program (see framedata.h)
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+};
+
+// where on the quad, in world coordinates, and the sphere it stands for
+out vec3 worldPosition;
+flat out vec4 sphere;
+
+// turns world directions into the unit sphere's, for texture coordinates
+flat out mat3 objectFromWorld;
+flat out int layer;
+
+void main()
+{
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+
+	// bodies are only ever scaled uniformly, so any axis gives the radius
+	vec3 centre = InstanceModel[3].xyz;
+	float radius = length(InstanceModel[0].xyz);
+
+	// the quad faces the camera itself, not just its view direction
+	vec3 toCamera = cameraPosition.xyz - centre;
+	float distance = length(toCamera);
+	toCamera /= distance;
+	vec3 right = normalize(cross(vec3(view[0][1], view[1][1], view[2][1]), toCamera));
+	vec3 up = cross(toCamera, right);
+
+	// the tangent cone's radius where it crosses the centre's plane
+	float size = radius * distance / sqrt(max(distance * distance - radius * radius, 1e-6));
+
+	worldPosition = centre + (right * corner.x + up * corner.y) * size;
+	gl_Position = viewProjection * vec4(worldPosition, 1.0);
+
+	sphere = vec4(centre, radius);
+	objectFromWorld = transpose(mat3(InstanceModel) / radius);
+	layer = InstanceLayer;
+}
@@ -0,0 +1,19 @@
+// ==========================================================================
+// Fragment program for instanced bodies
+// ==========================================================================
+#version 410
+
+// interpolated texture coordinates received from the vertex stage
+in vec2 textureCoords;
+flat in int layer;
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+// every body's texture, one layer each (see texturemanager.h)
+uniform sampler2DArray s;
+
+void main(void)
+{
+	FragmentColour = texture(s, vec3(textureCoords, layer));
+}
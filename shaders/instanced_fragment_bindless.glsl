@@ -0,0 +1,25 @@
+// ==========================================================================
+// Fragment program for instanced bodies, with bindless texture handles
+// ==========================================================================
+#version 410
+#extension GL_ARB_bindless_texture : require
+
+// lets neighbouring fragments of different bodies use different handles
+#extension GL_NV_gpu_shader5 : enable
+
+// interpolated texture coordinates received from the vertex stage
+in vec2 textureCoords;
+flat in int layer;
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+// every body's texture handle (see texturemanager.h)
+layout(std140) uniform TextureHandles {
+	uvec2 handles[64];
+};
+
+void main(void)
+{
+	FragmentColour = texture(sampler2D(handles[layer]), textureCoords);
+}
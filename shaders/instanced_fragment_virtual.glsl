@@ -0,0 +1,67 @@
+// ==========================================================================
+// Fragment program for instanced bodies with virtual textures
+//
+// Samples each body's map through the tile indirection of virtualtexture.h:
+// the level the hardware would pick is found from the derivatives, and the
+// finest resident ancestor of the tile under the fragment is sampled there.
+// ==========================================================================
+#version 410
+
+// interpolated texture coordinates received from the vertex stage
+in vec2 textureCoords;
+flat in int layer;
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+// the layout of the maps and their tiles (see virtualtexture.h)
+layout(std140) uniform VirtualTextureData {
+	vec4 layerSizes[8];
+	vec4 page;
+	vec4 options;
+};
+
+// the tile cache or sparse array, and where each tile is resident
+uniform sampler2DArray s;
+uniform usampler2DArray indirection;
+
+// the level of detail the hardware would pick for texel coordinates
+float MipLevel(vec2 texel)
+{
+	vec2 dx = dFdx(texel), dy = dFdy(texel);
+	return 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+}
+
+// the tile under uv at a level of a map, clamped to the map
+ivec2 TileAt(vec2 uv, vec2 size, float level)
+{
+	vec2 levelSize = max(floor(size / exp2(level)), vec2(1.0));
+	return min(ivec2(uv * levelSize / page.x), ivec2(ceil(levelSize / page.x)) - 1);
+}
+
+vec4 VirtualTexture(vec2 uv, int map)
+{
+	vec3 size = layerSizes[map].xyz;
+	float lod = clamp(MipLevel(uv * size.xy), 0.0, size.z - 1.0);
+	uv = vec2(fract(uv.x), clamp(uv.y, 0.0, 1.0));
+
+	uvec4 entry = texelFetch(indirection, ivec3(TileAt(uv, size.xy, floor(lod)), map), int(lod));
+	float resident = float(entry.z);
+
+	// a sparse array is sampled in place, no finer than what is resident
+	if (options.x > 0.5)
+		return textureLod(s, vec3(uv * size.xy / options.zw, map), max(lod, resident));
+
+	// a cache page holds its tile inside a border, so bilinear filtering
+	// never reaches the neighbouring page
+	vec2 levelSize = max(floor(size.xy / exp2(resident)), vec2(1.0));
+	vec2 texel = uv * levelSize;
+	vec2 within = texel - vec2(TileAt(uv, size.xy, resident)) * page.x;
+	vec2 physical = (vec2(entry.xy) * page.z + page.y + within) / page.w;
+	return textureLod(s, vec3(physical, 0.0), 0.0);
+}
+
+void main(void)
+{
+	FragmentColour = VirtualTexture(textureCoords, layer);
+}
@@ -0,0 +1,53 @@
+// ==========================================================================
+// Vertex program for instanced bodies
+//
+// Every body is an instance of the same sphere; its model matrix and the
+// texture it samples arrive as per-instance attributes.
+// ==========================================================================
+#version 410
+
+// location indices for these attributes correspond to those specified in the
+// vertex layout (see vertexformat.h) and InitializeInstances function of the
+// application
+layout(location = 0) in vec3 VertexPosition;
+layout(location = 1) in vec2 VertexTexture;
+layout(location = 2) in vec2 VertexNormal;
+layout(location = 4) in mat4 InstanceModel;
+layout(location = 8) in int InstanceLayer;
+
+// per-frame camera data, shared with every other program (see framedata.h)
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+};
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec2 textureCoords;
+out vec3 normal;
+flat out int layer;
+
+// unit normal from its octahedral encoding, the inverse of OctahedralEncode
+vec3 OctahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+void main()
+{
+	// assign vertex position without modification
+	gl_Position = viewProjection * InstanceModel * vec4(VertexPosition, 1.0);
+
+	// bodies are only ever scaled uniformly, so the model matrix turns
+	// normals the same way it turns positions
+	normal = normalize(mat3(InstanceModel) * OctahedralDecode(VertexNormal));
+
+	// pass the texture coordinates and layer through to the fragment shader
+	textureCoords = VertexTexture;
+	layer = InstanceLayer;
+}
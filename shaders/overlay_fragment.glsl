@@ -0,0 +1,14 @@
+// ==========================================================================
+// Fragment program for flat overlay rectangles
+// ==========================================================================
+#version 410
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+uniform vec3 Colour;
+
+void main(void)
+{
+	FragmentColour = vec4(Colour, 1.0);
+}
@@ -0,0 +1,16 @@
+// ==========================================================================
+// Vertex program for flat overlay rectangles
+//
+// Draws a rectangle as a four vertex triangle strip with no vertex data;
+// the corners come from gl_VertexID.
+// ==========================================================================
+#version 410
+
+// lower left corner and size, in normalized device coordinates
+uniform vec4 rect;
+
+void main()
+{
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	gl_Position = vec4(rect.xy + corner * rect.zw, 0.0, 1.0);
+}
@@ -0,0 +1,87 @@
+// ==========================================================================
+// Vertex program for instanced bodies drawn without any vertex buffers
+//
+// The sphere is generated from gl_VertexID alone: tessellation holds the
+// columns and rings of the level being drawn, and the vertices of a draw of
+// 3 * columns * (2*rings - 2) walk its triangles in the same order, and with
+// the same winding, as generateIndexedSphere's indices. The ring touching
+// each pole has one triangle per cell, every other ring two.
+// ==========================================================================
+#version 410
+
+// location indices for these attributes correspond to those specified in the
+// InitializeInstances function of the application
+layout(location = 4) in mat4 InstanceModel;
+layout(location = 8) in int InstanceLayer;
+
+// per-frame camera data, shared with every other program (see framedata.h)
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+};
+
+// columns and rings of the sphere
+uniform ivec2 tessellation;
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec2 textureCoords;
+out vec3 normal;
+flat out int layer;
+
+const float PI = 3.14159265358979;
+
+void main()
+{
+	int columns = tessellation.x;
+	int rings = tessellation.y;
+
+	// find the cell and which of its triangles this vertex belongs to
+	int triangle = gl_VertexID / 3;
+	int corner = gl_VertexID - 3*triangle;
+	int ring, column;
+	bool lower;
+	int middle = 2 * columns * (rings - 2);
+	if (triangle < columns) {
+		ring = 0;
+		column = triangle;
+		lower = true;
+	}
+	else if (triangle - columns < middle) {
+		int t = triangle - columns;
+		ring = 1 + t / (2*columns);
+		int cell = t - (ring - 1) * 2*columns;
+		column = cell / 2;
+		lower = (cell & 1) == 1;
+	}
+	else {
+		ring = rings - 1;
+		column = triangle - columns - middle;
+		lower = false;
+	}
+
+	// the upper triangle is top left, top right, bottom right; the lower
+	// one top left, bottom left, bottom right
+	ivec2 offset = corner == 0 ? ivec2(0, 0)
+		: corner == 2 ? ivec2(1, 1)
+		: lower ? ivec2(1, 0) : ivec2(0, 1);
+	int i = ring + offset.x;
+	int j = column + offset.y;
+
+	// the seam column shares the first column's position, so the sphere
+	// closes without a crack, but keeps u = 1
+	float phi = PI * float(i) / float(rings);
+	float theta = 2.0 * PI * float(j == columns ? 0 : j) / float(columns);
+	vec3 position = vec3(sin(phi) * sin(theta), cos(phi), sin(phi) * cos(theta));
+
+	gl_Position = viewProjection * InstanceModel * vec4(position, 1.0);
+
+	// bodies are only ever scaled uniformly, so the model matrix turns
+	// normals the same way it turns positions
+	normal = normalize(mat3(InstanceModel) * position);
+
+	textureCoords = vec2(float(j) / float(columns), float(i) / float(rings));
+	layer = InstanceLayer;
+}
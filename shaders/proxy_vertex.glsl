@@ -0,0 +1,28 @@
+// ==========================================================================
+// Vertex program for occlusion proxy boxes
+//
+// Draws the box about a bounding sphere as a fourteen vertex triangle strip
+// with no vertex data; the bits of the three masks pick each corner from
+// gl_VertexID.
+// ==========================================================================
+#version 410
+
+// per-frame camera data, shared with every other program (see framedata.h)
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+};
+
+// centre and radius, in world coordinates
+uniform vec4 sphere;
+
+void main()
+{
+	int bit = 1 << gl_VertexID;
+	vec3 corner = vec3((0x287a & bit) != 0, (0x02af & bit) != 0, (0x31e3 & bit) != 0);
+	vec3 position = sphere.xyz + sphere.w * (corner * 2.0 - 1.0);
+	gl_Position = viewProjection * vec4(position, 1.0);
+}
@@ -0,0 +1,40 @@
+// ==========================================================================
+// Fragment program stretching a dynamic resolution frame over the window
+//
+// Samples what was drawn bilinearly, never closer than half a texel to the
+// edge of the part drawn this frame, since the rest of the target is stale,
+// then sharpens against the four neighbouring texels to win back some of
+// the detail the stretch blurs.
+// ==========================================================================
+#version 410
+
+// the frame, drawn into the lower left corner
+uniform sampler2D s;
+
+// the size drawn, and the size of the window
+uniform vec4 source;
+
+// 0 for a plain bilinear stretch
+uniform float sharpness;
+
+// first output is mapped to the framebuffer's colour index by default
+out vec4 FragmentColour;
+
+vec3 Fetch(vec2 position)
+{
+	vec2 clamped = clamp(position, vec2(0.5), source.xy - 0.5);
+	return texture(s, clamped / vec2(textureSize(s, 0))).rgb;
+}
+
+void main(void)
+{
+	vec2 position = gl_FragCoord.xy / source.zw * source.xy;
+	vec3 colour = Fetch(position);
+
+	if (sharpness > 0.0) {
+		vec3 neighbours = Fetch(position + vec2(1.0, 0.0)) + Fetch(position - vec2(1.0, 0.0))
+			+ Fetch(position + vec2(0.0, 1.0)) + Fetch(position - vec2(0.0, 1.0));
+		colour = clamp(colour + sharpness * (colour - 0.25 * neighbours), 0.0, 1.0);
+	}
+	FragmentColour = vec4(colour, 1.0);
+}
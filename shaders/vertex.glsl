@@ -0,0 +1,33 @@
+// ==========================================================================
+// Vertex program for single objects drawn with RenderScene
+// ==========================================================================
+#version 410
+
+// location indices for these attributes correspond to those specified in the
+// vertex layout of the application (see vertexformat.h)
+layout(location = 0) in vec3 VertexPosition;
+layout(location = 1) in vec2 VertexTexture;
+
+// per-frame camera data, shared with every other program (see framedata.h)
+layout(std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPosition;
+	float time;
+};
+
+// model matrix of the object being drawn
+uniform mat4 translation;
+
+// output to be interpolated between vertices and passed to the fragment stage
+out vec2 textureCoords;
+
+void main()
+{
+	// transform the vertex from model to clip space
+	gl_Position = viewProjection * translation * vec4(VertexPosition, 1.0);
+
+	// pass the texture coordinates through to the fragment shader
+	textureCoords = VertexTexture;
+}
@@ -0,0 +1,45 @@
+// ==========================================================================
+// Fragment program for the virtual texture feedback pass
+//
+// Drawn at a fraction of the window's resolution with the bodies' vertex
+// program, and writes the tile and level each fragment would sample, with
+// the layer plus one so that 0 is left for the background. The level of
+// detail is biased by the pass's scale, so it matches the full-size frame.
+// ==========================================================================
+#version 410
+
+// interpolated texture coordinates received from the vertex stage
+in vec2 textureCoords;
+flat in int layer;
+
+// tile x and y, level, and layer + 1
+out uvec4 FeedbackTile;
+
+// the layout of the maps and their tiles (see virtualtexture.h)
+layout(std140) uniform VirtualTextureData {
+	vec4 layerSizes[8];
+	vec4 page;
+	vec4 options;
+};
+
+// the level of detail the hardware would pick for texel coordinates
+float MipLevel(vec2 texel)
+{
+	vec2 dx = dFdx(texel), dy = dFdy(texel);
+	return 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+}
+
+// the tile under uv at a level of a map, clamped to the map
+ivec2 TileAt(vec2 uv, vec2 size, float level)
+{
+	vec2 levelSize = max(floor(size / exp2(level)), vec2(1.0));
+	return min(ivec2(uv * levelSize / page.x), ivec2(ceil(levelSize / page.x)) - 1);
+}
+
+void main(void)
+{
+	vec3 size = layerSizes[layer].xyz;
+	float level = floor(clamp(MipLevel(textureCoords * size.xy) + options.y, 0.0, size.z - 1.0));
+	vec2 uv = vec2(fract(textureCoords.x), clamp(textureCoords.y, 0.0, 1.0));
+	FeedbackTile = uvec4(uvec2(TileAt(uv, size.xy, level)), uint(level), uint(layer + 1));
+}
@@ -0,0 +1,138 @@
+// ==========================================================================
+// Sphere meshes
+// ==========================================================================
+
+#include "spheremesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+const float SPHERE_LOD_INTERVALS[LOD_LEVELS] = { 30.f, 20.f, 10.f, 5.f, 2.5f };
+
+// sine and cosine of count+1 evenly spaced angles from 0 to range degrees,
+// so a sphere evaluates each once rather than once per vertex; the last
+// angle is made to repeat the first exactly when range is a full turn, so
+// the seam closes without a crack
+void angleTable(float range, int count, vector<vec2> &table)
+{
+	table.resize(count + 1);
+	for (int i = 0; i <= count; i++) {
+		float angle = radians(range*i/count);
+		table[i] = vec2(sin(angle), cos(angle));
+	}
+	if (range == 360.f)
+		table[count] = table[0];
+}
+
+// how many vertices and indices generateIndexedSphere writes for interval
+void indexedSphereSize(float interval, int *vertexCount, int *indexCount)
+{
+	int rings = int(180.f/interval + 0.5f);
+	int columns = int(360.f/interval + 0.5f);
+
+	// the cells touching a pole have one triangle, every other cell two
+	*vertexCount = (rings + 1) * (columns + 1);
+	*indexCount = rings > 1 ? 3 * columns * (2*rings - 2) : 0;
+}
+
+// build a sphere that shares one vertex between all the triangles touching
+// it, and an index list stitching neighbouring rings together. Each ring
+// repeats its first vertex at theta = 360 so the texture seam gets its own
+// u = 1 texture coordinates, and each pole gets one vertex per column so
+// every triangle meeting it samples the right part of the map. The arrays
+// must hold as many elements as indexedSphereSize asks for; indices count
+// from the sphere's first vertex.
+void generateIndexedSphere(float radius, float interval, vec3 *vertices, vec3 *normals,
+	vec2 *texCoords, GLuint *indices)
+{
+	int rings = int(180.f/interval + 0.5f);
+	int columns = int(360.f/interval + 0.5f);
+
+	vector<vec2> phiTable, thetaTable;
+	angleTable(180.f, rings, phiTable);
+	angleTable(360.f, columns, thetaTable);
+
+	// rings+1 latitudes by columns+1 longitudes, the last one being the seam
+	for (int i = 0; i <= rings; i++) {
+		float r = phiTable[i].x;
+		float y = phiTable[i].y;
+		float v = float(i)/rings;
+
+		// the unit normal, scaled to the radius, is the position
+		for (int j = 0; j <= columns; j++) {
+			vec3 normal = vec3(r*thetaTable[j].x, y, r*thetaTable[j].y);
+			*vertices++ = normal * radius;
+			*normals++ = normal;
+			*texCoords++ = vec2(float(j)/columns, v);
+		}
+	}
+
+	// two triangles per cell, top-left, top-right, bottom-right and then
+	// top-left, bottom-left, bottom-right; the cells touching a pole
+	// collapse one of them, so it is left out
+	GLuint stride = columns + 1;
+	for (int i = 0; i < rings; i++) {
+		for (int j = 0; j < columns; j++) {
+			GLuint topLeft = i*stride + j;
+			GLuint topRight = topLeft + 1;
+			GLuint bottomLeft = topLeft + stride;
+			GLuint bottomRight = bottomLeft + 1;
+
+			if (i != 0) {
+				*indices++ = topLeft;
+				*indices++ = topRight;
+				*indices++ = bottomRight;
+			}
+			if (i != rings-1) {
+				*indices++ = topLeft;
+				*indices++ = bottomLeft;
+				*indices++ = bottomRight;
+			}
+		}
+	}
+}
+
+// Every level is sized first, so the whole chain is packed in place into one
+// interleaved buffer; each level is generated into scratch streams big
+// enough for the largest, then packed behind the one before it.
+void BuildSphereChain(const float *intervals, int levels, const VertexLayout *layout,
+	vector<unsigned char> *vertices, vector<GLuint> *indices, LODChain *chain)
+{
+	int levelVertexCounts[LOD_LEVELS], levelIndexCounts[LOD_LEVELS];
+	int vertexTotal = 0, indexTotal = 0, levelVertexMax = 0;
+	levels = std::min(levels, LOD_LEVELS);
+	for (int i = 0; i < levels; i++) {
+		indexedSphereSize(intervals[i], &levelVertexCounts[i], &levelIndexCounts[i]);
+		vertexTotal += levelVertexCounts[i];
+		indexTotal += levelIndexCounts[i];
+		levelVertexMax = std::max(levelVertexMax, levelVertexCounts[i]);
+	}
+	if (!layout)
+		vertexTotal = indexTotal = levelVertexMax = 0;
+
+	vertices->assign(layout ? size_t(vertexTotal) * layout->stride : 0, 0);
+	indices->assign(indexTotal, 0);
+	vector<vec3> levelPositions(levelVertexMax), levelNormals(levelVertexMax);
+	vector<vec2> levelTexCoords(levelVertexMax);
+	for (int i = 0, firstVertex = 0, firstIndex = 0; i < levels; i++) {
+		// the equator has one edge per column
+		int columns = int(360.f/intervals[i] + 0.5f);
+		int rings = int(180.f/intervals[i] + 0.5f);
+		float maxRadius = columns * SPHERE_LOD_EDGE_PIXELS / (2.f*3.14159265359f);
+		if (!layout) {
+			AddLOD(chain, 0, levelIndexCounts[i], 0, maxRadius, columns, rings);
+			continue;
+		}
+
+		generateIndexedSphere(1.f, intervals[i], &levelPositions[0], &levelNormals[0], &levelTexCoords[0], &(*indices)[firstIndex]);
+		PackVertices(layout, &levelPositions[0], &levelNormals[0], &levelTexCoords[0], levelVertexCounts[i],
+			&(*vertices)[size_t(firstVertex) * layout->stride]);
+		AddLOD(chain, firstIndex, levelIndexCounts[i], firstVertex, maxRadius, columns, rings);
+
+		firstVertex += levelVertexCounts[i];
+		firstIndex += levelIndexCounts[i];
+	}
+}
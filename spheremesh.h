@@ -0,0 +1,44 @@
+// ==========================================================================
+// Sphere meshes
+//
+// The unit sphere every body is drawn from, generated at several
+// tessellations and packed into one level-of-detail chain. The application
+// builds it at startup and tools/packassets.cpp builds the same chain ahead
+// of time for the asset pack, so both share this code.
+// ==========================================================================
+#ifndef SPHEREMESH_H
+#define SPHEREMESH_H
+
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "lod.h"
+#include "vertexformat.h"
+
+// each level is used up to the size at which its edges would grow longer
+// than this many pixels on screen
+#define SPHERE_LOD_EDGE_PIXELS 8.f
+
+// the degrees per step of the default chain's levels, coarsest first
+extern const float SPHERE_LOD_INTERVALS[LOD_LEVELS];
+
+// sine and cosine of count+1 evenly spaced angles from 0 to range degrees
+void angleTable(float range, int count, std::vector<glm::vec2> &table);
+
+// how many vertices and indices generateIndexedSphere writes for interval
+void indexedSphereSize(float interval, int *vertexCount, int *indexCount);
+
+// a sphere of the given radius sharing its vertices between triangles; the
+// arrays must hold as many elements as indexedSphereSize asks for
+void generateIndexedSphere(float radius, float interval, glm::vec3 *vertices, glm::vec3 *normals,
+	glm::vec2 *texCoords, GLuint *indices);
+
+// appends a unit sphere level for each of levels intervals to chain, and
+// packs them one behind the other into vertices, in layout, and indices;
+// with a null layout the spheres are generated in the vertex shader, so
+// only the chain is filled in
+void BuildSphereChain(const float *intervals, int levels, const VertexLayout *layout,
+	std::vector<unsigned char> *vertices, std::vector<GLuint> *indices, LODChain *chain);
+
+#endif
@@ -0,0 +1,244 @@
+// ==========================================================================
+// Asynchronous texture loading
+// ==========================================================================
+
+#include "textureloader.h"
+#include "gldebug.h"
+#include "stb_image.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+TextureLoader::TextureLoader() : jobs(0), placeholder(0), nextPixelBuffer(0), uploadBudget(16 << 20)
+{
+	for (int i = 0; i < TEXTURELOADER_PIXEL_BUFFERS; i++) {
+		pixelBuffers[i] = 0;
+		pixelBuffersBusy[i] = false;
+	}
+}
+
+bool InitializeTextureLoader(TextureLoader *loader, JobSystem *jobs)
+{
+	loader->jobs = jobs;
+
+	// a single mid grey texel reads as an untextured body
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+	glGenTextures(1, &loader->placeholder);
+	glBindTexture(GL_TEXTURE_2D, loader->placeholder);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenBuffers(TEXTURELOADER_PIXEL_BUFFERS, loader->pixelBuffers);
+
+	return !CheckGLErrors();
+}
+
+void LoadTextureAsync(TextureLoader *loader, MyTexture *texture, const char *filename)
+{
+	texture->textureID = loader->placeholder;
+	texture->target = GL_TEXTURE_2D;
+	texture->width = texture->height = 1;
+
+	TextureRequest *request = new TextureRequest;
+	request->texture = texture;
+	request->filename = filename;
+	request->compressedFilename = IsCompressedTextureFile(filename) ? request->filename : FindCompressedVersion(filename);
+	loader->pending.push_back(request);
+
+	// decoding only touches the request, never OpenGL
+	SubmitJob(loader->jobs, &loader->decodes, [request]() {
+		if (!request->compressedFilename.empty()) {
+			CompressedImage &image = request->compressed;
+			if (ReadCompressedImage(request->compressedFilename, &image) && CompressedFormatSupported(image.format)) {
+				request->width = image.width;
+				request->height = image.height;
+				request->decoded = true;
+				return;
+			}
+			image = CompressedImage();
+			if (request->compressedFilename == request->filename) {
+				request->decoded = true;
+				return;
+			}
+		}
+
+		int components;
+		request->pixels = stbi_load(request->filename.c_str(), &request->width, &request->height, &components, 4);
+		if (!request->pixels)
+			cout << "ERROR: could not decode texture " << request->filename << endl;
+		request->decoded = true;
+	});
+}
+
+// bytes the request's image takes, and where they are
+static GLsizeiptr ImageSize(const TextureRequest *request)
+{
+	if (request->compressed.format != GL_NONE)
+		return GLsizeiptr(request->compressed.data.size());
+	return GLsizeiptr(request->width) * request->height * 4;
+}
+
+static const void *ImageData(const TextureRequest *request)
+{
+	if (request->compressed.format != GL_NONE)
+		return &request->compressed.data[0];
+	return request->pixels;
+}
+
+// maps the next pixel buffer, if it is free, and has a job copy the image
+// into it; returns false when none was free. If the buffer cannot be
+// mapped the request is left to upload from its own memory
+static bool StageTexture(TextureLoader *loader, TextureRequest *request)
+{
+	int index = loader->nextPixelBuffer;
+	if (loader->pixelBuffersBusy[index]) return false;
+	loader->nextPixelBuffer = (index + 1) % TEXTURELOADER_PIXEL_BUFFERS;
+
+	// fresh storage, so we never wait for the driver to finish reading the
+	// last image out of this buffer
+	GLsizeiptr size = ImageSize(request);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader->pixelBuffers[index]);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_STREAM_DRAW);
+	void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (!mapped) {
+		request->copied = true;
+		return true;
+	}
+
+	// the buffer stays mapped, and so unusable by OpenGL, until the copy
+	// is done and the upload unmaps it
+	loader->pixelBuffersBusy[index] = true;
+	request->pixelBuffer = loader->pixelBuffers[index];
+	request->mapped = mapped;
+	SubmitJob(loader->jobs, &loader->copies, [request, size]() {
+		memcpy(request->mapped, ImageData(request), size);
+		request->copied = true;
+	});
+	return true;
+}
+
+// unmaps the request's pixel buffer, uploads the image from it into a new
+// texture, and hands that texture to the request's MyTexture
+static void UploadTexture(TextureLoader *loader, TextureRequest *request)
+{
+	bool compressed = request->compressed.format != GL_NONE;
+
+	// an unmap can fail if the buffer's memory was lost meanwhile, in which
+	// case the image goes up from the request's own copy instead
+	bool fromBuffer = false;
+	if (request->pixelBuffer) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request->pixelBuffer);
+		fromBuffer = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+		if (!fromBuffer) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		for (int i = 0; i < TEXTURELOADER_PIXEL_BUFFERS; i++)
+			if (loader->pixelBuffers[i] == request->pixelBuffer) loader->pixelBuffersBusy[i] = false;
+		request->pixelBuffer = 0;
+		request->mapped = 0;
+	}
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	// with a pixel buffer bound the data pointer is an offset into it, and
+	// the copy into the texture happens without the CPU having to wait
+	if (compressed) {
+		UploadCompressedImage(&request->compressed, fromBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	} else {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, request->width, request->height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+			fromBuffer ? 0 : request->pixels);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	MyTexture *target = request->texture;
+	target->textureID = texture;
+	target->target = GL_TEXTURE_2D;
+	target->width = request->width;
+	target->height = request->height;
+	if (compressed && loader->compressedUploaded)
+		loader->compressedUploaded(target, &request->compressed);
+}
+
+size_t UpdateTextureLoader(TextureLoader *loader)
+{
+	size_t uploaded = 0;
+	for (size_t i = 0; i < loader->pending.size(); ) {
+		TextureRequest *request = loader->pending[i];
+		if (!request->decoded) {
+			i++;
+			continue;
+		}
+
+		// a file that failed to decode keeps showing the placeholder
+		bool failed = request->compressed.format == GL_NONE && !request->pixels;
+		if (!failed && !request->copied) {
+			// a request only waits on its copy once it has a buffer
+			if (!request->mapped) StageTexture(loader, request);
+			i++;
+			continue;
+		}
+		if (!failed) {
+			if (uploaded > 0 && uploaded >= loader->uploadBudget) {
+				i++;
+				continue;
+			}
+			UploadTexture(loader, request);
+			uploaded += size_t(ImageSize(request));
+		}
+
+		if (request->pixels) stbi_image_free(request->pixels);
+		delete request;
+		loader->pending.erase(loader->pending.begin() + i);
+	}
+
+	if (uploaded > 0) CheckGLErrors();
+	return loader->pending.size();
+}
+
+void FinishTextureLoader(TextureLoader *loader)
+{
+	WaitForJobs(loader->jobs, &loader->decodes);
+
+	// each pass stages what the free buffers allow and uploads what was
+	// copied in the pass before
+	size_t budget = loader->uploadBudget;
+	loader->uploadBudget = ~size_t(0);
+	while (UpdateTextureLoader(loader) > 0)
+		WaitForJobs(loader->jobs, &loader->copies);
+	loader->uploadBudget = budget;
+}
+
+void DestroyTextureLoader(TextureLoader *loader)
+{
+	WaitForJobs(loader->jobs, &loader->decodes);
+	WaitForJobs(loader->jobs, &loader->copies);
+	for (size_t i = 0; i < loader->pending.size(); i++) {
+		TextureRequest *request = loader->pending[i];
+		if (request->mapped) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request->pixelBuffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		if (request->pixels) stbi_image_free(request->pixels);
+		delete request;
+	}
+	loader->pending.clear();
+
+	glDeleteBuffers(TEXTURELOADER_PIXEL_BUFFERS, loader->pixelBuffers);
+	glDeleteTextures(1, &loader->placeholder);
+	loader->placeholder = 0;
+}
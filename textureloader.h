@@ -0,0 +1,103 @@
+// ==========================================================================
+// Asynchronous texture loading
+//
+// LoadTextureAsync returns straight away, leaving the MyTexture pointing at
+// a small grey placeholder so it can be bound and drawn with immediately.
+// The image is decoded on the job system; UpdateTextureLoader, called once
+// per frame on the thread that owns the OpenGL context, then maps a pixel
+// buffer object for each decoded image and has another job copy the image
+// into it. A later call, once that copy is done, unmaps the buffer, uploads
+// from it and swaps the finished texture into the MyTexture, so the render
+// thread never copies the pixels itself. Uploads are spread over frames so
+// a dozen large maps finishing together do not stall a single one.
+// ==========================================================================
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+#include "texture.h"
+#include "compressedtexture.h"
+#include "jobs.h"
+
+#define TEXTURELOADER_PIXEL_BUFFERS 2
+
+struct TextureRequest
+{
+	// the texture to fill in, and where from
+	MyTexture   *texture;
+	std::string  filename;
+
+	// the pre-compressed version to try first, if any
+	std::string  compressedFilename;
+
+	// written by the decoding job, read once it has finished: either pixels
+	// or, when compressed.format is set, a compressed image
+	unsigned char  *pixels;
+	int             width;
+	int             height;
+	CompressedImage compressed;
+	std::atomic<bool> decoded;
+
+	// the pixel buffer a job is copying the image into, mapped at mapped,
+	// and set once the copy is done
+	GLuint pixelBuffer;
+	void  *mapped;
+	std::atomic<bool> copied;
+
+	TextureRequest() : texture(0), pixels(0), width(0), height(0), decoded(false), pixelBuffer(0), mapped(0),
+		copied(false)
+	{}
+};
+
+struct TextureLoader
+{
+	JobSystem *jobs;
+	JobCounter decodes;
+	JobCounter copies;
+
+	// requests still waiting to reach the GPU
+	std::vector<TextureRequest*> pending;
+
+	// what textures show until their image arrives
+	GLuint placeholder;
+
+	// uploads alternate between these so one can still be read by the
+	// driver while the next is filled; a buffer is busy from being mapped
+	// for a request until that request has been uploaded
+	GLuint pixelBuffers[TEXTURELOADER_PIXEL_BUFFERS];
+	bool   pixelBuffersBusy[TEXTURELOADER_PIXEL_BUFFERS];
+	int    nextPixelBuffer;
+
+	// bytes uploaded per UpdateTextureLoader call; at least one image is
+	// always uploaded, however large it is
+	size_t uploadBudget;
+
+	// if set, called with each compressed image as its texture is filled,
+	// while the blocks are still in memory
+	std::function<void(MyTexture*, const CompressedImage*)> compressedUploaded;
+
+	TextureLoader();
+};
+
+bool InitializeTextureLoader(TextureLoader *loader, JobSystem *jobs);
+
+// points texture at the placeholder and starts decoding filename
+void LoadTextureAsync(TextureLoader *loader, MyTexture *texture, const char *filename);
+
+// uploads what has been decoded since the last call; returns the number of
+// textures still loading
+size_t UpdateTextureLoader(TextureLoader *loader);
+
+// blocks until every requested texture is on the GPU
+void FinishTextureLoader(TextureLoader *loader);
+
+// waits for outstanding decodes and copies, then frees the loader's own
+// objects; the textures it loaded are left alone
+void DestroyTextureLoader(TextureLoader *loader);
+
+#endif
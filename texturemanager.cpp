@@ -0,0 +1,415 @@
+// ==========================================================================
+// Shared texture binding for every body
+// ==========================================================================
+
+#include "texturemanager.h"
+#include "program.h"
+#include "gldebug.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+// std140 pads each uvec2 of the handle array out to 16 bytes
+struct HandleSlot
+{
+	GLuint64 handle;
+	GLuint64 padding;
+};
+
+TextureManager::TextureManager() : array(0), format(GL_RGBA8), width(0), height(0), levels(0), capacity(0), bindless(false),
+	handleBuffer(0), placeholder(0), vertexArray(0)
+{
+	framebuffers[0] = framebuffers[1] = 0;
+}
+
+bool BindlessTexturesSupported()
+{
+	return GLAD_GL_ARB_bindless_texture && GLAD_GL_NV_gpu_shader5;
+}
+
+// whether compressed layers can be copied straight out of their textures
+static bool CopyImageSupported()
+{
+	return GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_copy_image;
+}
+
+// (re)creates the array in manager's format and levels, level by level,
+// since immutable storage needs 4.2
+static void AllocateArray(TextureManager *manager)
+{
+	glDeleteTextures(1, &manager->array);
+	glGenTextures(1, &manager->array);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, manager->array);
+	for (GLsizei level = 0; level < manager->levels; level++) {
+		GLsizei width = std::max(1, manager->width >> level), height = std::max(1, manager->height >> level);
+		if (manager->format == GL_RGBA8)
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, width, height, manager->capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		else
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, manager->format, width, height, manager->capacity, 0,
+				GLsizei(CompressedLevelSize(manager->format, width, height) * manager->capacity), 0);
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, manager->levels - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+bool InitializeTextureManager(TextureManager *manager, GLsizei width, GLsizei height, GLsizei maxLayers, bool bindless)
+{
+	maxLayers = std::min(maxLayers, GLsizei(TEXTURE_MANAGER_MAX_LAYERS));
+	manager->bindless = bindless && BindlessTexturesSupported();
+	manager->format = GL_RGBA8;
+	manager->width = width;
+	manager->height = height;
+	manager->capacity = maxLayers;
+
+	if (manager->bindless) {
+		glGenBuffers(1, &manager->handleBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, manager->handleBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, TEXTURE_MANAGER_MAX_LAYERS * sizeof(HandleSlot), 0, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, TEXTURE_BLOCK_BINDING, manager->handleBuffer);
+		return !CheckGLErrors();
+	}
+
+	// a full mip chain
+	manager->levels = 1;
+	while ((std::max(width, height) >> manager->levels) > 0)
+		manager->levels++;
+	AllocateArray(manager);
+
+	glGenFramebuffers(2, manager->framebuffers);
+
+	// the dynamic resolution stretch, unsharpened
+	manager->program = InitializeShaders("shaders/overlay_vertex.glsl", "shaders/upscale_fragment.glsl");
+	if (!manager->program.id) {
+		cout << "ERROR: could not build the texture manager's program" << endl;
+		return false;
+	}
+	SetUniform(&manager->program, UNIFORM_RECT, vec4(-1.f, -1.f, 2.f, 2.f));
+	SetUniform(&manager->program, UNIFORM_SAMPLER, 0);
+	SetUniform(&manager->program, UNIFORM_SHARPNESS, 0.f);
+	glGenVertexArrays(1, &manager->vertexArray);
+
+	return !CheckGLErrors();
+}
+
+GLint AddTextureLayer(TextureManager *manager, MyTexture *texture)
+{
+	if (GLsizei(manager->sources.size()) >= manager->capacity) {
+		cout << "ERROR: texture manager has no free layers" << endl;
+		return -1;
+	}
+
+	manager->sources.push_back(texture);
+	manager->current.push_back(0);
+	manager->handles.push_back(0);
+	manager->images.push_back(CompressedImage());
+	return GLint(manager->sources.size() - 1);
+}
+
+void SetTextureLayerImage(TextureManager *manager, const MyTexture *texture, const CompressedImage *image)
+{
+	if (manager->bindless || CopyImageSupported()) return;
+
+	const unsigned char *bytes = image->external ? image->external : &image->data[0];
+	for (size_t layer = 0; layer < manager->sources.size(); layer++) {
+		if (manager->sources[layer] != texture) continue;
+
+		// a copy of just the levels, since in-place data need not outlive
+		// the upload
+		CompressedImage &kept = manager->images[layer];
+		kept = CompressedImage();
+		kept.format = image->format;
+		kept.width = image->width;
+		kept.height = image->height;
+		for (size_t level = 0; level < image->levelSizes.size(); level++) {
+			const unsigned char *start = bytes + image->levelOffsets[level];
+			kept.levelOffsets.push_back(kept.data.size());
+			kept.levelSizes.push_back(image->levelSizes[level]);
+			kept.data.insert(kept.data.end(), start, start + image->levelSizes[level]);
+		}
+	}
+}
+
+// points the layer at its texture's resident handle, releasing the old
+// handle once no other layer uses it
+static void UpdateHandle(TextureManager *manager, size_t layer)
+{
+	GLuint64 previous = manager->handles[layer];
+	GLuint64 handle = glGetTextureHandleARB(manager->sources[layer]->textureID);
+	if (!glIsTextureHandleResidentARB(handle))
+		glMakeTextureHandleResidentARB(handle);
+	manager->handles[layer] = handle;
+
+	if (previous && previous != handle && find(manager->handles.begin(), manager->handles.end(), previous) == manager->handles.end())
+		glMakeTextureHandleNonResidentARB(previous);
+
+	HandleSlot slot = { handle, 0 };
+	glBindBuffer(GL_UNIFORM_BUFFER, manager->handleBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, layer * sizeof(HandleSlot), sizeof(HandleSlot), &slot);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// the compressed internal format of texture's top level and how many
+// levels it has, or GL_NONE if it is not compressed
+static GLenum CompressedFormat(const MyTexture *texture, GLint *levels)
+{
+	GLint compressed = GL_FALSE, format = GL_NONE, maxLevel = 0;
+	glBindTexture(GL_TEXTURE_2D, texture->textureID);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+	glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	*levels = maxLevel + 1;
+	return compressed ? GLenum(format) : GL_NONE;
+}
+
+// whether the layer's texture, of the given format and levels, can be
+// copied into the compressed array as it is
+static bool FitsArray(const TextureManager *manager, size_t layer, GLenum format, GLint levels)
+{
+	const MyTexture *source = manager->sources[layer];
+	const CompressedImage &image = manager->images[layer];
+	if (format != manager->format || source->width != manager->width || source->height != manager->height || levels < manager->levels)
+		return false;
+	return CopyImageSupported() || (image.format == format && image.width == source->width && image.height == source->height);
+}
+
+// deletes the layer's texture now the array holds it, since nothing else
+// draws from it; the placeholder is left alone
+static void ReleaseSource(TextureManager *manager, size_t layer)
+{
+	MyTexture *source = manager->sources[layer];
+	manager->images[layer] = CompressedImage();
+	if (source->textureID == manager->placeholder) {
+		manager->current[layer] = source->textureID;
+		return;
+	}
+
+	glDeleteTextures(1, &source->textureID);
+	source->textureID = 0;
+	manager->current[layer] = 0;
+}
+
+// scales the layer's texture into the array with a framebuffer blit
+static void BlitLayer(TextureManager *manager, size_t layer)
+{
+	const MyTexture *source = manager->sources[layer];
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, manager->framebuffers[0]);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source->textureID, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, manager->framebuffers[1]);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, manager->array, 0, GLint(layer));
+	glBlitFramebuffer(0, 0, source->width, source->height, 0, 0, manager->width, manager->height,
+		GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
+
+// draws the layer's compressed texture into the RGBA8 array, scaled as
+// BlitLayer would, since a blit cannot read compressed formats
+static void DecodeLayer(TextureManager *manager, size_t layer)
+{
+	const MyTexture *source = manager->sources[layer];
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, manager->framebuffers[1]);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, manager->array, 0, GLint(layer));
+	glViewport(0, 0, manager->width, manager->height);
+
+	SetUniform(&manager->program, UNIFORM_SOURCE,
+		vec4(float(source->width), float(source->height), float(manager->width), float(manager->height)));
+	glUseProgram(manager->program.id);
+	glBindVertexArray(manager->vertexArray);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source->textureID);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if (depthTest) glEnable(GL_DEPTH_TEST);
+	if (blend) glEnable(GL_BLEND);
+}
+
+// copies the layer's texture into the compressed array level by level, as
+// the blocks it is stored in
+static void CopyCompressedLayer(TextureManager *manager, size_t layer)
+{
+	const MyTexture *source = manager->sources[layer];
+	const CompressedImage &image = manager->images[layer];
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, manager->array);
+	for (GLsizei level = 0; level < manager->levels; level++) {
+		GLsizei width = std::max(1, manager->width >> level);
+		GLsizei height = std::max(1, manager->height >> level);
+		if (CopyImageSupported())
+			glCopyImageSubData(source->textureID, GL_TEXTURE_2D, level, 0, 0, 0,
+				manager->array, GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(layer), width, height, 1);
+		else
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(layer), width, height, 1, manager->format,
+				GLsizei(image.levelSizes[level]), &image.data[image.levelOffsets[level]]);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+// once every layer's texture has arrived compressed, in one format and at
+// the layer size, reallocates the array in that format and copies them in;
+// if some cannot be, draws the compressed ones into the RGBA8 array as it
+// is. Returns the layers filled
+static int ChooseArrayFormat(TextureManager *manager)
+{
+	GLenum format = GL_NONE;
+	GLint levels = manager->levels;
+	bool fits = true;
+	for (size_t layer = 0; layer < manager->sources.size(); layer++) {
+		const MyTexture *source = manager->sources[layer];
+
+		// a layer still on the placeholder may yet arrive compressed; one
+		// whose texture has gone is already in the array uncompressed
+		GLint sourceLevels = 0;
+		if (source->textureID == manager->placeholder) return 0;
+		GLenum sourceFormat = source->textureID ? CompressedFormat(source, &sourceLevels) : GL_NONE;
+
+		if (format == GL_NONE) format = sourceFormat;
+		fits = fits && sourceFormat != GL_NONE && sourceFormat == format && CompressedLevelSize(format, 1, 1) > 0;
+		levels = std::min(levels, sourceLevels);
+	}
+
+	GLenum previous = manager->format;
+	GLsizei previousLevels = manager->levels;
+	manager->format = format;
+	manager->levels = levels;
+	for (size_t layer = 0; layer < manager->sources.size() && fits; layer++)
+		if (!FitsArray(manager, layer, format, levels)) fits = false;
+
+	if (!fits) {
+		manager->format = previous;
+		manager->levels = previousLevels;
+		int decoded = 0;
+		for (size_t layer = 0; layer < manager->sources.size(); layer++) {
+			const MyTexture *source = manager->sources[layer];
+			if (!source->textureID || source->textureID == manager->current[layer]) continue;
+			DecodeLayer(manager, layer);
+			ReleaseSource(manager, layer);
+			decoded++;
+		}
+		return decoded;
+	}
+
+	// the blocks go in as they are, so nothing is blitted or drawn any more
+	AllocateArray(manager);
+	glDeleteFramebuffers(2, manager->framebuffers);
+	manager->framebuffers[0] = manager->framebuffers[1] = 0;
+	DestroyProgram(&manager->program);
+	glDeleteVertexArrays(1, &manager->vertexArray);
+	manager->vertexArray = 0;
+
+	for (size_t layer = 0; layer < manager->sources.size(); layer++) {
+		CopyCompressedLayer(manager, layer);
+		ReleaseSource(manager, layer);
+	}
+	return int(manager->sources.size());
+}
+
+int UpdateTextureManager(TextureManager *manager)
+{
+	int refreshed = 0;
+	bool blitted = false, held = false;
+	for (size_t layer = 0; layer < manager->sources.size(); layer++) {
+		GLuint texture = manager->sources[layer]->textureID;
+		if (texture == manager->current[layer]) continue;
+
+		if (manager->bindless)
+			UpdateHandle(manager, layer);
+		else {
+			GLint levels;
+			GLenum format = CompressedFormat(manager->sources[layer], &levels);
+			if (manager->format == GL_RGBA8 && format == GL_NONE) {
+				BlitLayer(manager, layer);
+				ReleaseSource(manager, layer);
+				blitted = true;
+				refreshed++;
+				continue;
+			}
+			else if (manager->format == GL_RGBA8) {
+				// compressed layers wait until the array can take them as
+				// they are
+				held = true;
+				continue;
+			}
+			else if (FitsArray(manager, layer, format, levels)) {
+				CopyCompressedLayer(manager, layer);
+				ReleaseSource(manager, layer);
+				refreshed++;
+				continue;
+			}
+			else {
+				cout << "WARNING: texture layer " << layer << " no longer matches the compressed array and is not updated" << endl;
+				ReleaseSource(manager, layer);
+				continue;
+			}
+		}
+		manager->current[layer] = texture;
+		refreshed++;
+	}
+
+	// layers drawn into an RGBA8 array need their mip chains rebuilt too
+	if (held) {
+		int filled = ChooseArrayFormat(manager);
+		refreshed += filled;
+		blitted = blitted || (filled > 0 && manager->format == GL_RGBA8);
+	}
+
+	// the lower levels of every blitted layer are now stale
+	if (blitted) {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, manager->array);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+	if (refreshed > 0) CheckGLErrors();
+	return refreshed;
+}
+
+void BindTextureManager(RenderState *state, const TextureManager *manager, GLuint unit)
+{
+	if (!manager->bindless)
+		BindTexture(state, unit, GL_TEXTURE_2D_ARRAY, manager->array);
+}
+
+void DestroyTextureManager(TextureManager *manager)
+{
+	for (size_t layer = 0; layer < manager->handles.size(); layer++) {
+		GLuint64 handle = manager->handles[layer];
+		if (handle && glIsTextureHandleResidentARB(handle))
+			glMakeTextureHandleNonResidentARB(handle);
+	}
+	manager->handles.clear();
+	manager->sources.clear();
+	manager->current.clear();
+	manager->images.clear();
+
+	glDeleteBuffers(1, &manager->handleBuffer);
+	glDeleteFramebuffers(2, manager->framebuffers);
+	glDeleteTextures(1, &manager->array);
+	glDeleteVertexArrays(1, &manager->vertexArray);
+	DestroyProgram(&manager->program);
+	manager->handleBuffer = manager->array = manager->vertexArray = 0;
+	manager->format = GL_RGBA8;
+	manager->framebuffers[0] = manager->framebuffers[1] = 0;
+}
@@ -0,0 +1,109 @@
+// ==========================================================================
+// Shared texture binding for every body
+//
+// The planets' textures are gathered into one GL_TEXTURE_2D_ARRAY, a layer
+// each, so a body only carries its layer index and a single binding serves
+// every instanced draw. Layers are a fixed size; uncompressed textures of
+// another size are scaled into them. Once a layer holds its texture, the
+// texture is deleted and its MyTexture left empty, so each map is only
+// kept once.
+//
+// Once every layer's texture has arrived compressed, in one format and at
+// the layer size, the array is reallocated in that format and the blocks
+// are copied in as they are, level by level, with glCopyImageSubData where
+// ARB_copy_image is present and glCompressedTexSubImage3D from the blocks
+// handed over with SetTextureLayerImage otherwise. Compressed textures
+// that cannot share a compressed array, such as the pack's maps among ones
+// it does not hold, are drawn into the RGBA8 array instead: sampling
+// decodes them, which a blit cannot.
+//
+// With ARB_bindless_texture (and NV_gpu_shader5, since one draw's fragments
+// can index different handles) each texture keeps its own size and format
+// instead: its resident handle sits in a uniform block, declared as
+//
+//	layout(std140) uniform TextureHandles {
+//		uvec2 handles[TEXTURE_MANAGER_MAX_LAYERS];	// one per 16 bytes
+//	};
+//
+// and the layer index picks the handle.
+//
+// The manager watches the MyTextures it was given, so a texture the async
+// loader swaps in later replaces its layer's placeholder automatically.
+// ==========================================================================
+#ifndef TEXTUREMANAGER_H
+#define TEXTUREMANAGER_H
+
+#include <vector>
+#include <glad/glad.h>
+
+#include "texture.h"
+#include "compressedtexture.h"
+#include "program.h"
+#include "renderstate.h"
+
+// must match the handle array in instanced_fragment_bindless.glsl
+#define TEXTURE_MANAGER_MAX_LAYERS 64
+
+struct TextureManager
+{
+	// the array holding every layer, unused with bindless handles, in
+	// GL_RGBA8 until it takes the layers' compressed format
+	GLuint  array;
+	GLenum  format;
+	GLsizei width;
+	GLsizei height;
+	GLsizei levels;
+	GLsizei capacity;
+
+	// with bindless textures, the uniform buffer of layer handles
+	bool    bindless;
+	GLuint  handleBuffer;
+	std::vector<GLuint64> handles;
+
+	// what each layer shows, and the texture it was last filled from
+	std::vector<MyTexture*> sources;
+	std::vector<GLuint>     current;
+
+	// the texture layers show while they load, shared between them and so
+	// never deleted; see TextureLoader
+	GLuint placeholder;
+
+	// without ARB_copy_image, each layer's compressed blocks, kept until
+	// the array takes them
+	std::vector<CompressedImage> images;
+
+	// read and draw framebuffers for scaling textures into layers, and the
+	// stretch that draws compressed ones in, with no vertex data
+	GLuint framebuffers[2];
+	ShaderProgram program;
+	GLuint        vertexArray;
+
+	TextureManager();
+};
+
+// whether the context can take the bindless path
+bool BindlessTexturesSupported();
+
+// allocates room for maxLayers layers of width x height; bindless is only
+// honoured when BindlessTexturesSupported
+bool InitializeTextureManager(TextureManager *manager, GLsizei width, GLsizei height, GLsizei maxLayers, bool bindless);
+
+// gives texture a layer and returns its index, or -1 when the manager is full
+GLint AddTextureLayer(TextureManager *manager, MyTexture *texture);
+
+// hands over the blocks texture was just uploaded from, while they are still
+// in memory; they are only kept where the array cannot copy them out of the
+// texture itself
+void SetTextureLayerImage(TextureManager *manager, const MyTexture *texture, const CompressedImage *image);
+
+// refreshes the layers whose texture has changed since the last call and
+// returns how many did; refreshing binds textures, framebuffers, programs
+// and vertex arrays behind the render state cache
+int UpdateTextureManager(TextureManager *manager);
+
+// binds the array to unit; with bindless handles there is nothing to bind
+void BindTextureManager(RenderState *state, const TextureManager *manager, GLuint unit);
+
+void DestroyTextureManager(TextureManager *manager);
+
+#endif
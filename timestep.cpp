@@ -0,0 +1,37 @@
+// ==========================================================================
+// Fixed-timestep simulation
+// ==========================================================================
+
+#include "timestep.h"
+
+void InitializeTimestep(FixedTimestep *timestep, double rate, double now)
+{
+	timestep->step = 1.0 / rate;
+	timestep->accumulator = 0.0;
+	timestep->last = now;
+	timestep->ticks = 0;
+}
+
+int AdvanceTimestep(FixedTimestep *timestep, double now)
+{
+	double elapsed = now - timestep->last;
+	timestep->last = now;
+	if (elapsed > timestep->maxFrameTime)
+		elapsed = timestep->maxFrameTime;
+	if (elapsed > 0.0)
+		timestep->accumulator += elapsed;
+
+	int ticks = 0;
+	while (timestep->accumulator >= timestep->step) {
+		timestep->accumulator -= timestep->step;
+		ticks++;
+	}
+	timestep->ticks += ticks;
+	return ticks;
+}
+
+float TimestepAlpha(const FixedTimestep *timestep)
+{
+	float alpha = float(timestep->accumulator / timestep->step);
+	return alpha < 1.f ? alpha : 1.f;
+}
@@ -0,0 +1,52 @@
+// ==========================================================================
+// Fixed-timestep simulation
+//
+// The simulation advances in ticks of a fixed length, however often frames
+// are drawn. Every frame adds the time that passed to an accumulator, and
+// AdvanceTimestep says how many whole ticks that paid for; what is left
+// over, as a fraction of a tick, is how far to interpolate from the state
+// before the last tick to the state after it. A frame then looks like
+//
+//	for (int ticks = AdvanceTimestep(&timestep, glfwGetTime()); ticks > 0; ticks--) {
+//		previous = current;
+//		... advance current by one tick ...
+//	}
+//	... draw mix(previous, current, TimestepAlpha(&timestep)) ...
+//
+// so the picture is always up to one tick behind the simulation, but moves
+// at the same speed at any frame rate. Long stalls, such as dragging the
+// window, are clamped to maxFrameTime so the simulation does not try to
+// catch up all at once.
+// ==========================================================================
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+struct FixedTimestep
+{
+	// seconds per tick
+	double step;
+
+	// longest frame, in seconds, the simulation keeps up with
+	double maxFrameTime;
+
+	// time not yet simulated, and the clock when it was last advanced
+	double accumulator;
+	double last;
+
+	// ticks run so far
+	unsigned long long ticks;
+
+	FixedTimestep() : step(1.0/60.0), maxFrameTime(0.25), accumulator(0.0), last(0.0), ticks(0)
+	{}
+};
+
+// starts the clock at now, in seconds, ticking rate times a second
+void InitializeTimestep(FixedTimestep *timestep, double rate, double now);
+
+// adds the time since the last call and returns how many ticks to run
+int AdvanceTimestep(FixedTimestep *timestep, double now);
+
+// how far into the next tick the clock is, from 0 to 1
+float TimestepAlpha(const FixedTimestep *timestep);
+
+#endif
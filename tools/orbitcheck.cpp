@@ -0,0 +1,99 @@
+// ==========================================================================
+// orbitcheck: accuracy check of the batched orbit kernels against glm
+//
+// Fills batches of every size from one body up to a few thousand, with
+// angles well outside [0, 360) and bodies of every size and tilt, and checks
+// that both UpdateOrbits and UpdateOrbitsScalar build the same matrices as
+// glm's rotate, scale and translate, to within ORBIT_KERNEL_TOLERANCE, both
+// as filled and after advancing them. Sizes that are not a multiple of any
+// vector width send the last few bodies of each batch through the scalar
+// tail of the vector path too.
+//
+// The vector kernel is chosen when orbits.cpp is compiled, so every path is
+// only covered by building the check once for each:
+//
+//     g++ -O2 -I. tools/orbitcheck.cpp orbits.cpp -o orbitcheck
+//     g++ -O2 -I. -mavx tools/orbitcheck.cpp orbits.cpp -o orbitcheck-avx
+//     g++ -O2 -I. -DORBITS_SCALAR tools/orbitcheck.cpp orbits.cpp -o orbitcheck-scalar
+//
+// Exits with 1 if any batch is off. It is a separate program with its own
+// main; see the README.
+// ==========================================================================
+
+#include "orbits.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace glm;
+
+// how far two angles in degrees are apart, either way round
+static float AngleDifference(float a, float b)
+{
+	float difference = fmod(std::abs(a - b), 360.f);
+	return std::min(difference, 360.f - difference);
+}
+
+// the largest difference between the angles the two paths advanced to
+static float AdvanceError(const OrbitBatch *vectorBatch, const OrbitBatch *scalarBatch)
+{
+	float error = 0.f;
+	for (size_t i = 0; i < OrbitCount(vectorBatch); i++) {
+		error = std::max(error, AngleDifference(vectorBatch->orbitAngle[i], scalarBatch->orbitAngle[i]));
+		error = std::max(error, AngleDifference(vectorBatch->spinAngle[i], scalarBatch->spinAngle[i]));
+	}
+	return error;
+}
+
+int main()
+{
+	const size_t counts[] = { 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 100, 1000, 4099 };
+	const float steps = 37.25f;
+
+	mt19937 random(453);
+	uniform_real_distribution<float> angle(-720.f, 720.f);
+	uniform_real_distribution<float> speed(-5.f, 5.f);
+	uniform_real_distribution<float> distance(0.f, 200.f);
+	uniform_real_distribution<float> tilt(-180.f, 180.f);
+	uniform_real_distribution<float> size(0.01f, 5.f);
+
+	cout << "orbit kernel " << OrbitKernelName() << ", tolerance " << ORBIT_KERNEL_TOLERANCE << endl;
+	bool failed = false;
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		OrbitBatch batch;
+		batch.centre = vec3(12.f, -3.f, 40.f);
+		for (size_t i = 0; i < counts[c]; i++)
+			AddOrbit(&batch, distance(random), speed(random), speed(random), tilt(random), size(random),
+				angle(random), angle(random));
+
+		// as filled, then after each path has advanced its own copy
+		float vectorError = OrbitKernelError(&batch);
+		float scalarError = OrbitKernelError(&batch, true);
+
+		OrbitBatch vectorBatch = batch, scalarBatch = batch;
+		vector<mat4> out(counts[c]);
+		UpdateOrbits(&vectorBatch, steps, &out[0], sizeof(mat4), 0, counts[c]);
+		UpdateOrbitsScalar(&scalarBatch, steps, &out[0], sizeof(mat4), 0, counts[c]);
+		vectorError = std::max(vectorError, OrbitKernelError(&vectorBatch));
+		scalarError = std::max(scalarError, OrbitKernelError(&scalarBatch, true));
+
+		// angles are in degrees, not relative; a thousandth of one is far
+		// below anything visible
+		float advanceError = AdvanceError(&vectorBatch, &scalarBatch);
+
+		bool ok = vectorError <= ORBIT_KERNEL_TOLERANCE && scalarError <= ORBIT_KERNEL_TOLERANCE
+			&& advanceError <= 1e-3f;
+		cout << (ok ? "ok   " : "FAIL ") << counts[c] << " bodies: vector " << vectorError
+			<< ", scalar " << scalarError << ", angles " << advanceError << " degrees apart" << endl;
+		failed = failed || !ok;
+	}
+
+	if (failed) {
+		cout << "ERROR: orbit kernels disagree with glm" << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,161 @@
+// ==========================================================================
+// packassets: offline builder for the application's asset pack
+//
+// Builds the sphere chain exactly as the application would at startup,
+// packed in the given vertex format, and writes it into one pack together
+// with any pre-compressed textures and shader sources named on the command
+// line, each under the name the application looks it up by:
+//
+//     packassets assets.pack textures/*.ktx2 shaders/*.glsl
+//     packassets assets.pack --vertex-format float shaders/*.glsl
+//
+// Textures must be KTX2 (see texconvert) and are stored as the whole file.
+// It is a separate program with its own main; see the README for how to
+// build it.
+// ==========================================================================
+
+#include "assetpack.h"
+#include "spheremesh.h"
+#include "vertexformat.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// an entry and the bytes it will name once written
+struct PendingAsset
+{
+	AssetEntry entry;
+	vector<unsigned char> bytes;
+};
+
+static bool ReadFile(const string &filename, vector<unsigned char> *bytes)
+{
+	ifstream input(filename.c_str(), ios::binary);
+	if (!input) return false;
+	input.seekg(0, ios::end);
+	bytes->resize(size_t(input.tellg()));
+	input.seekg(0, ios::beg);
+	return bytes->empty() || bool(input.read((char*)&(*bytes)[0], bytes->size()));
+}
+
+static bool AddAsset(vector<PendingAsset> *assets, const string &name, uint32_t type, uint32_t format,
+	const void *data, size_t size)
+{
+	if (name.size() >= sizeof(AssetEntry().name)) {
+		cout << "ERROR: asset name " << name << " is too long" << endl;
+		return false;
+	}
+	PendingAsset asset;
+	memset(&asset.entry, 0, sizeof(asset.entry));
+	strcpy(asset.entry.name, name.c_str());
+	asset.entry.type = type;
+	asset.entry.format = format;
+	asset.entry.size = size;
+	asset.bytes.assign((const unsigned char*)data, (const unsigned char*)data + size);
+	assets->push_back(asset);
+	return true;
+}
+
+static bool EndsWith(const string &text, const string &suffix)
+{
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static size_t Align(size_t offset)
+{
+	return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+}
+
+// --------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		cout << "usage: packassets <output.pack> [--vertex-format float|snorm16] [texture.ktx2|shader.glsl ...]" << endl;
+		return -1;
+	}
+	string output = argv[1];
+	PositionFormat positionFormat = POSITION_SNORM16;
+	vector<string> files;
+	for (int i = 2; i < argc; i++) {
+		if (string(argv[i]) == "--vertex-format" && i+1 < argc) {
+			if (!ParsePositionFormat(argv[++i], &positionFormat)) {
+				cout << "ERROR: unknown vertex format " << argv[i] << endl;
+				return -1;
+			}
+		}
+		else
+			files.push_back(argv[i]);
+	}
+
+	vector<PendingAsset> assets;
+
+	// the sphere chain, with its levels flattened to fixed-size records
+	VertexLayout layout = MakeVertexLayout(positionFormat);
+	vector<unsigned char> vertices;
+	vector<GLuint> indices;
+	LODChain chain;
+	BuildSphereChain(SPHERE_LOD_INTERVALS, LOD_LEVELS, &layout, &vertices, &indices, &chain);
+
+	vector<AssetLOD> levels(chain.count);
+	for (int i = 0; i < chain.count; i++) {
+		levels[i].firstIndex = int32_t(chain.levels[i].firstIndex);
+		levels[i].indexCount = int32_t(chain.levels[i].indexCount);
+		levels[i].baseVertex = int32_t(chain.levels[i].baseVertex);
+		levels[i].columns = int32_t(chain.levels[i].columns);
+		levels[i].rings = int32_t(chain.levels[i].rings);
+		levels[i].maxRadius = chain.levels[i].maxRadius;
+	}
+	AddAsset(&assets, ASSET_SPHERE_VERTICES, ASSET_VERTICES, uint32_t(positionFormat), &vertices[0], vertices.size());
+	AddAsset(&assets, ASSET_SPHERE_INDICES, ASSET_INDICES, 0, &indices[0], indices.size() * sizeof(GLuint));
+	AddAsset(&assets, ASSET_SPHERE_LODS, ASSET_LODS, 0, &levels[0], levels.size() * sizeof(AssetLOD));
+
+	for (size_t i = 0; i < files.size(); i++) {
+		uint32_t type = EndsWith(files[i], ".ktx2") ? ASSET_TEXTURE : EndsWith(files[i], ".glsl") ? ASSET_SHADER : 0;
+		if (!type) {
+			cout << "ERROR: " << files[i] << " is neither a .ktx2 texture nor a .glsl shader" << endl;
+			return -1;
+		}
+		vector<unsigned char> bytes;
+		if (!ReadFile(files[i], &bytes)) {
+			cout << "ERROR: could not read " << files[i] << endl;
+			return -1;
+		}
+		if (!AddAsset(&assets, AssetName(files[i]), type, 0, bytes.empty() ? 0 : &bytes[0], bytes.size()))
+			return -1;
+	}
+
+	// lay the blobs out behind the index, each on an aligned boundary
+	AssetPackHeader header;
+	memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+	header.version = ASSET_PACK_VERSION;
+	header.entryCount = uint32_t(assets.size());
+	size_t offset = sizeof(AssetPackHeader) + assets.size() * sizeof(AssetEntry);
+	for (size_t i = 0; i < assets.size(); i++) {
+		offset = Align(offset);
+		assets[i].entry.offset = offset;
+		offset += assets[i].bytes.size();
+	}
+
+	ofstream out(output.c_str(), ios::binary);
+	out.write((const char*)&header, sizeof(header));
+	for (size_t i = 0; i < assets.size(); i++)
+		out.write((const char*)&assets[i].entry, sizeof(AssetEntry));
+	for (size_t i = 0; i < assets.size(); i++) {
+		while ((unsigned long long)out.tellp() < assets[i].entry.offset) out.put(0);
+		if (!assets[i].bytes.empty())
+			out.write((const char*)&assets[i].bytes[0], assets[i].bytes.size());
+	}
+	if (!out) {
+		cout << "ERROR: could not write " << output << endl;
+		return -1;
+	}
+
+	cout << output << ": " << assets.size() << " assets, " << offset / 1024 << " KB" << endl;
+	return 0;
+}
@@ -0,0 +1,332 @@
+// ==========================================================================
+// texconvert: offline JPEG/PNG to BC1 DDS or KTX2 converter
+//
+// Builds the full mip chain with a box filter, compresses every level to
+// BC1 (DXT1) and writes it in the container named by the output's
+// extension, ready for MyTexture to upload without decoding:
+//
+//     texconvert textures/earth.jpg textures/earth.ktx2
+//     texconvert textures/moon.jpg textures/moon.dds
+//
+// It is a separate program with its own main; see the README for how to
+// build it.
+// ==========================================================================
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Level
+{
+	int width;
+	int height;
+	vector<unsigned char> rgba;		//uncompressed, 4 bytes a texel
+	vector<unsigned char> blocks;	//BC1, 8 bytes per 4x4 block
+};
+
+// --------------------------------------------------------------------------
+// Mip chain
+
+static Level Downsample(const Level &level)
+{
+	Level next;
+	next.width = max(1, level.width / 2);
+	next.height = max(1, level.height / 2);
+	next.rgba.resize(size_t(next.width) * next.height * 4);
+
+	for (int y = 0; y < next.height; y++) {
+		for (int x = 0; x < next.width; x++) {
+			// average the 2x2 footprint, clamped for odd or unit sizes
+			int x0 = min(2*x, level.width - 1), x1 = min(2*x + 1, level.width - 1);
+			int y0 = min(2*y, level.height - 1), y1 = min(2*y + 1, level.height - 1);
+			for (int c = 0; c < 4; c++) {
+				int sum = level.rgba[(size_t(y0) * level.width + x0) * 4 + c]
+					+ level.rgba[(size_t(y0) * level.width + x1) * 4 + c]
+					+ level.rgba[(size_t(y1) * level.width + x0) * 4 + c]
+					+ level.rgba[(size_t(y1) * level.width + x1) * 4 + c];
+				next.rgba[(size_t(y) * next.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+	return next;
+}
+
+// --------------------------------------------------------------------------
+// BC1 encoding
+
+static unsigned short Pack565(const float colour[3])
+{
+	int r = int(min(max(colour[0], 0.f), 255.f) * 31.f / 255.f + 0.5f);
+	int g = int(min(max(colour[1], 0.f), 255.f) * 63.f / 255.f + 0.5f);
+	int b = int(min(max(colour[2], 0.f), 255.f) * 31.f / 255.f + 0.5f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void Unpack565(unsigned short packed, float colour[3])
+{
+	colour[0] = float((packed >> 11) & 31) * 255.f / 31.f;
+	colour[1] = float((packed >> 5) & 63) * 255.f / 63.f;
+	colour[2] = float(packed & 31) * 255.f / 31.f;
+}
+
+// fits the endpoints to the block's principal axis of colour, then picks
+// the nearest of the four palette entries for each texel
+static void EncodeBlock(const unsigned char texels[16][4], unsigned char out[8])
+{
+	float mean[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++) mean[c] += texels[i][c] / 16.f;
+
+	float covariance[6] = { 0, 0, 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		float r = texels[i][0] - mean[0], g = texels[i][1] - mean[1], b = texels[i][2] - mean[2];
+		covariance[0] += r*r; covariance[1] += r*g; covariance[2] += r*b;
+		covariance[3] += g*g; covariance[4] += g*b; covariance[5] += b*b;
+	}
+
+	// a few rounds of power iteration find the dominant axis
+	float axis[3] = { 1, 1, 1 };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float x = covariance[0]*axis[0] + covariance[1]*axis[1] + covariance[2]*axis[2];
+		float y = covariance[1]*axis[0] + covariance[3]*axis[1] + covariance[4]*axis[2];
+		float z = covariance[2]*axis[0] + covariance[4]*axis[1] + covariance[5]*axis[2];
+		float length = max(max(fabsf(x), fabsf(y)), fabsf(z));
+		if (length < 1e-6f) break;
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+
+	float lowest = 1e30f, highest = -1e30f;
+	for (int i = 0; i < 16; i++) {
+		float t = (texels[i][0] - mean[0])*axis[0] + (texels[i][1] - mean[1])*axis[1] + (texels[i][2] - mean[2])*axis[2];
+		lowest = min(lowest, t);
+		highest = max(highest, t);
+	}
+	float lengthSquared = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+	if (lengthSquared > 0) {
+		lowest /= lengthSquared;
+		highest /= lengthSquared;
+	}
+
+	float end0[3], end1[3];
+	for (int c = 0; c < 3; c++) {
+		end0[c] = mean[c] + axis[c] * highest;
+		end1[c] = mean[c] + axis[c] * lowest;
+	}
+	unsigned short colour0 = Pack565(end0), colour1 = Pack565(end1);
+
+	// colour0 > colour1 selects the four colour mode
+	if (colour0 < colour1) swap(colour0, colour1);
+
+	float palette[4][3];
+	Unpack565(colour0, palette[0]);
+	Unpack565(colour1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2*palette[0][c] + palette[1][c]) / 3.f;
+		palette[3][c] = (palette[0][c] + 2*palette[1][c]) / 3.f;
+	}
+
+	unsigned indices = 0;
+	if (colour0 != colour1) {
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			float bestError = 1e30f;
+			for (int p = 0; p < 4; p++) {
+				float dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+				float error = dr*dr + dg*dg + db*db;
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= unsigned(best) << (2*i);
+		}
+	}
+
+	out[0] = colour0 & 0xFF; out[1] = colour0 >> 8;
+	out[2] = colour1 & 0xFF; out[3] = colour1 >> 8;
+	for (int i = 0; i < 4; i++) out[4 + i] = (indices >> (8*i)) & 0xFF;
+}
+
+static void CompressLevel(Level *level)
+{
+	int across = (level->width + 3) / 4, down = (level->height + 3) / 4;
+	level->blocks.resize(size_t(across) * down * 8);
+
+	for (int by = 0; by < down; by++) {
+		for (int bx = 0; bx < across; bx++) {
+			// edge blocks repeat the last row and column
+			unsigned char texels[16][4];
+			for (int i = 0; i < 16; i++) {
+				int x = min(bx*4 + i % 4, level->width - 1);
+				int y = min(by*4 + i / 4, level->height - 1);
+				memcpy(texels[i], &level->rgba[(size_t(y) * level->width + x) * 4], 4);
+			}
+			EncodeBlock(texels, &level->blocks[(size_t(by) * across + bx) * 8]);
+		}
+	}
+}
+
+// --------------------------------------------------------------------------
+// Containers
+
+static void WriteU32(ostream &out, unsigned value)
+{
+	unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+	out.write((const char*)bytes, 4);
+}
+
+static void WriteU64(ostream &out, unsigned long long value)
+{
+	WriteU32(out, unsigned(value));
+	WriteU32(out, unsigned(value >> 32));
+}
+
+static bool WriteDDS(const string &filename, const vector<Level> &levels)
+{
+	ofstream out(filename.c_str(), ios::binary);
+	if (!out) return false;
+
+	out.write("DDS ", 4);
+	WriteU32(out, 124);
+	WriteU32(out, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000);		//caps, height, width, pixel format, mip count, linear size
+	WriteU32(out, levels[0].height);
+	WriteU32(out, levels[0].width);
+	WriteU32(out, unsigned(levels[0].blocks.size()));
+	WriteU32(out, 0);
+	WriteU32(out, unsigned(levels.size()));
+	for (int i = 0; i < 11; i++) WriteU32(out, 0);
+
+	// pixel format: a four character code and nothing else
+	WriteU32(out, 32);
+	WriteU32(out, 0x4);
+	out.write("DXT1", 4);
+	for (int i = 0; i < 5; i++) WriteU32(out, 0);
+
+	WriteU32(out, 0x1000 | 0x8 | 0x400000);		//texture, complex, mipmap
+	for (int i = 0; i < 4; i++) WriteU32(out, 0);
+
+	for (size_t i = 0; i < levels.size(); i++)
+		out.write((const char*)&levels[i].blocks[0], levels[i].blocks.size());
+	return bool(out);
+}
+
+static bool WriteKTX2(const string &filename, const vector<Level> &levels)
+{
+	ofstream out(filename.c_str(), ios::binary);
+	if (!out) return false;
+
+	const unsigned levelCount = unsigned(levels.size());
+	const unsigned dfdOffset = 80 + 24 * levelCount;
+	const unsigned dfdLength = 44;
+
+	// data follows the descriptor, smallest level first, each 8 byte aligned
+	vector<unsigned long long> offsets(levelCount);
+	unsigned long long offset = (dfdOffset + dfdLength + 7) & ~7ull;
+	for (unsigned i = levelCount; i-- > 0; ) {
+		offsets[i] = offset;
+		offset = (offset + levels[i].blocks.size() + 7) & ~7ull;
+	}
+
+	static const unsigned char identifier[12] = {
+		0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+	};
+	out.write((const char*)identifier, 12);
+	WriteU32(out, 131);				//VK_FORMAT_BC1_RGB_UNORM_BLOCK
+	WriteU32(out, 1);				//type size
+	WriteU32(out, levels[0].width);
+	WriteU32(out, levels[0].height);
+	WriteU32(out, 0);				//depth
+	WriteU32(out, 0);				//layers
+	WriteU32(out, 1);				//faces
+	WriteU32(out, levelCount);
+	WriteU32(out, 0);				//no supercompression
+
+	WriteU32(out, dfdOffset);
+	WriteU32(out, dfdLength);
+	WriteU32(out, 0);				//no key/value data
+	WriteU32(out, 0);
+	WriteU64(out, 0);				//no supercompression global data
+	WriteU64(out, 0);
+
+	for (unsigned i = 0; i < levelCount; i++) {
+		WriteU64(out, offsets[i]);
+		WriteU64(out, levels[i].blocks.size());
+		WriteU64(out, levels[i].blocks.size());
+	}
+
+	// basic data format descriptor: one BC1 sample covering a 4x4 block of
+	// 8 bytes, BT.709 primaries, linear like the RGBA8 path samples
+	WriteU32(out, dfdLength);
+	WriteU32(out, 0);				//Khronos vendor, basic descriptor type
+	WriteU32(out, 2 | (40 << 16));	//version 2, 40 byte block
+	WriteU32(out, 128 | (1 << 8) | (1 << 16));
+	WriteU32(out, 3 | (3 << 8));
+	WriteU32(out, 8);
+	WriteU32(out, 0);
+	WriteU32(out, 63 << 16);		//bits 0 to 63, colour channel
+	WriteU32(out, 0);
+	WriteU32(out, 0);
+	WriteU32(out, 0xFFFFFFFF);
+
+	for (unsigned i = levelCount; i-- > 0; ) {
+		while ((unsigned long long)out.tellp() < offsets[i]) out.put(0);
+		out.write((const char*)&levels[i].blocks[0], levels[i].blocks.size());
+	}
+	return bool(out);
+}
+
+// --------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3) {
+		cout << "usage: texconvert <input image> <output.dds|output.ktx2>" << endl;
+		return -1;
+	}
+	string input = argv[1], output = argv[2];
+	string extension = output.substr(output.find_last_of('.') + 1);
+	transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	if (extension != "dds" && extension != "ktx2") {
+		cout << "ERROR: output must end in .dds or .ktx2" << endl;
+		return -1;
+	}
+
+	Level base;
+	int components;
+	unsigned char *pixels = stbi_load(input.c_str(), &base.width, &base.height, &components, 4);
+	if (!pixels) {
+		cout << "ERROR: could not decode " << input << endl;
+		return -1;
+	}
+	base.rgba.assign(pixels, pixels + size_t(base.width) * base.height * 4);
+	stbi_image_free(pixels);
+
+	vector<Level> levels(1, base);
+	while (levels.back().width > 1 || levels.back().height > 1)
+		levels.push_back(Downsample(levels.back()));
+
+	size_t compressedBytes = 0;
+	for (size_t i = 0; i < levels.size(); i++) {
+		CompressLevel(&levels[i]);
+		compressedBytes += levels[i].blocks.size();
+	}
+
+	bool written = extension == "dds" ? WriteDDS(output, levels) : WriteKTX2(output, levels);
+	if (!written) {
+		cout << "ERROR: could not write " << output << endl;
+		return -1;
+	}
+
+	cout << output << ": " << base.width << "x" << base.height << ", " << levels.size()
+		<< " levels, " << compressedBytes / 1024 << " KB" << endl;
+	return 0;
+}
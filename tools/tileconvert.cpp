@@ -0,0 +1,139 @@
+// ==========================================================================
+// tileconvert: offline JPEG/PNG to virtual texture tile file converter
+//
+// Builds the full mip chain with a box filter and cuts every level into
+// square tiles, each surrounded by a border of its neighbours' texels
+// (wrapping around in x, as the maps do, and clamped in y), in the layout
+// virtualtexture.h reads:
+//
+//     tileconvert textures/16k_earth_daymap.jpg textures/earth.vtex
+//     tileconvert textures/8k_moon.jpg textures/moon.vtex --tile 128 --border 4
+//
+// The default tile of 128 texels is the virtual page size most drivers
+// have for RGBA8, so the same file serves the sparse texture backend. It is
+// a separate program with its own main; see the README for how to build it.
+// ==========================================================================
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "virtualtexture.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Level
+{
+	int width;
+	int height;
+	vector<unsigned char> rgba;		//4 bytes a texel
+};
+
+static Level Downsample(const Level &level)
+{
+	Level next;
+	next.width = max(1, level.width / 2);
+	next.height = max(1, level.height / 2);
+	next.rgba.resize(size_t(next.width) * next.height * 4);
+
+	for (int y = 0; y < next.height; y++) {
+		for (int x = 0; x < next.width; x++) {
+			// average the 2x2 footprint, clamped for odd or unit sizes
+			int x0 = min(2*x, level.width - 1), x1 = min(2*x + 1, level.width - 1);
+			int y0 = min(2*y, level.height - 1), y1 = min(2*y + 1, level.height - 1);
+			for (int c = 0; c < 4; c++) {
+				int sum = level.rgba[(size_t(y0) * level.width + x0) * 4 + c]
+					+ level.rgba[(size_t(y0) * level.width + x1) * 4 + c]
+					+ level.rgba[(size_t(y1) * level.width + x0) * 4 + c]
+					+ level.rgba[(size_t(y1) * level.width + x1) * 4 + c];
+				next.rgba[(size_t(y) * next.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+	return next;
+}
+
+// writes every tile of a level, row by row; texels past the right edge
+// wrap around to the left, even in a partial last tile, so filtering
+// across the seam finds the right neighbours
+static void WriteTiles(ostream &out, const Level &level, int tileSize, int border)
+{
+	int across = (level.width + tileSize - 1) / tileSize;
+	int down = (level.height + tileSize - 1) / tileSize;
+	int side = tileSize + 2*border;
+	vector<unsigned char> tile(size_t(side) * side * 4);
+
+	for (int ty = 0; ty < down; ty++) {
+		for (int tx = 0; tx < across; tx++) {
+			for (int y = 0; y < side; y++) {
+				int sy = min(max(ty*tileSize + y - border, 0), level.height - 1);
+				for (int x = 0; x < side; x++) {
+					int sx = ((tx*tileSize + x - border) % level.width + level.width) % level.width;
+					memcpy(&tile[(size_t(y) * side + x) * 4], &level.rgba[(size_t(sy) * level.width + sx) * 4], 4);
+				}
+			}
+			out.write((const char*)&tile[0], tile.size());
+		}
+	}
+}
+
+// --------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		cout << "usage: tileconvert <input image> <output.vtex> [--tile texels] [--border texels]" << endl;
+		return -1;
+	}
+	string input = argv[1], output = argv[2];
+	int tileSize = 128, border = 4;
+	for (int i = 3; i + 1 < argc; i++) {
+		if (string(argv[i]) == "--tile")
+			tileSize = max(1, atoi(argv[++i]));
+		else if (string(argv[i]) == "--border")
+			border = max(0, atoi(argv[++i]));
+	}
+
+	Level base;
+	int components;
+	unsigned char *pixels = stbi_load(input.c_str(), &base.width, &base.height, &components, 4);
+	if (!pixels) {
+		cout << "ERROR: could not decode " << input << endl;
+		return -1;
+	}
+	base.rgba.assign(pixels, pixels + size_t(base.width) * base.height * 4);
+	stbi_image_free(pixels);
+
+	// down to the level that is a single tile
+	vector<Level> levels(1, base);
+	while (levels.back().width > tileSize || levels.back().height > tileSize)
+		levels.push_back(Downsample(levels.back()));
+
+	ofstream out(output.c_str(), ios::binary);
+	VirtualTileHeader header;
+	memcpy(header.magic, VIRTUAL_TILE_MAGIC, sizeof(header.magic));
+	header.version = VIRTUAL_TILE_VERSION;
+	header.width = uint32_t(base.width);
+	header.height = uint32_t(base.height);
+	header.tileSize = uint32_t(tileSize);
+	header.border = uint32_t(border);
+	header.levels = uint32_t(levels.size());
+	out.write((const char*)&header, sizeof(header));
+	for (size_t i = 0; i < levels.size(); i++)
+		WriteTiles(out, levels[i], tileSize, border);
+	if (!out) {
+		cout << "ERROR: could not write " << output << endl;
+		return -1;
+	}
+
+	cout << output << ": " << base.width << "x" << base.height << ", " << levels.size()
+		<< " levels of " << tileSize << "x" << tileSize << " tiles, " << (size_t(out.tellp()) >> 20) << " MB" << endl;
+	return 0;
+}
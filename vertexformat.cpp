@@ -0,0 +1,106 @@
+// ==========================================================================
+// Interleaved vertex formats
+// ==========================================================================
+
+#include "vertexformat.h"
+
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+
+using namespace std;
+using namespace glm;
+
+static void AddAttribute(VertexLayout *layout, GLuint index, GLint components, GLenum type,
+	GLboolean normalized, GLuint size)
+{
+	VertexAttribute &attribute = layout->attributes[layout->count++];
+	attribute.index = index;
+	attribute.components = components;
+	attribute.type = type;
+	attribute.normalized = normalized;
+	attribute.offset = layout->stride;
+	layout->stride += size;
+}
+
+VertexLayout MakeVertexLayout(PositionFormat positions)
+{
+	VertexLayout layout;
+	layout.positions = positions;
+
+	// every attribute stays 4-byte aligned, which some drivers need to
+	// fetch without converting
+	if (positions == POSITION_SNORM16)
+		AddAttribute(&layout, VERTEX_POSITION_INDEX, 4, GL_SHORT, GL_TRUE, 4*sizeof(GLshort));
+	else
+		AddAttribute(&layout, VERTEX_POSITION_INDEX, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat));
+	AddAttribute(&layout, VERTEX_NORMAL_INDEX, 2, GL_SHORT, GL_TRUE, 2*sizeof(GLshort));
+	AddAttribute(&layout, VERTEX_TEXTURE_INDEX, 2, GL_HALF_FLOAT, GL_FALSE, 2*sizeof(GLhalf));
+	return layout;
+}
+
+bool ParsePositionFormat(const string &name, PositionFormat *format)
+{
+	if (name == "float")
+		*format = POSITION_FLOAT32;
+	else if (name == "snorm16")
+		*format = POSITION_SNORM16;
+	else
+		return false;
+	return true;
+}
+
+void ApplyVertexLayout(const VertexLayout *layout)
+{
+	for (int i = 0; i < layout->count; i++) {
+		const VertexAttribute &attribute = layout->attributes[i];
+		glVertexAttribPointer(attribute.index, attribute.components, attribute.type, attribute.normalized,
+			layout->stride, (const void*)(size_t)attribute.offset);
+		glEnableVertexAttribArray(attribute.index);
+	}
+}
+
+vec2 OctahedralEncode(const vec3 &normal)
+{
+	// project onto the octahedron |x| + |y| + |z| = 1, then fold the lower
+	// half over the upper so it all lands in one square
+	vec2 p = vec2(normal.x, normal.y) / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+	if (normal.z < 0.f) {
+		vec2 folded(1.f - std::abs(p.y), 1.f - std::abs(p.x));
+		p = vec2(p.x >= 0.f ? folded.x : -folded.x, p.y >= 0.f ? folded.y : -folded.y);
+	}
+	return p;
+}
+
+void PackVertices(const VertexLayout *layout, const vec3 *positions, const vec3 *normals,
+	const vec2 *texCoords, size_t count, void *out)
+{
+	unsigned char *vertex = (unsigned char*)out;
+	for (size_t i = 0; i < count; i++, vertex += layout->stride) {
+		for (int a = 0; a < layout->count; a++) {
+			const VertexAttribute &attribute = layout->attributes[a];
+			unsigned char *field = vertex + attribute.offset;
+
+			if (attribute.index == VERTEX_POSITION_INDEX && attribute.type == GL_FLOAT)
+				memcpy(field, &positions[i], sizeof(vec3));
+			else if (attribute.index == VERTEX_POSITION_INDEX) {
+				GLshort packed[4] = {
+					GLshort(packSnorm1x16(positions[i].x)),
+					GLshort(packSnorm1x16(positions[i].y)),
+					GLshort(packSnorm1x16(positions[i].z)),
+					0
+				};
+				memcpy(field, packed, sizeof(packed));
+			}
+			else if (attribute.index == VERTEX_NORMAL_INDEX) {
+				vec2 encoded = OctahedralEncode(normals[i]);
+				GLshort packed[2] = { GLshort(packSnorm1x16(encoded.x)), GLshort(packSnorm1x16(encoded.y)) };
+				memcpy(field, packed, sizeof(packed));
+			}
+			else if (attribute.index == VERTEX_TEXTURE_INDEX) {
+				GLhalf packed[2] = { GLhalf(packHalf1x16(texCoords[i].x)), GLhalf(packHalf1x16(texCoords[i].y)) };
+				memcpy(field, packed, sizeof(packed));
+			}
+		}
+	}
+}
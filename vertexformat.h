@@ -0,0 +1,81 @@
+// ==========================================================================
+// Interleaved vertex formats
+//
+// A VertexLayout describes where each attribute sits in one interleaved
+// vertex and how it is stored, so the vertex array and the packing code are
+// both driven by the same description instead of hard-coded attribute
+// indices and strides. Every layout stores
+//
+//	position	three floats, or four snorm16 (the fourth is padding)
+//	normal		two snorm16, octahedrally encoded; see OctahedralDecode in
+//			the vertex shaders
+//	texture		two half floats
+//
+// which is 20 bytes a vertex with float positions and 16 with snorm16 ones,
+// against the 20 the separate position and texture streams took without any
+// normal. snorm16 positions only cover [-1, 1], which suits the unit spheres
+// everything here is drawn from; larger meshes would have to be scaled into
+// that range, and the scale folded into their model matrices.
+// ==========================================================================
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <string>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// attribute locations, shared with the vertex shaders
+#define VERTEX_POSITION_INDEX 0
+#define VERTEX_TEXTURE_INDEX 1
+#define VERTEX_NORMAL_INDEX 2
+
+#define VERTEX_MAX_ATTRIBUTES 4
+
+enum PositionFormat
+{
+	POSITION_FLOAT32,
+	POSITION_SNORM16
+};
+
+// one attribute, in the terms glVertexAttribPointer takes
+struct VertexAttribute
+{
+	GLuint    index;
+	GLint     components;
+	GLenum    type;
+	GLboolean normalized;
+	GLuint    offset;
+};
+
+struct VertexLayout
+{
+	PositionFormat  positions;
+	VertexAttribute attributes[VERTEX_MAX_ATTRIBUTES];
+	int             count;
+
+	// bytes from one vertex to the next
+	GLsizei         stride;
+
+	VertexLayout() : positions(POSITION_FLOAT32), count(0), stride(0)
+	{}
+};
+
+// the interleaved layout storing positions as given
+VertexLayout MakeVertexLayout(PositionFormat positions);
+
+// parses "float" or "snorm16"; returns false for anything else
+bool ParsePositionFormat(const std::string &name, PositionFormat *format);
+
+// points the attributes of the bound vertex array at the layout in the
+// buffer bound to GL_ARRAY_BUFFER, and enables them
+void ApplyVertexLayout(const VertexLayout *layout);
+
+// writes count vertices in the layout to out, which must hold count times
+// the layout's stride bytes; normals must be unit length
+void PackVertices(const VertexLayout *layout, const glm::vec3 *positions, const glm::vec3 *normals,
+	const glm::vec2 *texCoords, size_t count, void *out);
+
+// the two components a unit normal is stored as, each in [-1, 1]
+glm::vec2 OctahedralEncode(const glm::vec3 &normal);
+
+#endif
@@ -0,0 +1,707 @@
+// ==========================================================================
+// Virtual texturing for planet maps larger than video memory
+// ==========================================================================
+
+#include "virtualtexture.h"
+#include "program.h"
+#include "gldebug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+// sparse textures are immutable storage, so the loader needs 4.2 as well
+#if defined(GL_ARB_sparse_texture) && defined(GL_VERSION_4_2)
+#define HAVE_SPARSE_TEXTURE 1
+#endif
+
+VirtualTextures::VirtualTextures() : sparse(false), tileSize(0), border(0), pageSize(0),
+	physical(0), physicalWidth(0), physicalHeight(0), levels(0), tailLevel(0),
+	indirection(0), indirectionWidth(0), indirectionHeight(0), indirectionLevels(0),
+	uniformBuffer(0), layerCount(0), jobs(0), frame(0),
+	feedbackFramebuffer(0), feedbackColour(0), feedbackDepth(0), feedbackWidth(0), feedbackHeight(0),
+	feedbackNext(0), previousFramebuffer(0)
+{
+	for (int i = 0; i < VIRTUAL_FEEDBACK_FRAMES; i++) {
+		feedbackBuffers[i] = 0;
+		feedbackIssued[i] = false;
+	}
+	for (int i = 0; i < 4; i++)
+		previousViewport[i] = 0;
+}
+
+bool SparseTexturesSupported()
+{
+#ifdef HAVE_SPARSE_TEXTURE
+	return GLAD_GL_ARB_sparse_texture && GLAD_GL_VERSION_4_2;
+#else
+	return false;
+#endif
+}
+
+// --------------------------------------------------------------------------
+// Tile files
+
+static GLsizei LevelWidth(const VirtualLayer *layer, int level)
+{
+	return GLsizei(std::max(1u, layer->header.width >> level));
+}
+
+static GLsizei LevelHeight(const VirtualLayer *layer, int level)
+{
+	return GLsizei(std::max(1u, layer->header.height >> level));
+}
+
+static int TileIndex(const VirtualLayer *layer, int level, int x, int y)
+{
+	return layer->first[level] + y * layer->across[level] + x;
+}
+
+static bool OpenLayer(VirtualLayer *layer, const char *filename)
+{
+	layer->filename = filename;
+	layer->file.open(filename, ios::binary);
+	if (!layer->file) {
+		cout << "ERROR: Could not open tile file " << filename << endl;
+		return false;
+	}
+
+	VirtualTileHeader &header = layer->header;
+	layer->file.read((char*)&header, sizeof(header));
+	if (!layer->file || memcmp(header.magic, VIRTUAL_TILE_MAGIC, 8) != 0 || header.version != VIRTUAL_TILE_VERSION
+		|| header.width == 0 || header.height == 0 || header.tileSize == 0 || header.levels == 0 || header.levels > 32) {
+		cout << "ERROR: " << filename << " is not a version " << VIRTUAL_TILE_VERSION << " tile file" << endl;
+		return false;
+	}
+
+	GLsizei tiles = 0;
+	for (int level = 0; level < int(header.levels); level++) {
+		GLsizei size = GLsizei(header.tileSize);
+		layer->across.push_back((LevelWidth(layer, level) + size - 1) / size);
+		layer->down.push_back((LevelHeight(layer, level) + size - 1) / size);
+		layer->first.push_back(tiles);
+		tiles += layer->across.back() * layer->down.back();
+	}
+	if (layer->across.back() != 1 || layer->down.back() != 1) {
+		cout << "ERROR: the last level of " << filename << " is more than one tile" << endl;
+		return false;
+	}
+	layer->pages.assign(tiles, VIRTUAL_ABSENT);
+
+	// a truncated file is caught here, not when its last tiles are first seen
+	size_t side = header.tileSize + 2*header.border;
+	layer->file.seekg(0, ios::end);
+	if (size_t(layer->file.tellg()) < sizeof(header) + size_t(tiles) * side * side * 4) {
+		cout << "ERROR: " << filename << " is truncated" << endl;
+		return false;
+	}
+	return true;
+}
+
+// reads one tile, border and all; safe to call from any thread
+static bool ReadTile(const VirtualTextures *textures, VirtualLayer *layer, int tile, vector<unsigned char> *texels)
+{
+	size_t bytes = size_t(textures->pageSize) * textures->pageSize * 4;
+	texels->resize(bytes);
+
+	lock_guard<mutex> guard(layer->lock);
+	layer->file.clear();
+	layer->file.seekg(streamoff(sizeof(VirtualTileHeader) + size_t(tile) * bytes));
+	return bool(layer->file.read((char*)&(*texels)[0], bytes));
+}
+
+// --------------------------------------------------------------------------
+// Pages
+
+// a sparse tile's page, clipped to its level of the array
+static void CommitTile(const VirtualTextures *textures, const VirtualPage *page, bool commit)
+{
+#ifdef HAVE_SPARSE_TEXTURE
+	GLint x = page->x * textures->tileSize, y = page->y * textures->tileSize;
+	GLsizei width = std::min(textures->tileSize, std::max(1, textures->physicalWidth >> page->level) - x);
+	GLsizei height = std::min(textures->tileSize, std::max(1, textures->physicalHeight >> page->level) - y);
+	glTexPageCommitmentARB(GL_TEXTURE_2D_ARRAY, page->level, x, y, page->layer, width, height, 1,
+		commit ? GL_TRUE : GL_FALSE);
+#else
+	(void)textures;
+	(void)page;
+	(void)commit;
+#endif
+}
+
+// takes the page's tile out of its layer; the physical texture must be bound
+static void ReleasePage(VirtualTextures *textures, int index)
+{
+	VirtualPage &page = textures->pages[index];
+	VirtualLayer *layer = &textures->layers[page.layer];
+	layer->pages[TileIndex(layer, page.level, page.x, page.y)] = VIRTUAL_ABSENT;
+	layer->dirty = true;
+	if (textures->sparse && page.level < textures->tailLevel && !page.loading)
+		CommitTile(textures, &page, false);
+	page.layer = -1;
+	page.pinned = page.loading = false;
+}
+
+// a free page, or the least recently used one that the latest feedback
+// did not ask for; -1 if every page is in use
+static int AllocatePage(VirtualTextures *textures, int *evicted)
+{
+	int best = -1;
+	for (size_t i = 0; i < textures->pages.size(); i++) {
+		const VirtualPage &page = textures->pages[i];
+		if (page.layer < 0) return int(i);
+		if (page.pinned || page.loading || page.lastUsed >= textures->frame) continue;
+		if (best < 0 || page.lastUsed < textures->pages[best].lastUsed) best = int(i);
+	}
+	if (best >= 0) {
+		ReleasePage(textures, best);
+		(*evicted)++;
+	}
+	return best;
+}
+
+static int AssignPage(VirtualTextures *textures, int layer, int level, int x, int y, int *evicted)
+{
+	int index = AllocatePage(textures, evicted);
+	if (index < 0) return -1;
+
+	VirtualPage page = { layer, level, x, y, textures->frame, false, true };
+	textures->pages[index] = page;
+	VirtualLayer *source = &textures->layers[layer];
+	source->pages[TileIndex(source, level, x, y)] = index;
+	return index;
+}
+
+// copies a tile into its page; the physical texture must be bound
+static void UploadTile(VirtualTextures *textures, int index, const unsigned char *texels)
+{
+	VirtualPage &page = textures->pages[index];
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if (textures->sparse) {
+		// the sampler filters across tiles itself, so only the tile's own
+		// texels go up, without their border
+		const VirtualLayer *layer = &textures->layers[page.layer];
+		GLint x = page.x * textures->tileSize, y = page.y * textures->tileSize;
+		GLsizei width = std::min(textures->tileSize, LevelWidth(layer, page.level) - x);
+		GLsizei height = std::min(textures->tileSize, LevelHeight(layer, page.level) - y);
+		if (page.level < textures->tailLevel)
+			CommitTile(textures, &page, true);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, textures->pageSize);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, textures->border);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, textures->border);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, page.level, x, y, page.layer, width, height, 1,
+			GL_RGBA, GL_UNSIGNED_BYTE, texels);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	}
+	else {
+		GLint x = (index % VIRTUAL_CACHE_PAGES) * textures->pageSize;
+		GLint y = (index / VIRTUAL_CACHE_PAGES) * textures->pageSize;
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, 0, textures->pageSize, textures->pageSize, 1,
+			GL_RGBA, GL_UNSIGNED_BYTE, texels);
+	}
+	page.loading = false;
+}
+
+// rewrites a layer's indirection texture, coarsest level first: a tile
+// counts as resident only if its parent does, so sampling never reaches a
+// level below it that is missing, and a tile that is not resident takes
+// its parent's entry. The indirection texture must be bound
+static void UpdateIndirection(VirtualTextures *textures, int index)
+{
+	VirtualLayer *layer = &textures->layers[index];
+	int levels = int(layer->header.levels);
+	vector<unsigned char> entries, parents;
+	GLsizei parentAcross = 1, parentDown = 1;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for (int level = levels - 1; level >= 0; level--) {
+		GLsizei across = layer->across[level], down = layer->down[level];
+		entries.assign(size_t(across) * down * 4, 0);
+		for (int y = 0; y < down; y++) {
+			for (int x = 0; x < across; x++) {
+				unsigned char *entry = &entries[(size_t(y) * across + x) * 4];
+				const unsigned char *parent = level == levels - 1 ? 0
+					: &parents[(size_t(std::min(y/2, parentDown - 1)) * parentAcross + std::min(x/2, parentAcross - 1)) * 4];
+
+				int page = layer->pages[TileIndex(layer, level, x, y)];
+				bool resident = page >= 0 && !textures->pages[page].loading;
+				if (resident && (!parent || parent[2] == level + 1)) {
+					entry[0] = (unsigned char)(page % VIRTUAL_CACHE_PAGES);
+					entry[1] = (unsigned char)(page / VIRTUAL_CACHE_PAGES);
+					entry[2] = (unsigned char)level;
+					entry[3] = 255;
+				}
+				else if (parent)
+					memcpy(entry, parent, 4);
+			}
+		}
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, index, across, down, 1,
+			GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, &entries[0]);
+		parents.swap(entries);
+		parentAcross = across;
+		parentDown = down;
+	}
+	layer->dirty = false;
+}
+
+// --------------------------------------------------------------------------
+// Initialization
+
+// one sparse array as large as the largest map; false if the driver cannot
+// commit a single tile's worth of it
+static bool InitializeSparse(VirtualTextures *textures, GLsizei width, GLsizei height)
+{
+#ifdef HAVE_SPARSE_TEXTURE
+	GLint maxSize = 0, maxLayers = 0;
+	glGetIntegerv(GL_MAX_SPARSE_TEXTURE_SIZE_ARB, &maxSize);
+	glGetIntegerv(GL_MAX_SPARSE_ARRAY_TEXTURE_LAYERS_ARB, &maxLayers);
+	if (width > maxSize || height > maxSize || textures->layerCount > maxLayers)
+		return false;
+
+	// a tile must be exactly one virtual page to be committed on its own
+	GLint sizes = 0;
+	glGetInternalformativ(GL_TEXTURE_2D_ARRAY, GL_RGBA8, GL_NUM_VIRTUAL_PAGE_SIZES_ARB, 1, &sizes);
+	if (sizes <= 0)
+		return false;
+	vector<GLint> pageX(sizes), pageY(sizes), pageZ(sizes);
+	glGetInternalformativ(GL_TEXTURE_2D_ARRAY, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_X_ARB, sizes, &pageX[0]);
+	glGetInternalformativ(GL_TEXTURE_2D_ARRAY, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_Y_ARB, sizes, &pageY[0]);
+	glGetInternalformativ(GL_TEXTURE_2D_ARRAY, GL_RGBA8, GL_VIRTUAL_PAGE_SIZE_Z_ARB, sizes, &pageZ[0]);
+	int pageIndex = -1;
+	for (int i = 0; i < sizes; i++)
+		if (pageX[i] == textures->tileSize && pageY[i] == textures->tileSize && pageZ[i] == 1) pageIndex = i;
+	if (pageIndex < 0)
+		return false;
+
+	glGenTextures(1, &textures->physical);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textures->physical);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SPARSE_ARB, GL_TRUE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_VIRTUAL_PAGE_SIZE_INDEX_ARB, pageIndex);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, textures->levels, GL_RGBA8, width, height, textures->layerCount);
+	glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_NUM_SPARSE_LEVELS_ARB, &textures->tailLevel);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	textures->physicalWidth = width;
+	textures->physicalHeight = height;
+
+	// the levels smaller than a page share pages, so they are committed
+	// whole and for good
+	for (int level = textures->tailLevel; level < textures->levels; level++)
+		glTexPageCommitmentARB(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, std::max(1, width >> level),
+			std::max(1, height >> level), textures->layerCount, GL_TRUE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	if (CheckGLErrors()) {
+		glDeleteTextures(1, &textures->physical);
+		textures->physical = 0;
+		return false;
+	}
+	return true;
+#else
+	(void)textures;
+	(void)width;
+	(void)height;
+	return false;
+#endif
+}
+
+// the fallback: tiles in the pages of one ordinary texture
+static void InitializeCache(VirtualTextures *textures)
+{
+	textures->physicalWidth = textures->physicalHeight = VIRTUAL_CACHE_PAGES * textures->pageSize;
+	textures->tailLevel = textures->levels;
+
+	glGenTextures(1, &textures->physical);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textures->physical);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, textures->physicalWidth, textures->physicalHeight, 1, 0,
+		GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+static GLsizei PowerOfTwoAtLeast(GLsizei size)
+{
+	GLsizei power = 1;
+	while (power < size) power *= 2;
+	return power;
+}
+
+// (re)allocates the feedback target and its pixel buffers for a framebuffer
+// of width x height; feedback already issued is of the old size, so dropped
+static void SizeFeedback(VirtualTextures *textures, GLsizei width, GLsizei height)
+{
+	textures->feedbackWidth = std::max(1, width / VIRTUAL_FEEDBACK_SCALE);
+	textures->feedbackHeight = std::max(1, height / VIRTUAL_FEEDBACK_SCALE);
+	glBindRenderbuffer(GL_RENDERBUFFER, textures->feedbackColour);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, textures->feedbackWidth, textures->feedbackHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, textures->feedbackDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, textures->feedbackWidth, textures->feedbackHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	for (int i = 0; i < VIRTUAL_FEEDBACK_FRAMES; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, textures->feedbackBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(textures->feedbackWidth) * textures->feedbackHeight * 4 * sizeof(GLushort),
+			0, GL_STREAM_READ);
+		textures->feedbackIssued[i] = false;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool InitializeVirtualTextures(VirtualTextures *textures, JobSystem *jobs, const char *const *filenames, int count,
+	GLsizei width, GLsizei height, bool sparse)
+{
+	textures->jobs = jobs;
+	textures->layerCount = std::min(count, VIRTUAL_MAX_LAYERS);
+	if (textures->layerCount <= 0)
+		return false;
+	for (int i = 0; i < textures->layerCount; i++)
+		if (!OpenLayer(&textures->layers[i], filenames[i])) return false;
+
+	// every layer shares the pages, so every layer shares their size
+	const VirtualTileHeader &header = textures->layers[0].header;
+	textures->tileSize = GLsizei(header.tileSize);
+	textures->border = GLsizei(header.border);
+	textures->pageSize = textures->tileSize + 2*textures->border;
+	GLsizei maxWidth = 0, maxHeight = 0, maxAcross = 0, maxDown = 0;
+	for (int i = 0; i < textures->layerCount; i++) {
+		const VirtualLayer *layer = &textures->layers[i];
+		if (layer->header.tileSize != header.tileSize || layer->header.border != header.border) {
+			cout << "ERROR: " << layer->filename << " does not share the tile size and border of " << textures->layers[0].filename << endl;
+			return false;
+		}
+		maxWidth = std::max(maxWidth, GLsizei(layer->header.width));
+		maxHeight = std::max(maxHeight, GLsizei(layer->header.height));
+		maxAcross = std::max(maxAcross, layer->across[0]);
+		maxDown = std::max(maxDown, layer->down[0]);
+		textures->levels = std::max(textures->levels, GLsizei(layer->header.levels));
+	}
+
+	textures->sparse = sparse && SparseTexturesSupported() && InitializeSparse(textures, maxWidth, maxHeight);
+	if (!textures->sparse)
+		InitializeCache(textures);
+	cout << "Virtual textures: " << (textures->sparse ? "sparse" : "page cache") << ", "
+		<< VIRTUAL_CACHE_PAGES * VIRTUAL_CACHE_PAGES << " tiles of " << textures->tileSize << "x" << textures->tileSize << endl;
+
+	// a power of two keeps every level at least as many texels across as
+	// the layers have tiles there
+	textures->indirectionWidth = PowerOfTwoAtLeast(maxAcross);
+	textures->indirectionHeight = PowerOfTwoAtLeast(maxDown);
+	textures->indirectionLevels = 1;
+	while ((std::max(textures->indirectionWidth, textures->indirectionHeight) >> textures->indirectionLevels) > 0)
+		textures->indirectionLevels++;
+	glGenTextures(1, &textures->indirection);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textures->indirection);
+	for (int level = 0; level < textures->indirectionLevels; level++)
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8UI, std::max(1, textures->indirectionWidth >> level),
+			std::max(1, textures->indirectionHeight >> level), textures->layerCount, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, textures->indirectionLevels - 1);
+
+	VirtualUniforms uniforms;
+	for (int i = 0; i < VIRTUAL_MAX_LAYERS; i++) {
+		const VirtualTileHeader &layer = textures->layers[std::min(i, textures->layerCount - 1)].header;
+		uniforms.layerSizes[i] = vec4(float(layer.width), float(layer.height), float(layer.levels), 0.f);
+	}
+	uniforms.page = vec4(float(textures->tileSize), float(textures->border), float(textures->pageSize), float(textures->physicalWidth));
+	uniforms.options = vec4(textures->sparse ? 1.f : 0.f, -std::log2(float(VIRTUAL_FEEDBACK_SCALE)),
+		float(textures->physicalWidth), float(textures->physicalHeight));
+	glGenBuffers(1, &textures->uniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, textures->uniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(uniforms), &uniforms, GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, VIRTUAL_BLOCK_BINDING, textures->uniformBuffer);
+
+	// the feedback target, and a pixel buffer per frame it stays in flight
+	glGenRenderbuffers(1, &textures->feedbackColour);
+	glGenRenderbuffers(1, &textures->feedbackDepth);
+	glGenBuffers(VIRTUAL_FEEDBACK_FRAMES, textures->feedbackBuffers);
+	SizeFeedback(textures, width, height);
+
+	glGenFramebuffers(1, &textures->feedbackFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, textures->feedbackFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, textures->feedbackColour);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, textures->feedbackDepth);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (!complete) {
+		cout << "ERROR: virtual texture feedback framebuffer is incomplete" << endl;
+		return false;
+	}
+
+	// the coarsest level of every map, and with sparse textures the mip
+	// tail, is loaded now and never evicted, so there is always something
+	// to draw
+	VirtualPage free = { -1, 0, 0, 0, 0, false, false };
+	textures->pages.assign(VIRTUAL_CACHE_PAGES * VIRTUAL_CACHE_PAGES, free);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textures->physical);
+	vector<unsigned char> texels;
+	int evicted = 0;
+	for (int i = 0; i < textures->layerCount; i++) {
+		VirtualLayer *layer = &textures->layers[i];
+		int levels = int(layer->header.levels);
+		for (int level = std::min(levels - 1, int(textures->tailLevel)); level < levels; level++) {
+			for (int y = 0; y < layer->down[level]; y++) {
+				for (int x = 0; x < layer->across[level]; x++) {
+					int page = AssignPage(textures, i, level, x, y, &evicted);
+					if (page < 0) {
+						cout << "ERROR: the coarsest levels of the virtual textures do not fit in the cache" << endl;
+						return false;
+					}
+					if (!ReadTile(textures, layer, TileIndex(layer, level, x, y), &texels)) {
+						cout << "ERROR: could not read a tile of " << layer->filename << endl;
+						return false;
+					}
+					UploadTile(textures, page, &texels[0]);
+					textures->pages[page].pinned = true;
+				}
+			}
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textures->indirection);
+	for (int i = 0; i < textures->layerCount; i++)
+		UpdateIndirection(textures, i);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	return !CheckGLErrors();
+}
+
+// --------------------------------------------------------------------------
+// Streaming
+
+// a tile of a layer, ordered coarsest level first
+struct TileKey
+{
+	int level;
+	int layer;
+	int y;
+	int x;
+
+	bool operator<(const TileKey &other) const
+	{
+		if (level != other.level) return level > other.level;
+		if (layer != other.layer) return layer < other.layer;
+		if (y != other.y) return y < other.y;
+		return x < other.x;
+	}
+	bool operator==(const TileKey &other) const
+	{
+		return level == other.level && layer == other.layer && y == other.y && x == other.x;
+	}
+};
+
+// the tiles a feedback buffer asks for, each once
+static void ReadFeedback(VirtualTextures *textures, int buffer, vector<TileKey> *keys)
+{
+	GLsizei texels = textures->feedbackWidth * textures->feedbackHeight;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, textures->feedbackBuffers[buffer]);
+	const GLushort *feedback = (const GLushort*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+		GLsizeiptr(texels) * 4 * sizeof(GLushort), GL_MAP_READ_BIT);
+	if (feedback) {
+		for (GLsizei i = 0; i < texels; i++) {
+			const GLushort *texel = feedback + 4*i;
+			int layer = int(texel[3]) - 1;
+			if (layer < 0 || layer >= textures->layerCount) continue;
+			TileKey key = { int(texel[2]), layer, int(texel[1]), int(texel[0]) };
+			keys->push_back(key);
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	textures->feedbackIssued[buffer] = false;
+
+	sort(keys->begin(), keys->end());
+	keys->erase(unique(keys->begin(), keys->end()), keys->end());
+}
+
+// marks what the feedback asked for as used, with every ancestor, and
+// starts reading the ones that are missing, coarsest first
+static int RequestTiles(VirtualTextures *textures, const vector<TileKey> &keys)
+{
+	vector<TileKey> wanted;
+	for (size_t i = 0; i < keys.size(); i++) {
+		VirtualLayer *layer = &textures->layers[keys[i].layer];
+		int levels = int(layer->header.levels);
+		if (keys[i].level >= levels) continue;
+		for (int level = keys[i].level; level < levels; level++) {
+			int shift = level - keys[i].level;
+			int x = std::min(keys[i].x >> shift, layer->across[level] - 1);
+			int y = std::min(keys[i].y >> shift, layer->down[level] - 1);
+			int page = layer->pages[TileIndex(layer, level, x, y)];
+			if (page >= 0)
+				textures->pages[page].lastUsed = textures->frame;
+			else if (page == VIRTUAL_ABSENT) {
+				TileKey key = { level, keys[i].layer, y, x };
+				wanted.push_back(key);
+			}
+		}
+	}
+	sort(wanted.begin(), wanted.end());
+	wanted.erase(unique(wanted.begin(), wanted.end()), wanted.end());
+
+	int evicted = 0;
+	for (size_t i = 0; i < wanted.size() && textures->pending.size() < VIRTUAL_MAX_LOADS; i++) {
+		const TileKey &key = wanted[i];
+		VirtualLayer *layer = &textures->layers[key.layer];
+		int tile = TileIndex(layer, key.level, key.x, key.y);
+		if (layer->pages[tile] != VIRTUAL_ABSENT) continue;
+
+		int page = AssignPage(textures, key.layer, key.level, key.x, key.y, &evicted);
+		if (page < 0) break;
+
+		// reading only touches the request and the layer's file
+		VirtualTileRequest *request = new VirtualTileRequest;
+		request->page = page;
+		textures->pending.push_back(request);
+		const VirtualTextures *source = textures;
+		SubmitJob(textures->jobs, &textures->loads, [source, layer, tile, request]() {
+			request->valid = ReadTile(source, layer, tile, &request->texels);
+			request->loaded = true;
+		});
+	}
+	return evicted;
+}
+
+// binds texture for uploading through the cache, on the active unit
+static void BindForUpload(RenderState *state, GLuint texture)
+{
+	BindTexture(state, 0, GL_TEXTURE_2D_ARRAY, texture);
+
+	// a binding the cache skipped may be on a unit that is not active
+	if (state->activeUnit != 0) {
+		glActiveTexture(GL_TEXTURE0);
+		state->activeUnit = 0;
+		state->changes++;
+	}
+}
+
+int UpdateVirtualTextures(VirtualTextures *textures, RenderState *state)
+{
+	textures->frame++;
+
+	// evicting a sparse tile decommits it, so the array must be bound first
+	BindForUpload(state, textures->physical);
+
+	// the oldest feedback, which the GPU finished frames ago
+	int changes = 0;
+	if (textures->feedbackIssued[textures->feedbackNext]) {
+		vector<TileKey> keys;
+		ReadFeedback(textures, textures->feedbackNext, &keys);
+		changes += RequestTiles(textures, keys);
+	}
+
+	for (size_t i = 0, uploads = 0; i < textures->pending.size(); ) {
+		VirtualTileRequest *request = textures->pending[i];
+		if (!request->loaded || uploads >= VIRTUAL_UPLOADS_PER_FRAME) {
+			i++;
+			continue;
+		}
+
+		VirtualPage &page = textures->pages[request->page];
+		VirtualLayer *layer = &textures->layers[page.layer];
+		if (request->valid) {
+			UploadTile(textures, request->page, &request->texels[0]);
+			uploads++;
+		}
+		else {
+			// a tile that cannot be read is not asked for again
+			cout << "ERROR: could not read a tile of " << layer->filename << endl;
+			int tile = TileIndex(layer, page.level, page.x, page.y);
+			ReleasePage(textures, request->page);
+			layer->pages[tile] = VIRTUAL_FAILED;
+		}
+		layer->dirty = true;
+		changes++;
+
+		delete request;
+		textures->pending.erase(textures->pending.begin() + i);
+	}
+
+	if (changes > 0) {
+		BindForUpload(state, textures->indirection);
+		for (int i = 0; i < textures->layerCount; i++)
+			if (textures->layers[i].dirty) UpdateIndirection(textures, i);
+	}
+
+	return changes;
+}
+
+void BindVirtualTextures(RenderState *state, const VirtualTextures *textures, GLuint unit)
+{
+	BindTexture(state, unit, GL_TEXTURE_2D_ARRAY, textures->physical);
+	BindTexture(state, VIRTUAL_INDIRECTION_UNIT, GL_TEXTURE_2D_ARRAY, textures->indirection);
+}
+
+// --------------------------------------------------------------------------
+// Feedback
+
+void BeginVirtualFeedback(VirtualTextures *textures)
+{
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &textures->previousFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, textures->previousViewport);
+
+	// layer 0 marks pixels no body covers
+	const GLuint none[4] = { 0, 0, 0, 0 };
+	const GLfloat farthest = 1.f;
+	glBindFramebuffer(GL_FRAMEBUFFER, textures->feedbackFramebuffer);
+	glViewport(0, 0, textures->feedbackWidth, textures->feedbackHeight);
+	glClearBufferuiv(GL_COLOR, 0, none);
+	glClearBufferfv(GL_DEPTH, 0, &farthest);
+}
+
+void EndVirtualFeedback(VirtualTextures *textures)
+{
+	// into the buffer UpdateVirtualTextures reads last, with no wait here
+	int buffer = textures->feedbackNext;
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, textures->feedbackBuffers[buffer]);
+	glReadPixels(0, 0, textures->feedbackWidth, textures->feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	textures->feedbackIssued[buffer] = true;
+	textures->feedbackNext = (buffer + 1) % VIRTUAL_FEEDBACK_FRAMES;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, textures->previousFramebuffer);
+	glViewport(textures->previousViewport[0], textures->previousViewport[1],
+		textures->previousViewport[2], textures->previousViewport[3]);
+}
+
+void ResizeVirtualFeedback(VirtualTextures *textures, GLsizei width, GLsizei height)
+{
+	if (!textures->feedbackFramebuffer) return;
+	if (std::max(1, width / VIRTUAL_FEEDBACK_SCALE) == textures->feedbackWidth
+		&& std::max(1, height / VIRTUAL_FEEDBACK_SCALE) == textures->feedbackHeight) return;
+	SizeFeedback(textures, width, height);
+	CheckGLErrors();
+}
+
+void DestroyVirtualTextures(VirtualTextures *textures)
+{
+	if (textures->jobs)
+		WaitForJobs(textures->jobs, &textures->loads);
+	for (size_t i = 0; i < textures->pending.size(); i++)
+		delete textures->pending[i];
+	textures->pending.clear();
+
+	glDeleteTextures(1, &textures->physical);
+	glDeleteTextures(1, &textures->indirection);
+	glDeleteBuffers(1, &textures->uniformBuffer);
+	glDeleteFramebuffers(1, &textures->feedbackFramebuffer);
+	glDeleteRenderbuffers(1, &textures->feedbackColour);
+	glDeleteRenderbuffers(1, &textures->feedbackDepth);
+	glDeleteBuffers(VIRTUAL_FEEDBACK_FRAMES, textures->feedbackBuffers);
+	for (int i = 0; i < textures->layerCount; i++)
+		textures->layers[i].file.close();
+}
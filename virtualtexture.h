@@ -0,0 +1,239 @@
+// ==========================================================================
+// Virtual texturing for planet maps larger than video memory
+//
+// Each body's map is cut offline (tools/tileconvert.cpp) into square tiles
+// at every mip level, and only the tiles the camera can actually see are
+// kept on the GPU, in a cache whose size is fixed whatever the resolution
+// of the maps. A frame looks like
+//
+//	UpdateVirtualTextures(&virtualTextures, &renderState);	// stream, evict
+//	BindVirtualTextures(&renderState, &virtualTextures, 0);
+//	... draw with a *_virtual fragment shader ...
+//	BeginVirtualFeedback(&virtualTextures);
+//	... draw the same meshes with virtual_feedback_fragment.glsl ...
+//	EndVirtualFeedback(&virtualTextures);
+//
+// The feedback pass renders the bodies again at 1/VIRTUAL_FEEDBACK_SCALE of
+// the resolution, writing the tile and level each pixel would sample. It is
+// read back through pixel buffers VIRTUAL_FEEDBACK_FRAMES frames later, so
+// the CPU never waits, and missing tiles are read from disk on the job
+// system, coarsest first, evicting the least recently seen. Until a tile
+// arrives its nearest resident ancestor is drawn instead.
+//
+// With ARB_sparse_texture, and a virtual page the size of a tile, the maps
+// are one sparse array texture as large as the largest map: a tile is
+// committed where it belongs and the sampler filters across tiles and
+// levels itself. Elsewhere tiles live in pages of one ordinary texture,
+// VIRTUAL_CACHE_PAGES square, and an indirection texture says where. Both
+// ways, the indirection texture names each tile's finest resident level,
+// and the shaders read the layout from a std140 uniform block bound to
+// VIRTUAL_BLOCK_BINDING:
+//
+//	layout(std140) uniform VirtualTextureData {
+//		vec4 layerSizes[VIRTUAL_MAX_LAYERS];	// width, height, levels
+//		vec4 page;		// tile size, border, page size, cache size
+//		vec4 options;		// 1 if sparse, feedback lod bias,
+//					// and the sparse array's width and height
+//	};
+//
+// A sparse map may show a texel-wide seam against a neighbouring tile that
+// has not yet been streamed; cache pages carry a border and do not.
+// ==========================================================================
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "jobs.h"
+#include "renderstate.h"
+
+#define VIRTUAL_TILE_MAGIC "A5VTEX\0\0"
+#define VIRTUAL_TILE_VERSION 1
+
+// must match the layerSizes array of the virtual shaders
+#define VIRTUAL_MAX_LAYERS 8
+
+// pages across and down the cache texture, and so the tiles kept resident
+#define VIRTUAL_CACHE_PAGES 32
+
+// the feedback pass's size as a fraction of the window, and the frames its
+// results wait before they are read back
+#define VIRTUAL_FEEDBACK_SCALE 8
+#define VIRTUAL_FEEDBACK_FRAMES 3
+
+// tiles uploaded per UpdateVirtualTextures, and tiles read at once
+#define VIRTUAL_UPLOADS_PER_FRAME 16
+#define VIRTUAL_MAX_LOADS 64
+
+// the texture unit the indirection texture is bound to
+#define VIRTUAL_INDIRECTION_UNIT 2
+
+// a tile file starts with this, followed by every tile of level 0 in rows,
+// then of level 1, and so on; a tile is the tile's texels surrounded by
+// border texels from its neighbours (wrapping around in x), RGBA8, and the
+// last level is a single tile
+struct VirtualTileHeader
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t tileSize;
+	uint32_t border;
+	uint32_t levels;
+};
+
+// what a layer's tile slot says when the tile is not in a cache page
+enum
+{
+	VIRTUAL_ABSENT = -1,
+	VIRTUAL_FAILED = -2
+};
+
+// one map and its tiles
+struct VirtualLayer
+{
+	std::string       filename;
+	std::ifstream     file;
+	std::mutex        lock;		// tiles are read from worker threads
+	VirtualTileHeader header;
+
+	// per level: tiles across and down, and the index of the first
+	std::vector<GLsizei> across;
+	std::vector<GLsizei> down;
+	std::vector<GLsizei> first;
+
+	// per tile: the page holding it, or VIRTUAL_ABSENT or VIRTUAL_FAILED
+	std::vector<int> pages;
+
+	// the indirection texture is out of date
+	bool dirty;
+
+	VirtualLayer() : dirty(false)
+	{}
+};
+
+// a page of the cache, or with sparse textures the right to commit one
+struct VirtualPage
+{
+	int      layer;		// -1 when free
+	int      level;
+	int      x;
+	int      y;
+	unsigned lastUsed;	// the last feedback that asked for it
+	bool     pinned;	// coarse levels keep something to fall back on
+	bool     loading;
+};
+
+// a tile being read from disk
+struct VirtualTileRequest
+{
+	int page;
+	std::vector<unsigned char> texels;
+	bool valid;
+	std::atomic<bool> loaded;
+
+	VirtualTileRequest() : page(-1), valid(false), loaded(false)
+	{}
+};
+
+// mirrors the std140 layout of the VirtualTextureData block
+struct VirtualUniforms
+{
+	glm::vec4 layerSizes[VIRTUAL_MAX_LAYERS];
+	glm::vec4 page;
+	glm::vec4 options;
+};
+
+struct VirtualTextures
+{
+	bool sparse;
+
+	// texels of a tile and of the border around it; a page is both
+	GLsizei tileSize;
+	GLsizei border;
+	GLsizei pageSize;
+
+	// the cache or sparse array texture, and the first of its levels that
+	// cannot be committed tile by tile
+	GLuint  physical;
+	GLsizei physicalWidth;
+	GLsizei physicalHeight;
+	GLsizei levels;
+	GLint   tailLevel;
+
+	// RGBA8UI, a layer per map: page x and y, and the resident level
+	GLuint  indirection;
+	GLsizei indirectionWidth;
+	GLsizei indirectionHeight;
+	GLsizei indirectionLevels;
+
+	GLuint uniformBuffer;
+
+	VirtualLayer layers[VIRTUAL_MAX_LAYERS];
+	int          layerCount;
+
+	std::vector<VirtualPage> pages;
+	std::vector<VirtualTileRequest*> pending;
+	JobSystem *jobs;
+	JobCounter loads;
+	unsigned   frame;
+
+	// the feedback pass's target, and the pixel buffers it is read into
+	GLuint  feedbackFramebuffer;
+	GLuint  feedbackColour;
+	GLuint  feedbackDepth;
+	GLsizei feedbackWidth;
+	GLsizei feedbackHeight;
+	GLuint  feedbackBuffers[VIRTUAL_FEEDBACK_FRAMES];
+	bool    feedbackIssued[VIRTUAL_FEEDBACK_FRAMES];
+	int     feedbackNext;
+	GLint   previousFramebuffer;
+	GLint   previousViewport[4];
+
+	// initialize object names to zero (OpenGL reserved value)
+	VirtualTextures();
+};
+
+// whether the sparse backend can be used at all; InitializeVirtualTextures
+// still falls back if the tile size is not a virtual page size
+bool SparseTexturesSupported();
+
+// opens count tile files, which become layers 0 to count-1, and allocates
+// the cache, the indirection texture and a feedback target for a
+// framebuffer of width x height; the coarsest levels are loaded before it
+// returns
+bool InitializeVirtualTextures(VirtualTextures *textures, JobSystem *jobs, const char *const *filenames, int count,
+	GLsizei width, GLsizei height, bool sparse);
+
+// reads back the oldest feedback, starts reading the tiles it asks for,
+// uploads tiles that have arrived and updates the indirection texture;
+// returns the number of tiles uploaded or evicted
+int UpdateVirtualTextures(VirtualTextures *textures, RenderState *state);
+
+// binds the cache or sparse array to unit and the indirection texture to
+// VIRTUAL_INDIRECTION_UNIT
+void BindVirtualTextures(RenderState *state, const VirtualTextures *textures, GLuint unit);
+
+// redirects drawing into the feedback target until EndVirtualFeedback
+void BeginVirtualFeedback(VirtualTextures *textures);
+
+// queues the feedback for reading back, and restores the framebuffer and
+// viewport that were bound before
+void EndVirtualFeedback(VirtualTextures *textures);
+
+// sizes the feedback target for a framebuffer now width x height; feedback
+// still in flight is dropped
+void ResizeVirtualFeedback(VirtualTextures *textures, GLsizei width, GLsizei height);
+
+// waits for outstanding reads, then frees everything
+void DestroyVirtualTextures(VirtualTextures *textures);
+
+#endif